@@ -14,56 +14,118 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stdatomic.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "driver/i2s.h"
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "soc/i2s_struct.h"
 #include "soc/apb_ctrl_reg.h"
 #include "esp32s2/rom/lldesc.h"
 #include "esp32s2/rom/cache.h"
 #include "soc/dport_access.h"
 #include "soc/dport_reg.h"
+#include "soc/soc_memory_layout.h"
 #include "driver/ledc.h"
 #include "cam.h"
+#include "dma_plan.h"
 #include "hal/gpio_ll.h"
+#include "cam_ring.h"
+#include "cam_jpeg.h"
 
 static const char *TAG = "cam";
 
 #define CAM_DMA_MAX_SIZE     (4095)
 
+#ifdef CONFIG_CAM_STATS_ENABLE
+#define CAM_STATS(x) x
+#define CAM_STATS_TIME() esp_timer_get_time()
+#else
+#define CAM_STATS(x)              /*!< Statistics are compiled out */
+#define CAM_STATS_TIME() 0
+#endif
+
 typedef enum {
     CAM_IN_SUC_EOF_EVENT = 0,
     CAM_VSYNC_EVENT
 } cam_event_t;
 
 typedef struct {
-    uint8_t *frame_buffer;
-    size_t len;
-} frame_buffer_event_t;
+    uint8_t *buf;
+    lldesc_t *dma;            /*!< Descriptor chain over buf, zero copy mode only */
+} cam_frame_buffer_t;
+
+#ifdef CONFIG_CAM_SIM_ENABLE
+typedef struct {
+    uint8_t enable;
+    uint16_t fps;
+    volatile uint8_t vsync_en;    /*!< Stands for the VSYNC GPIO interrupt enable */
+    volatile uint8_t dma_run;     /*!< Stands for I2S0.int_ena.in_suc_eof */
+    volatile uint8_t dma_restart; /*!< Set by cam_dma_start, the generator goes back to the head of link */
+    lldesc_t *volatile link;      /*!< Stands for I2S0.in_link.addr */
+    TaskHandle_t task_handle;
+} cam_sim_t;
+#endif
+
+/*!< The DMA of one frame size, allocated before cam_task takes it. NULL members: the current ones are reused */
+typedef struct {
+    dma_plan_t plan;
+    uint16_t width;
+    uint16_t high;
+    uint32_t total_cnt;
+    uint8_t *buffer;
+    lldesc_t *dma;
+    lldesc_t *frame_dma[CAM_FRAME_BUFFER_MAX_NUM];
+} cam_dma_layout_t;
 
 typedef struct {
+    dma_plan_t plan;
     uint32_t buffer_size;
     uint32_t half_buffer_size;
     uint32_t node_cnt;
     uint32_t half_node_cnt;
-    uint32_t dma_size;
     uint32_t cnt;
     uint32_t total_cnt;
     uint16_t width;
     uint16_t high;
+    uint32_t frame_size;
+    uint32_t frame_buffer_size; /*!< Bytes of every frame buffer, the frame size at cam_init */
+    uint32_t max_buffer_size;
     lldesc_t *dma;
+    uint32_t node_cap;        /*!< Descriptors allocated in dma */
     uint8_t *buffer;
-    uint8_t *frame1_buffer;
-    uint8_t *frame2_buffer;
-    uint8_t frame1_buffer_en;
-    uint8_t frame2_buffer_en;
+    uint32_t buffer_cap;      /*!< Bytes allocated in buffer */
+    cam_frame_buffer_t frames[CAM_FRAME_BUFFER_MAX_NUM];
+    uint32_t frame_num;
+    atomic_uint frame_free_mask; /*!< Bit n set: frames[n] is free for the camera. Lock-free, cam_give and cam_task both touch it */
+    atomic_uint frame_hold_num;  /*!< Frames taken by the application and not given back yet */
+    uint32_t frame_max_hold_num;
+    uint32_t frame_seq;
+    uint32_t frame_captured;
+    uint32_t frame_dropped;
+    uint32_t frame_discarded;
+    uint32_t event_lost;
+    uint32_t frame_skip;      /*!< VSYNCs to let pass before the next capture */
+    bool started;             /*!< Between cam_start and cam_stop or cam_set_size */
+    atomic_uint resize_pending; /*!< Set by cam_set_size, handled by cam_task */
+    cam_dma_layout_t *resize_layout; /*!< On the stack of cam_set_size, only swapped in by cam_task */
+    SemaphoreHandle_t resize_done;
+    cam_ring_t event_ring;    /*!< The two ISRs are level 1 interrupts of one core and never preempt each other, so together they are the single producer */
+#ifdef CONFIG_CAM_STATS_ENABLE
+    cam_stats_t stats;
+    portMUX_TYPE stats_lock;
+#endif
+#ifdef CONFIG_CAM_SIM_ENABLE
+    cam_sim_t sim;            /*!< Synthetic source, replaces the I2S peripheral and the VSYNC pin */
+#endif
     uint8_t jpeg_mode;
+    uint8_t zero_copy;
     uint8_t vsync_pin;
     uint8_t vsync_invert;
     uint8_t hsync_invert;
-    QueueHandle_t event_queue;
     QueueHandle_t frame_buffer_queue;
     TaskHandle_t task_handle;
     intr_handle_t intr_handle;
@@ -71,16 +133,18 @@ typedef struct {
 
 static cam_obj_t *cam_obj = NULL;
 
+static void cam_dma_layout_free(cam_dma_layout_t *layout);
+static void cam_dma_layout_swap(cam_dma_layout_t *layout);
+
 void IRAM_ATTR cam_isr(void *arg)
 {
-    cam_event_t cam_event = {0};
     BaseType_t HPTaskAwoken = pdFALSE;
     typeof(I2S0.int_st) int_st = I2S0.int_st;
     I2S0.int_clr.val = int_st.val;
 
     if (int_st.in_suc_eof) {
-        cam_event = CAM_IN_SUC_EOF_EVENT;
-        xQueueSendFromISR(cam_obj->event_queue, (void *)&cam_event, &HPTaskAwoken);
+        cam_ring_push(&cam_obj->event_ring, CAM_IN_SUC_EOF_EVENT, CAM_STATS_TIME());
+        vTaskNotifyGiveFromISR(cam_obj->task_handle, &HPTaskAwoken);
     }
 
     if (HPTaskAwoken == pdTRUE) {
@@ -90,14 +154,13 @@ void IRAM_ATTR cam_isr(void *arg)
 
 void IRAM_ATTR cam_vsync_isr(void *arg)
 {
-    cam_event_t cam_event = {0};
     BaseType_t HPTaskAwoken = pdFALSE;
     /*!< filter */
     ets_delay_us(1);
 
     if (gpio_ll_get_level(&GPIO, cam_obj->vsync_pin) == !cam_obj->vsync_invert) {
-        cam_event = CAM_VSYNC_EVENT;
-        xQueueSendFromISR(cam_obj->event_queue, (void *)&cam_event, &HPTaskAwoken);
+        cam_ring_push(&cam_obj->event_ring, CAM_VSYNC_EVENT, CAM_STATS_TIME());
+        vTaskNotifyGiveFromISR(cam_obj->task_handle, &HPTaskAwoken);
     }
 
     if (HPTaskAwoken == pdTRUE) {
@@ -183,7 +246,7 @@ static void cam_set_pin(const cam_config_t *config)
     io_conf.pull_up_en = 1;
     io_conf.pull_down_en = 0;
     gpio_config(&io_conf);
-    gpio_install_isr_service(0);
+    gpio_install_isr_service(ESP_INTR_FLAG_LEVEL1); /*!< Same level as cam_isr, see cam_obj_t.event_ring */
     gpio_isr_handler_add(config->pin.vsync, cam_vsync_isr, NULL);
     gpio_intr_disable(config->pin.vsync);
 
@@ -234,6 +297,13 @@ static void cam_set_pin(const cam_config_t *config)
 
 static void cam_vsync_intr_enable(uint8_t en)
 {
+#ifdef CONFIG_CAM_SIM_ENABLE
+    if (cam_obj->sim.enable) {
+        cam_obj->sim.vsync_en = en;
+        return;
+    }
+#endif
+
     if (en) {
         gpio_intr_enable(cam_obj->vsync_pin);
     } else {
@@ -243,6 +313,13 @@ static void cam_vsync_intr_enable(uint8_t en)
 
 static void cam_dma_stop(void)
 {
+#ifdef CONFIG_CAM_SIM_ENABLE
+    if (cam_obj->sim.enable) {
+        cam_obj->sim.dma_run = 0;
+        return;
+    }
+#endif
+
     if (I2S0.int_ena.in_suc_eof == 1) {
         I2S0.conf.rx_start = 0;
         I2S0.int_ena.in_suc_eof = 0;
@@ -253,6 +330,17 @@ static void cam_dma_stop(void)
 
 static void cam_dma_start(void)
 {
+#ifdef CONFIG_CAM_SIM_ENABLE
+    if (cam_obj->sim.enable) {
+        if (!cam_obj->sim.dma_run) {
+            cam_obj->sim.dma_restart = 1;
+            cam_obj->sim.dma_run = 1;
+        }
+
+        return;
+    }
+#endif
+
     if (I2S0.int_ena.in_suc_eof == 0) {
         I2S0.int_clr.in_suc_eof = 1;
         I2S0.int_ena.in_suc_eof = 1;
@@ -277,45 +365,262 @@ static void cam_dma_start(void)
     }
 }
 
+static void cam_dma_load(lldesc_t *dma)
+{
+#ifdef CONFIG_CAM_SIM_ENABLE
+    if (cam_obj->sim.enable) {
+        cam_obj->sim.link = dma;
+        return;
+    }
+#endif
+
+    I2S0.in_link.addr = ((uint32_t)dma) & 0xfffff;
+}
+
+/*!< The CPU must not see stale cache lines of a frame the DMA wrote to PSRAM */
+static void cam_frame_sync(uint8_t *frame_buffer, size_t len)
+{
+#ifdef CONFIG_CAM_SIM_ENABLE
+    if (cam_obj->sim.enable) {
+        return; /*!< The generator writes through the cache, invalidating would drop its data */
+    }
+#endif
+
+    if (cam_obj->zero_copy && esp_ptr_external_ram(frame_buffer)) {
+        Cache_Invalidate_Addr((uint32_t)frame_buffer, len);
+    }
+}
+
+/*!< Dirty cache lines the application left in a PSRAM frame must not be evicted over the data the DMA writes
+ *   next, write them back and drop them before the frame goes back to the camera */
+static void cam_frame_clean(uint8_t *frame_buffer)
+{
+    if (cam_obj->zero_copy && esp_ptr_external_ram(frame_buffer)) {
+        Cache_WriteBack_Addr((uint32_t)frame_buffer, cam_obj->frame_buffer_size);
+        Cache_Invalidate_Addr((uint32_t)frame_buffer, cam_obj->frame_buffer_size);
+    }
+}
+
 void cam_stop(void)
 {
+    cam_obj->started = false;
     cam_vsync_intr_enable(0);
     cam_dma_stop();
 }
 
 void cam_start(void)
 {
+    cam_obj->started = true;
     cam_vsync_intr_enable(1);
 }
 
+bool cam_is_started(void)
+{
+    return cam_obj && cam_obj->started;
+}
+
+#ifdef CONFIG_CAM_STATS_ENABLE
+static void cam_stats_add(cam_time_stat_t *stat, int64_t us)
+{
+    uint32_t v = us < 0 ? 0 : (uint32_t)us;
+    stat->last = v;
+    stat->min = (stat->num == 0 || v < stat->min) ? v : stat->min;
+    stat->max = v > stat->max ? v : stat->max;
+    stat->sum += v;
+    stat->num++;
+}
+
+/*!< Account a complete frame, the times are esp_timer_get_time stamps */
+static void cam_stats_frame(int64_t start, int64_t first_eof, int64_t end, int64_t copy)
+{
+    portENTER_CRITICAL(&cam_obj->stats_lock);
+    cam_stats_t *stats = &cam_obj->stats;
+
+    if (stats->captured) {
+        cam_stats_add(&stats->frame_interval, start - stats->last_start);
+    }
+
+    cam_stats_add(&stats->capture, end - start);
+    cam_stats_add(&stats->vsync_latency, first_eof - start);
+
+    if (!cam_obj->zero_copy) {
+        cam_stats_add(&stats->copy, copy);
+    }
+
+    stats->captured++;
+    stats->last_start = start;
+    stats->last_end = end;
+    portEXIT_CRITICAL(&cam_obj->stats_lock);
+}
+
+static void cam_stats_avg(cam_time_stat_t *stat)
+{
+    stat->avg = stat->num ? stat->sum / stat->num : 0;
+}
+#endif
+
+esp_err_t cam_get_stats(cam_stats_t *stats)
+{
+#ifdef CONFIG_CAM_STATS_ENABLE
+    portENTER_CRITICAL(&cam_obj->stats_lock);
+    *stats = cam_obj->stats;
+    portEXIT_CRITICAL(&cam_obj->stats_lock);
+    stats->dropped = cam_obj->frame_dropped - stats->dropped; /*!< stats.dropped holds the counter at the last reset */
+    cam_stats_avg(&stats->frame_interval);
+    cam_stats_avg(&stats->capture);
+    cam_stats_avg(&stats->vsync_latency);
+    cam_stats_avg(&stats->copy);
+    cam_stats_avg(&stats->take_wait);
+    stats->fps = stats->frame_interval.avg ? 1000000.0f / stats->frame_interval.avg : 0;
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+void cam_reset_stats(void)
+{
+#ifdef CONFIG_CAM_STATS_ENABLE
+    portENTER_CRITICAL(&cam_obj->stats_lock);
+    memset(&cam_obj->stats, 0, sizeof(cam_stats_t));
+    cam_obj->stats.dropped = cam_obj->frame_dropped;
+    portEXIT_CRITICAL(&cam_obj->stats_lock);
+#endif
+}
+
 typedef enum {
     CAM_STATE_IDLE = 0,
-    CAM_STATE_READ_BUF1 = 1,
-    CAM_STATE_READ_BUF2 = 2,
+    CAM_STATE_READ_BUF = 1,
 } cam_state_t;
 
+/*!< Claim a free frame buffer, returns its index or -1 if all of them are held */
+static int cam_frame_alloc(void)
+{
+    unsigned int mask = atomic_load(&cam_obj->frame_free_mask);
+
+    while (mask) {
+        int index = __builtin_ctz(mask);
+
+        if (atomic_compare_exchange_weak(&cam_obj->frame_free_mask, &mask, mask & ~(1U << index))) {
+            return index;
+        }
+    }
+
+    return -1;
+}
+
+static void cam_frame_free(int index)
+{
+    atomic_fetch_or(&cam_obj->frame_free_mask, 1U << index);
+}
+
+static int cam_frame_index(const uint8_t *buffer)
+{
+    for (int x = 0; x < cam_obj->frame_num; x++) {
+        if (buffer == cam_obj->frames[x].buf) {
+            return x;
+        }
+    }
+
+    return -1;
+}
+
+/*!< Switch the frame size from cam_task, capture stays stopped until cam_start */
+static void cam_task_resize(int state, int frame_index)
+{
+    cam_ring_event_t event;
+    uint32_t missed;
+    cam_frame_t frame;
+
+    cam_vsync_intr_enable(0);
+    cam_dma_stop();
+
+    if (state == CAM_STATE_READ_BUF) {
+        cam_frame_free(frame_index); /*!< The frame in flight is dropped */
+    }
+
+    while (cam_ring_pop(&cam_obj->event_ring, &event, &missed)) {
+        /*!< Events of the old size */
+    }
+
+    while (xQueueReceive(cam_obj->frame_buffer_queue, (void *)&frame, 0) == pdTRUE) {
+        cam_frame_free(cam_frame_index(frame.buf)); /*!< Frames of the old size not taken yet */
+    }
+
+    cam_dma_layout_swap(cam_obj->resize_layout);
+    cam_obj->frame_skip = 1; /*!< The sensor may switch in the middle of the first frame */
+    atomic_store(&cam_obj->resize_pending, 0);
+    xSemaphoreGive(cam_obj->resize_done);
+}
+
 /*!<Copy fram from DMA buffer to fram buffer */
 static void cam_task(void *arg)
 {
     int state = CAM_STATE_IDLE;
-    cam_event_t cam_event = {0};
-    frame_buffer_event_t frame_buffer_event = {0};
-    xQueueReset(cam_obj->event_queue);
+    int frame_index = -1;
+    uint8_t frame_end = 0;
+    cam_ring_event_t event = {0};
+    uint32_t missed = 0;
+    cam_frame_t frame = {0};
+#ifdef CONFIG_CAM_STATS_ENABLE
+    int64_t frame_start = 0;
+    int64_t frame_first_eof = 0;
+    int64_t frame_copy = 0;
+#endif
 
     while (1) {
-        xQueueReceive(cam_obj->event_queue, (void *)&cam_event, portMAX_DELAY);
+        if (atomic_load(&cam_obj->resize_pending)) {
+            cam_task_resize(state, frame_index);
+            state = CAM_STATE_IDLE;
+            continue;
+        }
+
+        if (!cam_ring_pop(&cam_obj->event_ring, &event, &missed)) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY); /*!< The ISRs notify after every push */
+            continue;
+        }
+
+        if (missed) {
+            cam_obj->event_lost += missed;
+
+            if (state == CAM_STATE_READ_BUF) {
+                /*!< A lost EOF shifts the copy offsets and a lost VSYNC hides the frame end, the frame can not be trusted.
+                 *   Only counted, cam_get_pool_info reports it: printing here needs more stack than cam_task may have */
+                cam_dma_stop();
+                cam_vsync_intr_enable(1);
+                cam_frame_free(frame_index);
+                cam_obj->frame_discarded++;
+                state = CAM_STATE_IDLE;
+            }
+        }
 
         switch (state) {
             case CAM_STATE_IDLE: {
-                if (cam_event == CAM_VSYNC_EVENT) {
-                    if (cam_obj->frame1_buffer_en) {
-                        cam_dma_start();
-                        cam_vsync_intr_enable(0);
-                        state = CAM_STATE_READ_BUF1;
-                    } else if (cam_obj->frame2_buffer_en) {
+                if (event.type == CAM_VSYNC_EVENT) {
+                    if (cam_obj->frame_skip) {
+                        cam_obj->frame_skip--;
+                        break;
+                    }
+
+                    cam_obj->frame_seq++;
+                    frame_index = cam_frame_alloc();
+
+                    if (frame_index >= 0) {
+                        if (cam_obj->zero_copy) {
+                            cam_dma_load(cam_obj->frames[frame_index].dma);
+                        }
+
                         cam_dma_start();
                         cam_vsync_intr_enable(0);
-                        state = CAM_STATE_READ_BUF2;
+                        frame.buf = cam_obj->frames[frame_index].buf;
+                        frame.seq = cam_obj->frame_seq;
+                        frame.timestamp = esp_timer_get_time();
+                        frame_end = 0;
+                        CAM_STATS(frame_start = event.time);
+                        CAM_STATS(frame_copy = 0);
+                        state = CAM_STATE_READ_BUF;
+                    } else {
+                        cam_obj->frame_dropped++; /*!< Every buffer is held by the application, skip this frame */
                     }
 
                     cam_obj->cnt = 0;
@@ -323,144 +628,396 @@ static void cam_task(void *arg)
             }
             break;
 
-            case CAM_STATE_READ_BUF1: {
-                if (cam_event == CAM_IN_SUC_EOF_EVENT) {
+            case CAM_STATE_READ_BUF: {
+                if (event.type == CAM_IN_SUC_EOF_EVENT) {
                     if (cam_obj->cnt == 0) {
                         cam_vsync_intr_enable(1); /*!< CAM real start is required to receive the first buf data and then turn on the vsync interrupt */
+                        CAM_STATS(frame_first_eof = event.time);
                     }
 
-                    memcpy(&cam_obj->frame1_buffer[cam_obj->cnt * cam_obj->half_buffer_size], &cam_obj->buffer[(cam_obj->cnt % 2) * cam_obj->half_buffer_size], cam_obj->half_buffer_size);
+                    if (!cam_obj->zero_copy) {
+                        CAM_STATS(int64_t copy_start = esp_timer_get_time());
+                        memcpy(&frame.buf[cam_obj->cnt * cam_obj->half_buffer_size], &cam_obj->buffer[(cam_obj->cnt % 2) * cam_obj->half_buffer_size], cam_obj->half_buffer_size);
+                        CAM_STATS(frame_copy += esp_timer_get_time() - copy_start);
+                    }
 
                     if (cam_obj->jpeg_mode) {
-                        if (cam_obj->frame1_buffer_en == 0) {
+                        if (cam_obj->zero_copy && cam_obj->cnt == cam_obj->total_cnt - 1) {
+                            frame_end = 1; /*!< The frame buffer is full, the chain must not run past it */
+                        }
+
+                        if (frame_end) {
                             cam_dma_stop();
                         }
                     } else {
                         if (cam_obj->cnt == cam_obj->total_cnt - 1) {
-                            cam_obj->frame1_buffer_en = 0;
+                            frame_end = 1;
+                            /*!< Restarted on the next vsync at the head of the chain, in zero copy mode the chain of a free frame buffer.
+                             *   A frame of an odd number of chunks would otherwise start in the second half of the ping-pong buffer */
+                            cam_dma_stop();
                         }
                     }
 
-                    if (cam_obj->frame1_buffer_en == 0) {
-                        frame_buffer_event.frame_buffer = cam_obj->frame1_buffer;
-                        frame_buffer_event.len = (cam_obj->cnt + 1) * cam_obj->half_buffer_size;
-                        xQueueSend(cam_obj->frame_buffer_queue, (void *)&frame_buffer_event, portMAX_DELAY);
+                    if (frame_end) {
+                        frame.len = (cam_obj->cnt + 1) * cam_obj->half_buffer_size;
+                        cam_frame_sync(frame.buf, frame.len);
+
+                        if (cam_obj->jpeg_mode) {
+                            /*!< The EOI may end the previous chunk exactly, then VSYNC only comes after its EOF */
+                            uint32_t scan_cnt = cam_obj->cnt ? cam_obj->cnt - 1 : 0;
+                            frame.len = cam_jpeg_frame_len(frame.buf, scan_cnt * cam_obj->half_buffer_size, frame.len);
+                        }
+
+                        cam_obj->frame_captured++;
+                        CAM_STATS(cam_stats_frame(frame_start, frame_first_eof, event.time, frame_copy));
+                        xQueueSend(cam_obj->frame_buffer_queue, (void *)&frame, portMAX_DELAY); /*!< Never blocks, the queue can hold every frame of the pool */
                         state = CAM_STATE_IDLE;
                     } else {
                         cam_obj->cnt++;
                     }
-                } else if (cam_event == CAM_VSYNC_EVENT) {
+                } else if (event.type == CAM_VSYNC_EVENT) {
                     if (cam_obj->jpeg_mode) {
-                        cam_obj->frame1_buffer_en = 0;
+                        frame_end = 1;
                     }
                 }
             }
             break;
+        }
+    }
+}
 
-            case CAM_STATE_READ_BUF2: {
-                if (cam_event == CAM_IN_SUC_EOF_EVENT) {
-                    if (cam_obj->cnt == 0) {
-                        cam_vsync_intr_enable(1); /*!< CAM real start is required to receive the first buf data and then turn on the vsync interrupt */
-                    }
+#ifdef CONFIG_CAM_SIM_ENABLE
+/*!< Same as the ISRs, the generator task is then the single producer of the event ring */
+static void cam_sim_event(cam_event_t type)
+{
+    cam_ring_push(&cam_obj->event_ring, type, CAM_STATS_TIME());
+    xTaskNotifyGive(cam_obj->task_handle);
+    taskYIELD();
+}
 
-                    memcpy(&cam_obj->frame2_buffer[cam_obj->cnt * cam_obj->half_buffer_size], &cam_obj->buffer[(cam_obj->cnt % 2) * cam_obj->half_buffer_size], cam_obj->half_buffer_size);
+/*!< RGB565 colour bars, high byte first like the sensor, scrolling by 2 pixels a frame */
+static void cam_sim_rgb565(uint8_t *buf, uint32_t pos, uint32_t len, uint32_t seq)
+{
+    static const uint16_t bars[8] = {0xFFFF, 0xFFE0, 0x07FF, 0x07E0, 0xF81F, 0xF800, 0x001F, 0x0000};
 
-                    if (cam_obj->jpeg_mode) {
-                        if (cam_obj->frame2_buffer_en == 0) {
-                            cam_dma_stop();
-                        }
-                    } else {
-                        if (cam_obj->cnt == cam_obj->total_cnt - 1) {
-                            cam_obj->frame2_buffer_en = 0;
-                        }
-                    }
+    for (uint32_t i = 0; i < len; i++, pos++) {
+        uint32_t x = (pos / 2 + seq * 2) % cam_obj->width;
+        uint16_t color = bars[x * 8 / cam_obj->width];
+        buf[i] = (pos & 1) ? color & 0xFF : color >> 8;
+    }
+}
 
-                    if (cam_obj->frame2_buffer_en == 0) {
-                        frame_buffer_event.frame_buffer = cam_obj->frame2_buffer;
-                        frame_buffer_event.len = (cam_obj->cnt + 1) * cam_obj->half_buffer_size;
-                        xQueueSend(cam_obj->frame_buffer_queue, (void *)&frame_buffer_event, portMAX_DELAY);
-                        state = CAM_STATE_IDLE;
-                    } else {
-                        cam_obj->cnt++;
-                    }
-                } else if (cam_event == CAM_VSYNC_EVENT) {
-                    if (cam_obj->jpeg_mode) {
-                        cam_obj->frame2_buffer_en = 0;
-                    }
-                }
+/*!< SOI, entropy coded data with no 0xFF, EOI. Only the markers cam_task looks at are real */
+static void cam_sim_jpeg(uint8_t *buf, uint32_t pos, uint32_t len, uint32_t seq, uint32_t frame_len)
+{
+    for (uint32_t i = 0; i < len; i++, pos++) {
+        if (pos == 0 || pos == frame_len - 2) {
+            buf[i] = 0xFF;
+        } else if (pos == 1) {
+            buf[i] = 0xD8;
+        } else if (pos == frame_len - 1) {
+            buf[i] = 0xD9;
+        } else {
+            buf[i] = (pos * 7 + seq) % 0xFF;
+        }
+    }
+}
+
+/*!< Stands for the sensor and the I2S DMA: a frame per period, written through the loaded descriptor chain */
+static void cam_sim_task(void *arg)
+{
+    cam_sim_t *sim = &cam_obj->sim;
+    TickType_t period = sim->fps ? pdMS_TO_TICKS(1000 / sim->fps) : 0;
+    TickType_t wake = xTaskGetTickCount();
+    lldesc_t *desc = NULL;
+    uint32_t desc_offset = 0;
+    uint32_t fill = 0; /*!< Bytes since the last EOF, the DMA raises it every rx_eof_num bytes, across frames */
+    uint32_t seq = 0;
+
+    while (1) {
+        vTaskDelayUntil(&wake, period ? period : 1);
+
+        if (sim->vsync_en) {
+            cam_sim_event(CAM_VSYNC_EVENT);
+        }
+
+        /*!< JPEG frames vary in length, a frame ends in the middle of a chunk like a real compressed stream */
+        uint32_t frame_len = cam_obj->jpeg_mode ? cam_obj->width * cam_obj->high / 5 + (seq % 16) * 64 : cam_obj->width * cam_obj->high * 2;
+        uint32_t pos = 0;
+
+        while (pos < frame_len && sim->dma_run) {
+            if (sim->dma_restart) {
+                sim->dma_restart = 0;
+                desc = sim->link;
+                desc_offset = 0;
+                fill = 0;
+            }
+
+            uint32_t len = desc->size - desc_offset;
+            len = len < frame_len - pos ? len : frame_len - pos;
+            len = len < cam_obj->half_buffer_size - fill ? len : cam_obj->half_buffer_size - fill;
+
+            if (cam_obj->jpeg_mode) {
+                cam_sim_jpeg((uint8_t *)desc->buf + desc_offset, pos, len, seq, frame_len);
+            } else {
+                cam_sim_rgb565((uint8_t *)desc->buf + desc_offset, pos, len, seq);
+            }
+
+            pos += len;
+            desc_offset += len;
+            fill += len;
+
+            if (desc_offset == desc->size) {
+                desc = (lldesc_t *)desc->qe.stqe_next;
+                desc_offset = 0;
+            }
+
+            if (fill == cam_obj->half_buffer_size) {
+                fill = 0;
+                cam_sim_event(CAM_IN_SUC_EOF_EVENT);
             }
-            break;
         }
+
+        seq++;
     }
 }
+#endif
+
+size_t cam_take_frame(cam_frame_t *frame)
+{
+    CAM_STATS(int64_t wait_start = esp_timer_get_time());
+    xQueueReceive(cam_obj->frame_buffer_queue, (void *)frame, portMAX_DELAY);
+#ifdef CONFIG_CAM_STATS_ENABLE
+    portENTER_CRITICAL(&cam_obj->stats_lock);
+    cam_stats_add(&cam_obj->stats.take_wait, esp_timer_get_time() - wait_start);
+    portEXIT_CRITICAL(&cam_obj->stats_lock);
+#endif
+    unsigned int hold_num = atomic_fetch_add(&cam_obj->frame_hold_num, 1) + 1;
+
+    if (hold_num > cam_obj->frame_max_hold_num) {
+        cam_obj->frame_max_hold_num = hold_num;
+    }
+
+    return frame->len;
+}
 
 size_t cam_take(uint8_t **buffer_p)
 {
-    frame_buffer_event_t frame_buffer_event;
-    xQueueReceive(cam_obj->frame_buffer_queue, (void *)&frame_buffer_event, portMAX_DELAY);
-    *buffer_p = frame_buffer_event.frame_buffer;
-    return frame_buffer_event.len;
+    cam_frame_t frame;
+    cam_take_frame(&frame);
+    *buffer_p = frame.buf;
+    return frame.len;
 }
 
 void cam_give(uint8_t *buffer)
 {
-    if (buffer == cam_obj->frame1_buffer) {
-        cam_obj->frame1_buffer_en = 1;
-    } else if (buffer == cam_obj->frame2_buffer) {
-        cam_obj->frame2_buffer_en = 1;
+    int index = cam_frame_index(buffer);
+
+    if (index >= 0) {
+        atomic_fetch_sub(&cam_obj->frame_hold_num, 1);
+        cam_frame_clean(buffer);
+        cam_frame_free(index);
+    }
+}
+
+void cam_get_pool_info(cam_pool_info_t *info)
+{
+    info->frame_num = cam_obj->frame_num;
+    info->free_num = __builtin_popcount(atomic_load(&cam_obj->frame_free_mask));
+    info->ready_num = uxQueueMessagesWaiting(cam_obj->frame_buffer_queue);
+    info->hold_num = atomic_load(&cam_obj->frame_hold_num);
+    info->max_hold_num = cam_obj->frame_max_hold_num;
+    info->captured = cam_obj->frame_captured;
+    info->dropped = cam_obj->frame_dropped;
+    info->discarded = cam_obj->frame_discarded;
+    info->event_lost = cam_obj->event_lost;
+}
+
+/*!< Scatter the whole frame buffer over a descriptor chain, so the DMA writes the frame in place */
+static lldesc_t *cam_frame_dma_create(const dma_plan_t *plan, uint32_t chunk_cnt, uint8_t *frame_buffer, uint8_t *dma_buffer)
+{
+    uint32_t node_cnt = chunk_cnt * plan->chunk_node_cnt;
+    lldesc_t *dma = (lldesc_t *)heap_caps_malloc((node_cnt + 1) * sizeof(lldesc_t), MALLOC_CAP_DMA);
+
+    if (!dma) {
+        return NULL;
     }
+
+    for (int x = 0; x < node_cnt; x++) {
+        /*!< Every chunk of the frame has the node layout of one half of the DMA buffer */
+        uint32_t size = dma_plan_node_size(plan, x % plan->chunk_node_cnt);
+        dma[x].size = size;
+        dma[x].length = size;
+        dma[x].eof = 0;
+        dma[x].owner = 1;
+        dma[x].buf = (frame_buffer + (x / plan->chunk_node_cnt) * plan->chunk_size + dma_plan_node_offset(plan, x % plan->chunk_node_cnt));
+        dma[x].empty = (uint32_t)&dma[x + 1];
+    }
+
+    /*!< The tail node loops on the DMA buffer and swallows any overrun, the frame buffer is never written past its end */
+    dma[node_cnt].size = plan->node_size;
+    dma[node_cnt].length = plan->node_size;
+    dma[node_cnt].eof = 0;
+    dma[node_cnt].owner = 1;
+    dma[node_cnt].buf = dma_buffer;
+    dma[node_cnt].empty = (uint32_t)&dma[node_cnt];
+
+    return dma;
 }
 
-void cam_dma_config(const cam_config_t *config) 
+/*!< Plan and allocate the DMA for a frame size, in the context of the caller: cam_task only swaps it in */
+static esp_err_t cam_dma_layout_create(uint16_t width, uint16_t high, cam_dma_layout_t *layout)
 {
-    int cnt = 0;
+    uint32_t total_size = width * high * 2;
+    dma_plan_t *plan = &layout->plan;
 
-    if (config->mode.jpeg) {
-        cam_obj->buffer_size = 2048;
-        cam_obj->half_buffer_size = cam_obj->buffer_size / 2;
-        cam_obj->dma_size = 1024;
+    memset(layout, 0, sizeof(cam_dma_layout_t));
+
+    if (cam_obj->jpeg_mode) {
+        dma_plan_calc(plan, 0, 2048, CAM_DMA_MAX_SIZE); /*!< JPEG frames have no fixed size */
     } else {
-        for (cnt = 0;; cnt++) { /*!< Find the divisible buffer size */
-            if ((config->size.width * config->size.high * 2) % (config->max_buffer_size - cnt) == 0) {
-                break;
-            }
+        dma_plan_calc(plan, total_size, cam_obj->max_buffer_size, CAM_DMA_MAX_SIZE);
+
+        if (plan->tail_size != plan->chunk_size) {
+            /*!< The short tail chunk never reaches rx_eof_num, the frame would never end */
+            ESP_LOGE(TAG, "frame size %d has no chunk size up to %d that divides it, change max_buffer_size", total_size, plan->chunk_size);
+            return ESP_ERR_INVALID_SIZE;
         }
+    }
 
-        cam_obj->buffer_size = config->max_buffer_size - cnt;
+    layout->width = width;
+    layout->high = high;
+    layout->total_cnt = total_size / plan->chunk_size; /*!< Number of interrupt copies produced. Ping pong copies */
+    bool fail = false;
 
-        cam_obj->half_buffer_size = cam_obj->buffer_size / 2;
+    if (plan->buffer_size > cam_obj->buffer_cap) {
+        layout->buffer = (uint8_t *)heap_caps_malloc(plan->buffer_size * sizeof(uint8_t), MALLOC_CAP_DMA);
+        fail = !layout->buffer;
+    }
 
-        for (cnt = 0;; cnt++) { /*!< Look for divisible dma sizes */
-            if ((cam_obj->half_buffer_size) % (CAM_DMA_MAX_SIZE - cnt) == 0) {
-                break;
-            }
-        }
+    if (plan->node_cnt > cam_obj->node_cap) {
+        layout->dma = (lldesc_t *)heap_caps_malloc(plan->node_cnt * sizeof(lldesc_t), MALLOC_CAP_DMA);
+        fail = fail || !layout->dma;
+    }
+
+    for (int x = 0; cam_obj->zero_copy && !fail && x < cam_obj->frame_num; x++) {
+        layout->frame_dma[x] = cam_frame_dma_create(plan, layout->total_cnt, cam_obj->frames[x].buf, layout->buffer ? layout->buffer : cam_obj->buffer);
+        fail = !layout->frame_dma[x];
+    }
+
+    if (fail) {
+        ESP_LOGE(TAG, "camera dma malloc error\n");
+        cam_dma_layout_free(layout);
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "cam_buffer_size: %d, cam_dma_size: %d, cam_dma_node_cnt: %d, cam_total_cnt: %d\n", plan->buffer_size, plan->node_size, plan->node_cnt, layout->total_cnt);
+    return ESP_OK;
+}
 
-        cam_obj->dma_size = CAM_DMA_MAX_SIZE - cnt;
+/*!< Free what a layout holds: its allocations when it was not swapped in, the replaced ones when it was */
+static void cam_dma_layout_free(cam_dma_layout_t *layout)
+{
+    free(layout->buffer);
+    free(layout->dma);
+
+    for (int x = 0; x < CAM_FRAME_BUFFER_MAX_NUM; x++) {
+        free(layout->frame_dma[x]);
+    }
+}
+
+/*!< Take a layout in with the DMA stopped, it leaves the replaced buffers in the layout. No allocation or logging,
+ *   it runs in cam_task */
+static void cam_dma_layout_swap(cam_dma_layout_t *layout)
+{
+    if (layout->buffer) {
+        uint8_t *buffer = cam_obj->buffer;
+        cam_obj->buffer = layout->buffer;
+        cam_obj->buffer_cap = layout->plan.buffer_size;
+        layout->buffer = buffer;
     }
 
-    cam_obj->node_cnt = (cam_obj->buffer_size) / cam_obj->dma_size; /*!< Number of DMA nodes */
-    cam_obj->half_node_cnt = cam_obj->node_cnt / 2;
-    cam_obj->total_cnt = (config->size.width * config->size.high * 2) / cam_obj->half_buffer_size; /*!< Number of interrupt copies produced. Ping pong copies */
+    if (layout->dma) {
+        lldesc_t *dma = cam_obj->dma;
+        cam_obj->dma = layout->dma;
+        cam_obj->node_cap = layout->plan.node_cnt;
+        layout->dma = dma;
+    }
 
-    ESP_LOGI(TAG, "cam_buffer_size: %d, cam_dma_size: %d, cam_dma_node_cnt: %d, cam_total_cnt: %d\n", cam_obj->buffer_size, cam_obj->dma_size, cam_obj->node_cnt, cam_obj->total_cnt);
+    for (int x = 0; cam_obj->zero_copy && x < cam_obj->frame_num; x++) {
+        lldesc_t *dma = cam_obj->frames[x].dma;
+        cam_obj->frames[x].dma = layout->frame_dma[x];
+        layout->frame_dma[x] = dma;
+    }
 
-    cam_obj->dma    = (lldesc_t *)heap_caps_malloc(cam_obj->node_cnt * sizeof(lldesc_t), MALLOC_CAP_DMA);
-    cam_obj->buffer = (uint8_t *)heap_caps_malloc(cam_obj->buffer_size * sizeof(uint8_t), MALLOC_CAP_DMA);
+    cam_obj->plan = layout->plan;
+    cam_obj->width = layout->width;
+    cam_obj->high = layout->high;
+    cam_obj->buffer_size = layout->plan.buffer_size;
+    cam_obj->half_buffer_size = layout->plan.chunk_size;
+    cam_obj->node_cnt = layout->plan.node_cnt; /*!< Number of DMA nodes */
+    cam_obj->half_node_cnt = layout->plan.chunk_node_cnt;
+    cam_obj->frame_size = layout->total_cnt * layout->plan.chunk_size;
+    cam_obj->total_cnt = layout->total_cnt;
 
     for (int x = 0; x < cam_obj->node_cnt; x++) {
-        cam_obj->dma[x].size = cam_obj->dma_size;
-        cam_obj->dma[x].length = cam_obj->dma_size;
+        uint32_t size = dma_plan_node_size(&cam_obj->plan, x);
+        cam_obj->dma[x].size = size;
+        cam_obj->dma[x].length = size;
         cam_obj->dma[x].eof = 0;
         cam_obj->dma[x].owner = 1;
-        cam_obj->dma[x].buf = (cam_obj->buffer + cam_obj->dma_size * x);
+        cam_obj->dma[x].buf = (cam_obj->buffer + dma_plan_node_offset(&cam_obj->plan, x));
         cam_obj->dma[x].empty = &cam_obj->dma[(x + 1) % cam_obj->node_cnt];
     }
 
-    I2S0.in_link.addr = ((uint32_t)&cam_obj->dma[0]) & 0xfffff;
+    cam_dma_load(&cam_obj->dma[0]);
+#ifdef CONFIG_CAM_SIM_ENABLE
+    if (cam_obj->sim.enable) {
+        return;
+    }
+#endif
     I2S0.rx_eof_num = cam_obj->half_buffer_size; /*!< Ping-pong operation */
 }
 
+void cam_get_size(uint16_t *width, uint16_t *high)
+{
+    *width = cam_obj->width;
+    *high = cam_obj->high;
+}
+
+esp_err_t cam_set_size(uint16_t width, uint16_t high)
+{
+    if (!cam_obj) {
+        return ESP_FAIL;
+    }
+
+    if (width * high * 2 > cam_obj->frame_buffer_size) {
+        ESP_LOGE(TAG, "%dx%d does not fit the frame buffers\n", width, high);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    cam_dma_layout_t layout;
+    esp_err_t ret = cam_dma_layout_create(width, high, &layout);
+
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    /*!< cam_task owns the DMA and the frame being captured, it swaps the layout in between two events */
+    cam_obj->resize_layout = &layout;
+    atomic_store(&cam_obj->resize_pending, 1);
+    xTaskNotifyGive(cam_obj->task_handle);
+    xSemaphoreTake(cam_obj->resize_done, portMAX_DELAY);
+    cam_obj->started = false;
+    cam_dma_layout_free(&layout);
+
+    if (cam_obj->zero_copy) {
+        ESP_LOGI(TAG, "cam zero copy, frame_dma_node_cnt: %d\n", cam_obj->total_cnt * cam_obj->half_node_cnt);
+    }
+
+    return ESP_OK;
+}
+
 esp_err_t cam_deinit()
 {
     if (!cam_obj) {
@@ -468,19 +1025,40 @@ esp_err_t cam_deinit()
     }
 
     cam_stop();
+#ifdef CONFIG_CAM_SIM_ENABLE
+    if (cam_obj->sim.enable) {
+        vTaskDelete(cam_obj->sim.task_handle);
+    } else {
+        esp_intr_free(cam_obj->intr_handle);
+    }
+#else
     esp_intr_free(cam_obj->intr_handle);
+#endif
     vTaskDelete(cam_obj->task_handle);
-    vQueueDelete(cam_obj->event_queue);
     vQueueDelete(cam_obj->frame_buffer_queue);
+    vSemaphoreDelete(cam_obj->resize_done);
     free(cam_obj->dma);
     free(cam_obj->buffer);
+
+    for (int x = 0; x < cam_obj->frame_num; x++) {
+        free(cam_obj->frames[x].dma);
+    }
+
     free(cam_obj);
+    cam_obj = NULL;
 
     return ESP_OK;
 }
 
 esp_err_t cam_init(const cam_config_t *config)
 {
+#ifndef CONFIG_CAM_SIM_ENABLE
+    if (config->mode.synthetic) {
+        ESP_LOGE(TAG, "synthetic mode needs CONFIG_CAM_SIM_ENABLE\n");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+#endif
+
     cam_obj = (cam_obj_t *)heap_caps_calloc(1, sizeof(cam_obj_t), MALLOC_CAP_DMA);
 
     if (!cam_obj) {
@@ -488,36 +1066,84 @@ esp_err_t cam_init(const cam_config_t *config)
         return ESP_FAIL;
     }
 
-    cam_obj->width = config->size.width;
-    cam_obj->high = config->size.high;
-    cam_obj->frame1_buffer = config->frame1_buffer;
-    cam_obj->frame2_buffer = config->frame2_buffer;
+    if (config->frame_buffer_num) { /*!< Frame buffer pool */
+        for (int x = 0; x < config->frame_buffer_num && x < CAM_FRAME_BUFFER_MAX_NUM; x++) {
+            cam_obj->frames[cam_obj->frame_num++].buf = config->frame_buffers[x];
+        }
+    } else { /*!< PingPang buffers */
+        if (config->frame1_buffer != NULL) {
+            cam_obj->frames[cam_obj->frame_num++].buf = config->frame1_buffer;
+        }
+
+        if (config->frame2_buffer != NULL) {
+            cam_obj->frames[cam_obj->frame_num++].buf = config->frame2_buffer;
+        }
+    }
+
+    if (cam_obj->frame_num == 0) {
+        ESP_LOGE(TAG, "camera frame buffer is not set\n");
+        free(cam_obj);
+        cam_obj = NULL;
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "frame_buffer_num: %d\n", cam_obj->frame_num);
+    atomic_init(&cam_obj->frame_free_mask, (1U << cam_obj->frame_num) - 1);
+    atomic_init(&cam_obj->frame_hold_num, 0);
+#ifdef CONFIG_CAM_STATS_ENABLE
+    vPortCPUInitializeMutex(&cam_obj->stats_lock);
+#endif
     cam_obj->jpeg_mode = config->mode.jpeg;
+    cam_obj->zero_copy = config->mode.zero_copy;
     cam_obj->vsync_pin = config->pin.vsync;
     cam_obj->vsync_invert = config->vsync_invert;
     cam_obj->hsync_invert = config->hsync_invert;
+#ifdef CONFIG_CAM_SIM_ENABLE
+    cam_obj->sim.enable = config->mode.synthetic;
+    cam_obj->sim.fps = config->synthetic_fps;
+
+    if (!cam_obj->sim.enable) {
+        cam_set_pin(config);
+        cam_config(config);
+    }
+#else
     cam_set_pin(config);
     cam_config(config);
-    cam_dma_config(config);
+#endif
+    cam_obj->max_buffer_size = config->max_buffer_size;
+    cam_obj->frame_buffer_size = config->size.width * config->size.high * 2;
 
-    cam_obj->event_queue = xQueueCreate(2, sizeof(cam_event_t));
-    cam_obj->frame_buffer_queue = xQueueCreate(2, sizeof(frame_buffer_event_t));
+    for (int x = 0; x < cam_obj->frame_num; x++) {
+        cam_frame_clean(cam_obj->frames[x].buf); /*!< The application may have written to them before */
+    }
 
-    if (cam_obj->frame1_buffer != NULL) {
-        ESP_LOGI(TAG, "frame1_buffer_en\n");
-        cam_obj->frame1_buffer_en = 1;
-    } else {
-        cam_obj->frame1_buffer_en = 0;
+    cam_dma_layout_t layout;
+    esp_err_t ret = cam_dma_layout_create(config->size.width, config->size.high, &layout);
+
+    if (ret != ESP_OK) {
+        free(cam_obj);
+        cam_obj = NULL;
+        return ret;
     }
 
-    if (cam_obj->frame2_buffer != NULL) {
-        ESP_LOGI(TAG, "frame2_buffer_en\n");
-        cam_obj->frame2_buffer_en = 1;
-    } else {
-        cam_obj->frame2_buffer_en = 0;
+    cam_dma_layout_swap(&layout);
+
+    if (cam_obj->zero_copy) {
+        ESP_LOGI(TAG, "cam zero copy, frame_dma_node_cnt: %d\n", cam_obj->total_cnt * cam_obj->half_node_cnt);
     }
 
-    esp_intr_alloc(ETS_I2S0_INTR_SOURCE, 0, cam_isr, NULL, &cam_obj->intr_handle);
-    xTaskCreate(cam_task, "cam_task", config->task_stack, NULL, config->task_pri, &cam_obj->task_handle);
+    cam_obj->frame_buffer_queue = xQueueCreate(cam_obj->frame_num, sizeof(cam_frame_t));
+    cam_obj->resize_done = xSemaphoreCreateBinary();
+
+    xTaskCreate(cam_task, "cam_task", config->task_stack, NULL, config->task_pri, &cam_obj->task_handle); /*!< The ISRs notify it, create it first */
+#ifdef CONFIG_CAM_SIM_ENABLE
+    if (cam_obj->sim.enable) {
+        /*!< Same priority as cam_task, it yields after every event like the ISRs would preempt */
+        xTaskCreate(cam_sim_task, "cam_sim", config->task_stack, NULL, config->task_pri, &cam_obj->sim.task_handle);
+        ESP_LOGI(TAG, "cam synthetic source, %d fps\n", cam_obj->sim.fps);
+        return ESP_OK;
+    }
+#endif
+    esp_intr_alloc(ETS_I2S0_INTR_SOURCE, ESP_INTR_FLAG_LEVEL1, cam_isr, NULL, &cam_obj->intr_handle);
     return ESP_OK;
 }
\ No newline at end of file
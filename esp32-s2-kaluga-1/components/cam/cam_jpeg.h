@@ -0,0 +1,56 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!< JPEG frame end detection of cam_task. No hardware access, the host tests run it over captured streams */
+
+/**
+ * @brief Find the EOI marker (0xFFD9) in the last chunks of a JPEG frame, only [start, end) is scanned
+ *
+ * @param frame Frame buffer
+ * @param start Offset to scan from, the marker may straddle it
+ * @param end   Bytes received
+ *
+ * @return - Length of the frame up to and including the EOI marker
+ *         - end, no marker, the frame may be truncated
+ */
+static inline size_t cam_jpeg_frame_len(const uint8_t *frame, size_t start, size_t end)
+{
+    const uint8_t *p = frame + (start ? start - 1 : 0); /*!< The marker may straddle the previous chunk */
+    const uint8_t *last = frame + end - 1;
+
+    /*!< Entropy coded data stuffs every 0xFF with 0x00, so the first 0xFFD9 is the end of the image */
+    while (p < last && (p = memchr(p, 0xFF, last - p)) != NULL) {
+        if (p[1] == 0xD9) {
+            return p + 2 - frame;
+        }
+
+        p++;
+    }
+
+    return end;
+}
+
+#ifdef __cplusplus
+}
+#endif
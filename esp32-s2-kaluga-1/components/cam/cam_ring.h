@@ -0,0 +1,97 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!< Single producer, single consumer event ring between the camera ISRs and cam_task. No locks, no FreeRTOS calls */
+
+#define CAM_RING_SIZE (16) /*!< Power of 2 */
+
+typedef struct {
+    uint32_t seq;             /*!< Sequence number, events lost on a full ring still take one */
+    uint32_t type;
+    int64_t time;             /*!< Time of the interrupt, in microseconds, 0 if not stamped */
+} cam_ring_event_t;
+
+typedef struct {
+    cam_ring_event_t events[CAM_RING_SIZE];
+    atomic_uint head;         /*!< Written by the producer only */
+    atomic_uint tail;         /*!< Written by the consumer only */
+    uint32_t seq;             /*!< Producer side, sequence number of the next event */
+    uint32_t expect;          /*!< Consumer side, sequence number of the next event not seen yet */
+} cam_ring_t;
+
+/**
+ * @brief Add an event, from the producer only
+ *
+ * @param ring ring
+ * @param type Event type
+ * @param time Event time
+ *
+ * @return - true added
+ *         - false the ring is full, the event is lost and the consumer sees a sequence gap
+ */
+static inline bool cam_ring_push(cam_ring_t *ring, uint32_t type, int64_t time)
+{
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t seq = ring->seq++;
+
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= CAM_RING_SIZE) {
+        return false;
+    }
+
+    cam_ring_event_t *event = &ring->events[head & (CAM_RING_SIZE - 1)];
+    event->seq = seq;
+    event->type = type;
+    event->time = time;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Take the oldest event, from the consumer only
+ *
+ * @param ring   ring
+ * @param event  Filled with the event
+ * @param missed Filled with the number of events lost right before this one
+ *
+ * @return - true an event was taken
+ *         - false the ring is empty
+ */
+static inline bool cam_ring_pop(cam_ring_t *ring, cam_ring_event_t *event, uint32_t *missed)
+{
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    if (tail == atomic_load_explicit(&ring->head, memory_order_acquire)) {
+        return false;
+    }
+
+    *event = ring->events[tail & (CAM_RING_SIZE - 1)];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    *missed = event->seq - ring->expect;
+    ring->expect = event->seq + 1;
+    return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,106 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "cam.h"
+#include "camera.h"
+#include "ov2640.h"
+
+static const char *TAG = "camera";
+
+/*!< The OV3660 switches its window and timing, the OV2640 DSP only scales to another output size */
+static esp_err_t camera_sensor_set(uint8_t sensor_pid, sensor_t *sensor, framesize_t framesize, uint16_t width, uint16_t high)
+{
+    if (sensor_pid == OV3660_PID) {
+        return sensor->set_framesize(sensor, framesize) == 0 ? ESP_OK : ESP_FAIL;
+    }
+
+    return OV2640_OutSize_Set(width, high);
+}
+
+esp_err_t camera_set_framesize(uint8_t sensor_pid, sensor_t *sensor, framesize_t framesize)
+{
+    if (framesize >= FRAMESIZE_INVALID) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t start = esp_timer_get_time();
+    uint16_t width = resolution[framesize].width;
+    uint16_t high = resolution[framesize].height;
+    uint16_t old_width = 0;
+    uint16_t old_high = 0;
+    framesize_t old_framesize = FRAMESIZE_INVALID;
+    esp_err_t ret = ESP_OK;
+
+    if (sensor_pid == OV3660_PID) {
+        if (!sensor) {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        old_framesize = sensor->status.framesize;
+    } else if (sensor_pid == OV2640_PID) {
+        uint16_t image_width = 0;
+        uint16_t image_high = 0;
+        ret = OV2640_ImageSize_Get(&image_width, &image_high);
+
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "OV2640 image size can not be read"); /*!< Nothing changed, capture goes on as it was */
+            return ret;
+        }
+
+        if ((width % 4) || (high % 4) || width > image_width || high > image_high) {
+            ESP_LOGE(TAG, "OV2640 can not output %dx%d", width, high);
+            return ESP_ERR_INVALID_SIZE;
+        }
+    } else {
+        ESP_LOGE(TAG, "sensor PID 0x%02x is not supported", sensor_pid);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    bool started = cam_is_started();
+    cam_get_size(&old_width, &old_high);
+    ret = cam_set_size(width, high);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "cam can not switch to %dx%d", width, high); /*!< Nothing changed, capture goes on as it was */
+        return ret;
+    }
+
+    ret = camera_sensor_set(sensor_pid, sensor, framesize, width, high);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "sensor can not switch to %dx%d", width, high);
+
+        /*!< The sensor may have taken part of the new size, both go back */
+        if (camera_sensor_set(sensor_pid, sensor, old_framesize, old_width, old_high) != ESP_OK) {
+            ESP_LOGE(TAG, "sensor can not go back to %dx%d, capture stays stopped", old_width, old_high);
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        if (cam_set_size(old_width, old_high) != ESP_OK) {
+            ESP_LOGE(TAG, "cam can not go back to %dx%d, capture stays stopped", old_width, old_high);
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        ret = ESP_FAIL;
+    }
+
+    if (started) {
+        cam_start();
+    }
+
+    ESP_LOGD(TAG, "%dx%d in %lld us", width, high, (long long)(esp_timer_get_time() - start));
+    return ret;
+}
@@ -14,10 +14,14 @@
 
 #pragma once
 
+#include <stdbool.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define CAM_FRAME_BUFFER_MAX_NUM (8) /*!< Maximum number of buffers in the frame buffer pool */
+
 typedef struct {
     uint8_t bit_width;
     uint32_t xclk_fre;
@@ -45,14 +49,60 @@ typedef struct {
     uint8_t task_pri;
     union {
         struct {
-            uint32_t jpeg:   1; 
+            uint32_t jpeg:      1;
+            uint32_t zero_copy: 1; /*!< DMA writes straight into the frame buffers, they must be DMA capable and 4-byte aligned */
+            uint32_t synthetic: 1; /*!< No camera, a task generates the frames, needs CONFIG_CAM_SIM_ENABLE */
         };
         uint32_t val;
     } mode;
     uint8_t *frame1_buffer; /*!< PingPang buffers , cache the image*/
     uint8_t *frame2_buffer; /*!< PingPang buffers , cache the image*/
+    uint8_t frame_buffer_num; /*!< Number of buffers in frame_buffers, 0: use frame1_buffer and frame2_buffer */
+    uint8_t **frame_buffers;  /*!< Frame buffer pool, up to CAM_FRAME_BUFFER_MAX_NUM buffers of a whole frame each */
+    uint16_t synthetic_fps;   /*!< Frame rate of the synthetic source, 0: one frame per tick */
 } cam_config_t;
 
+typedef struct {
+    uint8_t *buf;             /*!< Frame data */
+    size_t len;               /*!< Length of frame data */
+    uint32_t seq;             /*!< Sequence number of the frame, a gap means frames were dropped */
+    int64_t timestamp;        /*!< Capture start time of the frame, in microseconds */
+} cam_frame_t;
+
+typedef struct {
+    uint32_t frame_num;       /*!< Number of buffers in the pool */
+    uint32_t free_num;        /*!< Buffers free for the camera */
+    uint32_t ready_num;       /*!< Frames waiting for cam_take */
+    uint32_t hold_num;        /*!< Frames taken and not given back yet */
+    uint32_t max_hold_num;    /*!< Most frames held at the same time */
+    uint32_t captured;        /*!< Frames captured */
+    uint32_t dropped;         /*!< Frames dropped because all buffers were held */
+    uint32_t discarded;       /*!< Frames discarded because capture events were lost */
+    uint32_t event_lost;      /*!< VSYNC and EOF events lost because cam_task fell behind */
+} cam_pool_info_t;
+
+typedef struct {
+    uint32_t last;            /*!< Last sample, in microseconds */
+    uint32_t min;
+    uint32_t max;
+    uint32_t avg;
+    uint32_t num;             /*!< Number of samples */
+    uint64_t sum;
+} cam_time_stat_t;
+
+typedef struct {
+    uint32_t captured;        /*!< Frames captured since the last reset */
+    uint32_t dropped;         /*!< Frames dropped because all buffers were held */
+    int64_t last_start;       /*!< VSYNC time of the last captured frame, in microseconds */
+    int64_t last_end;         /*!< Time the last captured frame was complete, in microseconds */
+    float fps;                /*!< Capture frame rate from the average frame interval */
+    cam_time_stat_t frame_interval; /*!< VSYNC to VSYNC of captured frames */
+    cam_time_stat_t capture;  /*!< VSYNC to the last EOF of a frame */
+    cam_time_stat_t vsync_latency; /*!< VSYNC to the first EOF of a frame */
+    cam_time_stat_t copy;     /*!< memcpy from the DMA buffer per frame, 0 in zero copy mode */
+    cam_time_stat_t take_wait; /*!< Time cam_take waited for a frame */
+} cam_stats_t;
+
 /**
  * @brief enable camera
  */
@@ -63,15 +113,31 @@ void cam_start(void);
  */
 void cam_stop(void);
 
+/**
+ * @brief Whether capture is enabled
+ *
+ * @return true after cam_start, false after cam_stop and cam_set_size
+ */
+bool cam_is_started(void);
+
 /**
  * @brief Accepts frame data and returns a pointer to the frame data.
  *
  * @param buffer_p  The address of the frame buffer pointer
  * 
- * @return - len of buffer
+ * @return - len of buffer, in JPEG mode the exact length up to the EOI marker
  */
 size_t cam_take(uint8_t **buffer_p);
 
+/**
+ * @brief Accepts frame data together with its sequence number and timestamp.
+ *
+ * @param frame  Filled with the frame data, give frame->buf back with cam_give
+ * 
+ * @return - len of buffer
+ */
+size_t cam_take_frame(cam_frame_t *frame);
+
 /**
  * @brief enable frame buffer to get the next frame data.
  *
@@ -80,12 +146,64 @@ size_t cam_take(uint8_t **buffer_p);
  */
 void cam_give(uint8_t *buffer);
 
+/**
+ * @brief Get the frame buffer pool usage, to size the pool.
+ *
+ * @param info Filled with the pool usage and drop counters
+ */
+void cam_get_pool_info(cam_pool_info_t *info);
+
+/**
+ * @brief Get the capture timing statistics
+ *
+ * @param stats Filled with the statistics since cam_init or the last cam_reset_stats
+ *
+ * @return - ESP_OK success
+ *         - ESP_ERR_NOT_SUPPORTED CONFIG_CAM_STATS_ENABLE is off
+ */
+esp_err_t cam_get_stats(cam_stats_t *stats);
+
+/**
+ * @brief Clear the capture timing statistics
+ */
+void cam_reset_stats(void);
+
+/**
+ * @brief Get the frame size
+ *
+ * @param width  Filled with the frame width
+ * @param high   Filled with the frame height
+ */
+void cam_get_size(uint16_t *width, uint16_t *high);
+
+/**
+ * @brief Change the frame size without cam_deinit
+ *
+ * Capture stops, the frame in flight and the frames not taken yet are dropped, and the DMA is laid
+ * out again for the new size, reusing its buffers when they are large enough. The new layout is
+ * planned and allocated by the calling task, cam_task only swaps it in, so its stack size does not
+ * change. Call cam_start once the sensor outputs the new size, the first frame after it is skipped.
+ * On failure nothing changes and capture is not stopped.
+ *
+ * @param width  frame width
+ * @param high   frame height
+ *
+ * @return - ESP_OK success
+ *         - ESP_ERR_INVALID_SIZE larger than the frame buffers given to cam_init, or an RGB frame no chunk of
+ *           max_buffer_size / 2 bytes at most divides
+ *         - ESP_ERR_NO_MEM the DMA buffers could not be grown
+ */
+esp_err_t cam_set_size(uint16_t width, uint16_t high);
+
 /**
  * @brief Initialize camera
  *
  * @param config Parameter configuration, including pin, buffer, output image size, and so on.
  * 
  * @return - ESP_OK :Initialize success
+ *           ESP_ERR_INVALID_SIZE: RGB frame size that no chunk of max_buffer_size / 2 bytes at most divides,
+ *                                 the DMA could not end the frame. Change max_buffer_size
+ *           ESP_ERR_NO_MEM: DMA buffers could not be allocated
  *           ESP_FAIL: Initialize fails
  */
 esp_err_t cam_init(const cam_config_t *config);
@@ -0,0 +1,46 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "esp_err.h"
+#include "sensor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Switch the frame size of the sensor and of the camera driver together
+ *
+ * The sensor is not reset: OV3660 writes only the window, timing and PLL registers that change,
+ * OV2640 only its output size. The camera driver keeps its buffers. Capture runs again when it
+ * returns if it ran before, the first frame of the new size comes within two frames.
+ *
+ * @param sensor_pid OV3660_PID or OV2640_PID
+ * @param sensor     OV3660 initialized with ov3660_init, unused for the OV2640 set up with OV2640_Init
+ * @param framesize  new frame size, it must fit the frame buffers given to cam_init
+ *
+ * @return - ESP_OK success
+ *         - ESP_ERR_INVALID_ARG invalid frame size, or no OV3660 sensor
+ *         - ESP_ERR_NOT_SUPPORTED another sensor
+ *         - ESP_ERR_INVALID_SIZE larger than the frame buffers, or than the OV2640 image size, nothing changed
+ *         - ESP_FAIL the sensor could not be set, both went back to the old size
+ *         - ESP_ERR_INVALID_STATE the sensor failed and the old size could not be restored, capture stays stopped
+ */
+esp_err_t camera_set_framesize(uint8_t sensor_pid, sensor_t *sensor, framesize_t framesize);
+
+#ifdef __cplusplus
+}
+#endif
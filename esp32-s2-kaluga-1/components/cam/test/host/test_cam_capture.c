@@ -0,0 +1,337 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*!< Frame boundaries and lengths out of the EOF event sequence: the synthetic source raises VSYNC and an EOF
+ *   every chunk like the I2S DMA, cam_task must put every chunk at its place and end every frame at its length */
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "soc/soc_memory_layout.h"
+#include "esp32s2/rom/cache.h"
+#include "host_test.h"
+#include "cam.h"
+
+#define TEST_FRAME_NUM      (40)
+#define TEST_POOL_MAX_NUM   (4)
+
+typedef struct {
+    const char *name;
+    uint16_t width;
+    uint16_t high;
+    uint32_t max_buffer_size;
+    uint8_t jpeg;
+    uint8_t zero_copy;
+    uint8_t pool_num;
+} capture_case_t;
+
+static const capture_case_t capture_cases[] = {
+    {"rgb565 qvga copy",           320, 240, 8 * 1024, 0, 0, 2},
+    {"rgb565 qvga zero copy",      320, 240, 8 * 1024, 0, 1, 3},
+    {"rgb565 qqvga small chunks",  160, 120, 1536,     0, 0, 2},
+    {"rgb565 qcif zero copy",      176, 144, 4 * 1024, 0, 1, 2},
+    {"rgb565 96x96",               96,  96,  8 * 1024, 0, 0, 2},
+    {"rgb565 qqvga odd chunks",    160, 120, 1024,     0, 0, 2},
+    {"rgb565 96x96 one chunk",     96,  96,  40 * 1024, 0, 0, 2},
+    {"jpeg qvga copy",             320, 240, 8 * 1024, 1, 0, 2},
+    {"jpeg qvga zero copy",        320, 240, 8 * 1024, 1, 1, 2},
+    {"jpeg qqvga eoi on chunk end", 160, 120, 2 * 1024, 1, 0, 2},
+    {"jpeg qqvga zero copy",       160, 120, 2 * 1024, 1, 1, 3},
+};
+
+/*!< Colour bars of the synthetic source, every row the same, scrolled by 2 pixels a frame */
+static bool rgb565_frame_ok(const uint8_t *buf, uint16_t width, uint16_t high)
+{
+    static const uint16_t bars[8] = {0xFFFF, 0xFFE0, 0x07FF, 0x07E0, 0xF81F, 0xF800, 0x001F, 0x0000};
+    int scroll;
+
+    for (scroll = 0; scroll < width; scroll++) {
+        int x;
+
+        for (x = 0; x < width; x++) {
+            uint16_t color = bars[((x + scroll) % width) * 8 / width];
+
+            if (buf[2 * x] != color >> 8 || buf[2 * x + 1] != (color & 0xFF)) {
+                break;
+            }
+        }
+
+        if (x == width) {
+            break;
+        }
+    }
+
+    if (scroll == width) {
+        return false;
+    }
+
+    for (int y = 1; y < high; y++) {
+        if (memcmp(buf, buf + y * width * 2, width * 2)) {
+            return false; /*!< A chunk at the wrong offset, or one of another frame */
+        }
+    }
+
+    return true;
+}
+
+/*!< The synthetic JPEG frame of generator frame seq is width * high / 5 + (seq % 16) * 64 bytes, its first
+ *   data byte is (14 + seq) % 255. Valid for the first 255 generated frames */
+static size_t jpeg_frame_expected_len(const uint8_t *buf, uint16_t width, uint16_t high)
+{
+    uint32_t seq = (buf[2] + 255 - 14) % 255;
+
+    return width * high / 5 + (seq % 16) * 64;
+}
+
+static void capture_run(const capture_case_t *c)
+{
+    uint8_t *buffers[TEST_POOL_MAX_NUM];
+    cam_config_t config = {0};
+    cam_pool_info_t info;
+    uint32_t last_seq = 0;
+    int chunk_end_num = 0;
+
+    for (int x = 0; x < c->pool_num; x++) {
+        buffers[x] = heap_caps_malloc(c->width * c->high * 2, MALLOC_CAP_DMA);
+        HOST_CHECK(buffers[x]);
+    }
+
+    config.bit_width = 8;
+    config.size.width = c->width;
+    config.size.high = c->high;
+    config.max_buffer_size = c->max_buffer_size;
+    config.task_stack = 1024;
+    config.task_pri = 5;
+    config.mode.jpeg = c->jpeg;
+    config.mode.zero_copy = c->zero_copy;
+    config.mode.synthetic = 1;
+    config.frame_buffer_num = c->pool_num;
+    config.frame_buffers = buffers;
+    HOST_CHECK(cam_init(&config) == ESP_OK);
+    cam_start();
+
+    for (int x = 0; x < TEST_FRAME_NUM; x++) {
+        cam_frame_t frame;
+        size_t len = cam_take_frame(&frame);
+
+        HOST_CHECK(len == frame.len);
+        HOST_CHECK(frame.seq > last_seq);
+        last_seq = frame.seq;
+
+        if (c->jpeg) {
+            size_t expected = jpeg_frame_expected_len(frame.buf, c->width, c->high);
+
+            HOST_CHECK(frame.buf[0] == 0xFF && frame.buf[1] == 0xD8);
+            HOST_CHECK(len == expected);
+            HOST_CHECK(frame.buf[len - 2] == 0xFF && frame.buf[len - 1] == 0xD9);
+            chunk_end_num += len % (c->max_buffer_size / 2) == 0;
+        } else {
+            HOST_CHECK(len == c->width * c->high * 2);
+            HOST_CHECK(rgb565_frame_ok(frame.buf, c->width, c->high));
+        }
+
+        cam_give(frame.buf);
+    }
+
+    cam_stop();
+    cam_get_pool_info(&info);
+    HOST_CHECK(info.hold_num == 0);
+    HOST_CHECK(info.captured >= TEST_FRAME_NUM);
+    HOST_CHECK(info.event_lost == 0 && info.discarded == 0);
+    HOST_CHECK(cam_deinit() == ESP_OK);
+    printf("%-30s %u frames captured, %u dropped, %d ended on a chunk boundary\n",
+           c->name, info.captured, info.dropped, chunk_end_num);
+
+    for (int x = 0; x < c->pool_num; x++) {
+        heap_caps_free(buffers[x]);
+    }
+}
+
+/*!< Zero copy frames in PSRAM are written back and invalidated before the DMA gets them, at cam_init and cam_give */
+static void capture_psram_cache(bool zero_copy)
+{
+    enum { width = 160, high = 120, pool_num = 2 };
+    uint8_t *pool = heap_caps_malloc(pool_num * width * high * 2, MALLOC_CAP_SPIRAM);
+    uint8_t *buffers[pool_num] = {pool, pool + width * high * 2};
+    cam_config_t config = {0};
+    host_cache_stats_t before, after;
+
+    HOST_CHECK(pool);
+    host_set_external_ram(pool, pool + pool_num * width * high * 2);
+    config.bit_width = 8;
+    config.size.width = width;
+    config.size.high = high;
+    config.max_buffer_size = 4 * 1024;
+    config.task_stack = 1024;
+    config.task_pri = 5;
+    config.mode.zero_copy = zero_copy;
+    config.mode.synthetic = 1;
+    config.frame_buffer_num = pool_num;
+    config.frame_buffers = buffers;
+    host_cache_get_stats(&before);
+    HOST_CHECK(cam_init(&config) == ESP_OK);
+    host_cache_get_stats(&after);
+    HOST_CHECK(after.writeback_num - before.writeback_num == (zero_copy ? pool_num : 0));
+    cam_start();
+
+    for (int x = 0; x < 10; x++) {
+        cam_frame_t frame;
+
+        cam_take_frame(&frame);
+        memset(frame.buf, 0x5A, 64); /*!< The application dirties the frame */
+        host_cache_get_stats(&before);
+        cam_give(frame.buf);
+        host_cache_get_stats(&after);
+
+        if (zero_copy) {
+            HOST_CHECK(after.writeback_num == before.writeback_num + 1);
+            HOST_CHECK(after.invalidate_num == before.invalidate_num + 1);
+            HOST_CHECK(after.last_writeback_addr == (uint32_t)(uintptr_t)frame.buf);
+            HOST_CHECK(after.last_invalidate_addr == (uint32_t)(uintptr_t)frame.buf);
+        } else {
+            HOST_CHECK(after.writeback_num == before.writeback_num); /*!< The CPU copies, the DMA never sees the frames */
+        }
+    }
+
+    cam_stop();
+    HOST_CHECK(cam_deinit() == ESP_OK);
+    host_set_external_ram(NULL, NULL);
+    heap_caps_free(pool);
+    printf("%-30s ok\n", zero_copy ? "psram zero copy cache" : "psram copy cache");
+}
+
+/*!< An RGB frame that no chunk divides would never end on an EOF, cam_init and cam_set_size refuse it */
+static void capture_reject_tail(void)
+{
+    enum { width = 320, high = 240 };
+    uint8_t *buffers[2];
+    cam_config_t config = {0};
+    uint16_t w, h;
+
+    for (int x = 0; x < 2; x++) {
+        buffers[x] = heap_caps_malloc(width * high * 2, MALLOC_CAP_DMA);
+    }
+
+    config.bit_width = 8;
+    config.size.width = 97;
+    config.size.high = 97;
+    config.max_buffer_size = 8 * 1024;
+    config.task_stack = 1024;
+    config.task_pri = 5;
+    config.mode.synthetic = 1;
+    config.frame_buffer_num = 2;
+    config.frame_buffers = buffers;
+    HOST_CHECK(cam_init(&config) == ESP_ERR_INVALID_SIZE);
+
+    config.size.width = width;
+    config.size.high = high;
+    HOST_CHECK(cam_init(&config) == ESP_OK);
+    HOST_CHECK(cam_set_size(97, 97) == ESP_ERR_INVALID_SIZE);
+    cam_get_size(&w, &h);
+    HOST_CHECK(w == width && h == high);
+    cam_start();
+
+    for (int x = 0; x < 5; x++) {
+        cam_frame_t frame;
+
+        HOST_CHECK(cam_take_frame(&frame) == width * high * 2 && rgb565_frame_ok(frame.buf, width, high));
+        cam_give(frame.buf);
+    }
+
+    cam_stop();
+    HOST_CHECK(cam_deinit() == ESP_OK);
+
+    for (int x = 0; x < 2; x++) {
+        heap_caps_free(buffers[x]);
+    }
+
+    printf("%-30s ok\n", "rgb565 tail rejected");
+}
+
+/*!< cam_set_size lays the DMA out in the calling task and cam_task swaps it in: frames follow every size, and a
+ *   refused size leaves capture running */
+static void capture_resize(bool zero_copy)
+{
+    static const uint16_t sizes[][2] = {{160, 120}, {96, 96}, {320, 240}, {176, 144}, {320, 240}};
+    uint8_t *buffers[2];
+    cam_config_t config = {0};
+    cam_pool_info_t info;
+
+    for (int x = 0; x < 2; x++) {
+        buffers[x] = heap_caps_malloc(320 * 240 * 2, MALLOC_CAP_DMA);
+        HOST_CHECK(buffers[x]);
+    }
+
+    config.bit_width = 8;
+    config.size.width = 320;
+    config.size.high = 240;
+    config.max_buffer_size = 8 * 1024;
+    config.task_stack = 1024;
+    config.task_pri = 5;
+    config.mode.zero_copy = zero_copy;
+    config.mode.synthetic = 1;
+    config.frame_buffer_num = 2;
+    config.frame_buffers = buffers;
+    HOST_CHECK(cam_init(&config) == ESP_OK);
+    HOST_CHECK(!cam_is_started());
+    cam_start();
+
+    for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        uint16_t width = sizes[s][0];
+        uint16_t high = sizes[s][1];
+
+        HOST_CHECK(cam_set_size(width, high) == ESP_OK);
+        HOST_CHECK(!cam_is_started());
+        cam_start();
+
+        for (int x = 0; x < 5; x++) {
+            cam_frame_t frame;
+
+            HOST_CHECK(cam_take_frame(&frame) == width * high * 2 && rgb565_frame_ok(frame.buf, width, high));
+            cam_give(frame.buf);
+        }
+
+        HOST_CHECK(cam_set_size(97, 97) == ESP_ERR_INVALID_SIZE);
+        HOST_CHECK(cam_is_started());
+    }
+
+    cam_stop();
+    cam_get_pool_info(&info);
+    HOST_CHECK(info.hold_num == 0);
+    HOST_CHECK(cam_deinit() == ESP_OK);
+
+    for (int x = 0; x < 2; x++) {
+        heap_caps_free(buffers[x]);
+    }
+
+    printf("%-30s ok\n", zero_copy ? "resize zero copy" : "resize copy");
+}
+
+int main(void)
+{
+    host_test_start();
+
+    for (int x = 0; x < sizeof(capture_cases) / sizeof(capture_cases[0]); x++) {
+        capture_run(&capture_cases[x]);
+    }
+
+    capture_reject_tail();
+    capture_resize(false);
+    capture_resize(true);
+    capture_psram_cache(true);
+    capture_psram_cache(false);
+    return 0;
+}
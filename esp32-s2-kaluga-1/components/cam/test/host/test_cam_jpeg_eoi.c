@@ -0,0 +1,173 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*!< cam_jpeg_frame_len over JPEG streams laid out in a frame buffer the way cam_task sees them: the image, then
+ *   whatever the chunk holds past the EOI, stale bytes of an older and longer frame included */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "cam_jpeg.h"
+
+#define TEST_STREAM_MAX_SIZE (64 * 1024)
+
+static const uint32_t chunk_sizes[] = {64, 512, 1024, 1536, 2048, 4092, 4096};
+
+typedef enum {
+    TAIL_ZERO,                /*!< Fresh buffer */
+    TAIL_FF,                  /*!< Fill bytes of the sensor */
+    TAIL_STALE,               /*!< The rest of a longer frame captured before, with its own EOI */
+    TAIL_MAX,
+} tail_t;
+
+static uint32_t lcg = 1;
+
+static uint8_t test_rand(void)
+{
+    lcg = lcg * 1103515245 + 12345;
+    return lcg >> 16;
+}
+
+/*!< A baseline JPEG as a sensor sends it: headers, entropy coded data with stuffed 0xFF and restart markers, EOI */
+static size_t stream_make(uint8_t *out, size_t data_len, uint32_t restart_interval)
+{
+    static const uint8_t header[] = {
+        0xFF, 0xD8,                                     /*!< SOI */
+        0xFF, 0xDD, 0x00, 0x04, 0x00, 0x10,             /*!< DRI */
+        0xFF, 0xDB, 0x00, 0x05, 0x00, 0xFF, 0xFF,       /*!< DQT, table bytes may be 0xFF */
+        0xFF, 0xC0, 0x00, 0x0B, 0x08, 0x00, 0x78, 0x00, 0xA0, 0x01, 0x01, 0x11, 0x00, /*!< SOF0 */
+        0xFF, 0xDA, 0x00, 0x08, 0x01, 0x01, 0x00, 0x00, 0x3F, 0x00, /*!< SOS */
+    };
+    size_t len = sizeof(header);
+    uint32_t rst = 0;
+
+    memcpy(out, header, sizeof(header));
+
+    for (size_t x = 0; x < data_len; x++) {
+        uint8_t byte = test_rand();
+
+        out[len++] = byte;
+
+        if (byte == 0xFF) {
+            out[len++] = 0x00; /*!< Byte stuffing */
+        }
+
+        if (restart_interval && x % restart_interval == restart_interval - 1) {
+            out[len++] = 0xFF;
+            out[len++] = 0xD0 + rst++ % 8;
+        }
+    }
+
+    out[len++] = 0xFF;
+    out[len++] = 0xD9;
+    return len;
+}
+
+static size_t file_load(const char *path, uint8_t *out, size_t max_len)
+{
+    FILE *f = fopen(path, "rb");
+
+    HOST_CHECK(f);
+    size_t len = fread(out, 1, max_len, f);
+    fclose(f);
+    HOST_CHECK(len > 4 && len < max_len);
+
+    /*!< Drop anything after the EOI, like a camera frame has none */
+    while (len > 2 && !(out[len - 2] == 0xFF && out[len - 1] == 0xD9)) {
+        len--;
+    }
+
+    return len;
+}
+
+/*!< Lay the stream out as cam_task ends the frame on chunk end_cnt and check the length it finds */
+static void stream_check(const uint8_t *stream, size_t len, const uint8_t *stale, size_t stale_len, uint32_t chunk, uint32_t end_cnt, tail_t tail)
+{
+    static uint8_t frame[TEST_STREAM_MAX_SIZE + 2 * 4096];
+    size_t end = (end_cnt + 1) * chunk;
+    uint32_t scan_cnt = end_cnt ? end_cnt - 1 : 0;
+
+    switch (tail) {
+        case TAIL_ZERO:
+            memset(frame, 0x00, end);
+            break;
+
+        case TAIL_FF:
+            memset(frame, 0xFF, end);
+            break;
+
+        default:
+            memcpy(frame, stale, stale_len < end ? stale_len : end);
+            break;
+    }
+
+    memcpy(frame, stream, len);
+    HOST_CHECK(cam_jpeg_frame_len(frame, scan_cnt * chunk, end) == len);
+
+    /*!< Truncated frame, no EOI in the window: the whole window is returned */
+    frame[len - 1] = 0x00;
+
+    if (tail == TAIL_ZERO) {
+        HOST_CHECK(cam_jpeg_frame_len(frame, scan_cnt * chunk, end) == end);
+    }
+}
+
+/*!< The EOI lies in the last chunk received, or in the chunk before it: VSYNC came one EOF later, because the EOI
+ *   ended that chunk exactly or the sensor sent padding after it */
+static int stream_check_all(const uint8_t *stream, size_t len, const uint8_t *stale, size_t stale_len)
+{
+    int checks = 0;
+
+    for (int c = 0; c < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); c++) {
+        uint32_t chunk = chunk_sizes[c];
+        uint32_t last_cnt = (len + chunk - 1) / chunk - 1;
+
+        for (tail_t tail = 0; tail < TAIL_MAX; tail++) {
+            stream_check(stream, len, stale, stale_len, chunk, last_cnt, tail);
+            stream_check(stream, len, stale, stale_len, chunk, last_cnt + 1, tail);
+            checks += 2;
+        }
+    }
+
+    return checks;
+}
+
+int main(void)
+{
+    static uint8_t stream[TEST_STREAM_MAX_SIZE];
+    static uint8_t stale[TEST_STREAM_MAX_SIZE + 2 * 4096];
+    int checks = 0;
+    size_t len, stale_len;
+
+    /*!< The stale frame is longer than every stream, its EOI lies past theirs */
+    stale_len = stream_make(stale, TEST_STREAM_MAX_SIZE - 16 * 1024, 0);
+    memset(stale + stale_len, 0xA5, sizeof(stale) - stale_len);
+
+    /*!< Every alignment of the EOI against small chunks, including a marker straddling two chunks */
+    for (size_t data_len = 0; data_len < 3 * 64; data_len++) {
+        len = stream_make(stream, data_len, 0);
+        checks += stream_check_all(stream, len, stale, sizeof(stale));
+    }
+
+    for (size_t data_len = 1000; data_len < 40 * 1000; data_len += 997) {
+        len = stream_make(stream, data_len, data_len % 3 ? 64 : 0);
+        checks += stream_check_all(stream, len, stale, sizeof(stale));
+    }
+
+    len = file_load(TEST_JPEG_FILE, stream, sizeof(stream));
+    checks += stream_check_all(stream, len, stale, sizeof(stale));
+    printf("%d frame layouts checked, %s is %zu bytes\n", checks, TEST_JPEG_FILE, len);
+    return 0;
+}
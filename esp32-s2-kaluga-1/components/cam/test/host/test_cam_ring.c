@@ -0,0 +1,219 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*!< The ISR to cam_task event ring: synthetic VSYNC and EOF sequences pushed and popped in scripted and random
+ *   orders against a model, then a producer and a consumer thread. Every event must come out once and in order,
+ *   and the losses of a full ring must show as exactly that many missed events */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "host_test.h"
+#include "cam_ring.h"
+
+#define TEST_VSYNC_EVENT   (0)
+#define TEST_EOF_EVENT     (1)
+#define TEST_STRESS_NUM    (200000)
+
+static cam_ring_t ring;
+
+static uint32_t lcg = 1;
+
+static uint32_t test_rand(uint32_t max)
+{
+    lcg = lcg * 1103515245 + 12345;
+    return (lcg >> 8) % max;
+}
+
+/*!< Event n of a stream of frames with chunk_num EOFs each: VSYNC, then the EOFs */
+static uint32_t test_event_type(uint32_t n, uint32_t chunk_num)
+{
+    return n % (chunk_num + 1) ? TEST_EOF_EVENT : TEST_VSYNC_EVENT;
+}
+
+static void ring_reset(unsigned int index)
+{
+    memset(&ring, 0, sizeof(ring));
+    atomic_init(&ring.head, index);
+    atomic_init(&ring.tail, index);
+}
+
+/*!< A full ring refuses events, the next one popped reports them as missed */
+static void ring_overflow(void)
+{
+    cam_ring_event_t event;
+    uint32_t missed;
+    int added = 0;
+
+    ring_reset(0);
+
+    for (int x = 0; x < CAM_RING_SIZE + 4; x++) {
+        added += cam_ring_push(&ring, test_event_type(x, 3), x * 100);
+    }
+
+    HOST_CHECK(added == CAM_RING_SIZE);
+
+    for (int x = 0; x < CAM_RING_SIZE; x++) {
+        HOST_CHECK(cam_ring_pop(&ring, &event, &missed));
+        HOST_CHECK(event.seq == x && event.type == test_event_type(x, 3) && event.time == x * 100 && missed == 0);
+    }
+
+    HOST_CHECK(!cam_ring_pop(&ring, &event, &missed));
+    HOST_CHECK(cam_ring_push(&ring, TEST_VSYNC_EVENT, 0));
+    HOST_CHECK(cam_ring_pop(&ring, &event, &missed));
+    HOST_CHECK(event.seq == CAM_RING_SIZE + 4 && missed == 4);
+    printf("%-30s ok\n", "overflow");
+}
+
+/*!< Random bursts of pushes and pops against a model of the ring, the free running indexes wrap on the way */
+static void ring_model(unsigned int start_index)
+{
+    uint32_t model[CAM_RING_SIZE];
+    uint32_t model_head = 0, model_tail = 0;
+    uint32_t produced = 0, lost = 0, consumed = 0, missed_total = 0;
+    uint32_t pending_lost = 0;    /*!< Lost since the last event the model holds */
+    uint32_t lost_before[CAM_RING_SIZE];
+    uint32_t chunk_num = 1 + test_rand(8);
+
+    ring_reset(start_index);
+
+    for (int round = 0; round < 20000; round++) {
+        int push_num = test_rand(CAM_RING_SIZE + 4);
+        int pop_num = test_rand(CAM_RING_SIZE + 4);
+
+        for (int x = 0; x < push_num; x++, produced++) {
+            bool full = model_head - model_tail == CAM_RING_SIZE;
+
+            HOST_CHECK(cam_ring_push(&ring, test_event_type(produced, chunk_num), produced) == !full);
+
+            if (full) {
+                lost++;
+                pending_lost++;
+                continue;
+            }
+
+            model[model_head % CAM_RING_SIZE] = produced;
+            lost_before[model_head % CAM_RING_SIZE] = pending_lost;
+            pending_lost = 0;
+            model_head++;
+        }
+
+        for (int x = 0; x < pop_num; x++) {
+            cam_ring_event_t event = {0};
+            uint32_t missed = 0;
+            bool empty = model_head == model_tail;
+
+            HOST_CHECK(cam_ring_pop(&ring, &event, &missed) == !empty);
+
+            if (empty) {
+                break;
+            }
+
+            uint32_t seq = model[model_tail % CAM_RING_SIZE];
+
+            HOST_CHECK(event.seq == seq && event.time == seq && event.type == test_event_type(seq, chunk_num));
+            HOST_CHECK(missed == lost_before[model_tail % CAM_RING_SIZE]);
+            model_tail++;
+            consumed++;
+            missed_total += missed;
+        }
+    }
+
+    /*!< Every loss is reported once: by an event popped, by one still in the ring, or by the next one pushed */
+    for (uint32_t x = model_tail; x != model_head; x++) {
+        missed_total += lost_before[x % CAM_RING_SIZE];
+    }
+
+    HOST_CHECK(consumed + (model_head - model_tail) + lost == produced);
+    HOST_CHECK(missed_total + pending_lost == lost);
+    printf("%-30s %u events, %u lost, start index %08x\n", "model", produced, lost, start_index);
+}
+
+static atomic_int producer_done;
+static uint32_t producer_lost;
+
+static void *ring_producer(void *arg)
+{
+    uint32_t seed = 7;            /*!< test_rand belongs to the consumer thread */
+    uint32_t burst = 1;
+
+    for (uint32_t x = 0; x < TEST_STRESS_NUM; x++) {
+        if (!cam_ring_push(&ring, test_event_type(x, 5), (int64_t)x * 3)) {
+            producer_lost++;
+        }
+
+        /*!< Bursts shorter and longer than the ring, so it runs both empty and full */
+        if (--burst == 0) {
+            seed = seed * 1103515245 + 12345;
+            burst = 1 + (seed >> 8) % (2 * CAM_RING_SIZE);
+            sched_yield();
+        }
+    }
+
+    atomic_store(&producer_done, 1);
+    return NULL;
+}
+
+/*!< A real producer thread: the consumer must see every event written completely and account for every loss */
+static void ring_threads(void)
+{
+    pthread_t thread;
+    uint32_t consumed = 0, missed_total = 0, last_seq = 0;
+    bool first = true;
+
+    ring_reset(0);
+    HOST_CHECK(pthread_create(&thread, NULL, ring_producer, NULL) == 0);
+
+    while (1) {
+        cam_ring_event_t event;
+        uint32_t missed;
+        int done = atomic_load(&producer_done);
+
+        if (!cam_ring_pop(&ring, &event, &missed)) {
+            if (done) {
+                break; /*!< Read before the failed pop, nothing can follow */
+            }
+
+            sched_yield(); /*!< cam_task blocks on the notification of the next push */
+            continue;
+        }
+
+        if (test_rand(CAM_RING_SIZE) == 0) {
+            sched_yield(); /*!< cam_task is preempted by other tasks too */
+        }
+
+        HOST_CHECK(first || event.seq > last_seq);
+        HOST_CHECK(event.time == (int64_t)event.seq * 3 && event.type == test_event_type(event.seq, 5));
+        first = false;
+        last_seq = event.seq;
+        consumed++;
+        missed_total += missed;
+    }
+
+    HOST_CHECK(pthread_join(thread, NULL) == 0);
+    missed_total += TEST_STRESS_NUM - 1 - last_seq; /*!< Lost after the last event, no later event reports them */
+    HOST_CHECK(consumed + producer_lost == TEST_STRESS_NUM);
+    HOST_CHECK(missed_total == producer_lost);
+    printf("%-30s %u events, %u lost\n", "threads", (uint32_t)TEST_STRESS_NUM, producer_lost);
+}
+
+int main(void)
+{
+    ring_overflow();
+    ring_model(0);
+    ring_model(0xFFFFFFF0); /*!< head and tail wrap around */
+    ring_threads();
+    return 0;
+}
@@ -0,0 +1,87 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stddef.h>
+#include "dma_plan.h"
+
+#define DMA_PLAN_ALIGN(x)     ((x) & ~3U) /*!< DMA buffers are accessed by words */
+#define DMA_PLAN_DIV_UP(x, y) (((x) + (y) - 1) / (y))
+
+/*!< Largest word aligned divisor of total_size not above max_chunk_size, 0 if none is at least half of it */
+static uint32_t dma_plan_chunk_find(uint32_t total_size, uint32_t max_chunk_size)
+{
+    uint32_t min_cnt = DMA_PLAN_DIV_UP(total_size, max_chunk_size);
+
+    /*!< Walk the chunk count up instead of the chunk size down, the first hit is the largest chunk */
+    for (uint32_t cnt = min_cnt; cnt <= min_cnt * 2; cnt++) {
+        if (total_size % cnt == 0 && (total_size / cnt) % 4 == 0) {
+            return total_size / cnt;
+        }
+    }
+
+    return 0;
+}
+
+int dma_plan_calc(dma_plan_t *plan, uint32_t total_size, uint32_t max_buffer_size, uint32_t node_max_size)
+{
+    uint32_t max_chunk_size = DMA_PLAN_ALIGN(max_buffer_size / 2);
+    uint32_t chunk_size = 0;
+
+    node_max_size = DMA_PLAN_ALIGN(node_max_size);
+
+    if (plan == NULL || max_chunk_size == 0 || node_max_size == 0) {
+        return -1;
+    }
+
+    if (total_size == 0) { /*!< Streaming, use the whole buffer */
+        chunk_size = max_chunk_size;
+    } else if (total_size <= max_chunk_size) {
+        chunk_size = total_size;
+    } else {
+        chunk_size = dma_plan_chunk_find(total_size, max_chunk_size);
+
+        if (chunk_size == 0) { /*!< No suitable divisor, end the transfer with a short tail chunk */
+            chunk_size = max_chunk_size;
+        }
+    }
+
+    plan->total_size = total_size;
+    plan->chunk_size = chunk_size;
+    plan->buffer_size = chunk_size * 2;
+    plan->chunk_cnt = DMA_PLAN_DIV_UP(total_size, chunk_size);
+    plan->tail_size = total_size ? total_size - (plan->chunk_cnt - 1) * chunk_size : chunk_size;
+
+    /*!< As few descriptors as possible, with the bytes spread evenly over them */
+    plan->chunk_node_cnt = DMA_PLAN_DIV_UP(chunk_size, node_max_size);
+    plan->node_size = (DMA_PLAN_DIV_UP(chunk_size, plan->chunk_node_cnt) + 3) & ~3U;
+
+    if (plan->node_size > chunk_size) {
+        plan->node_size = chunk_size;
+    }
+
+    plan->node_tail_size = chunk_size - (plan->chunk_node_cnt - 1) * plan->node_size;
+    plan->node_cnt = plan->chunk_node_cnt * 2;
+
+    return 0;
+}
+
+uint32_t dma_plan_node_size(const dma_plan_t *plan, uint32_t node)
+{
+    return (node % plan->chunk_node_cnt == plan->chunk_node_cnt - 1) ? plan->node_tail_size : plan->node_size;
+}
+
+uint32_t dma_plan_node_offset(const dma_plan_t *plan, uint32_t node)
+{
+    return (node / plan->chunk_node_cnt) * plan->chunk_size + (node % plan->chunk_node_cnt) * plan->node_size;
+}
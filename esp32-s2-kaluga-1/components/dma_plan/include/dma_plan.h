@@ -0,0 +1,80 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Layout of a ping-pong DMA buffer and its descriptors.
+ *
+ * The buffer is split into two chunks, each chunk produces one EOF event.
+ * A chunk is covered by chunk_node_cnt descriptors, all of node_size bytes except the last one.
+ */
+typedef struct {
+    uint32_t total_size;      /*!< Bytes of one transfer, e.g. a frame, 0 if unknown */
+    uint32_t buffer_size;     /*!< Bytes of the ping-pong buffer, two chunks */
+    uint32_t chunk_size;      /*!< Bytes of one chunk, half of the buffer */
+    uint32_t chunk_cnt;       /*!< Chunks of one transfer, including a short tail chunk. 0 if total_size is 0 */
+    uint32_t tail_size;       /*!< Bytes of the last chunk of a transfer, chunk_size if the chunk divides total_size */
+    uint32_t node_size;       /*!< Bytes of a descriptor */
+    uint32_t node_tail_size;  /*!< Bytes of the last descriptor of a chunk, may be shorter than node_size */
+    uint32_t chunk_node_cnt;  /*!< Descriptors of one chunk */
+    uint32_t node_cnt;        /*!< Descriptors of the whole buffer */
+} dma_plan_t;
+
+/**
+ * @brief Compute the DMA layout of a transfer
+ *
+ * The largest word aligned chunk that divides total_size is preferred, so every chunk of a transfer
+ * ends on an EOF event. If there is none, the last chunk of a transfer is a short tail.
+ * Descriptors are balanced over a chunk instead of requiring node_max_size to divide it.
+ *
+ * @param plan            Filled with the layout
+ * @param total_size      Bytes of one transfer, 0 if transfers have no fixed size
+ * @param max_buffer_size Upper limit of the ping-pong buffer
+ * @param node_max_size   Upper limit of the bytes of one descriptor
+ *
+ * @return - 0 success
+ *         - -1 invalid arguments
+ */
+int dma_plan_calc(dma_plan_t *plan, uint32_t total_size, uint32_t max_buffer_size, uint32_t node_max_size);
+
+/**
+ * @brief Bytes of a descriptor of the buffer
+ *
+ * @param plan Layout of the buffer
+ * @param node Index of the descriptor, 0 to node_cnt - 1
+ *
+ * @return - bytes of the descriptor
+ */
+uint32_t dma_plan_node_size(const dma_plan_t *plan, uint32_t node);
+
+/**
+ * @brief Offset of a descriptor in the buffer
+ *
+ * @param plan Layout of the buffer
+ * @param node Index of the descriptor, 0 to node_cnt - 1
+ *
+ * @return - offset of the descriptor in bytes
+ */
+uint32_t dma_plan_node_offset(const dma_plan_t *plan, uint32_t node);
+
+#ifdef __cplusplus
+}
+#endif
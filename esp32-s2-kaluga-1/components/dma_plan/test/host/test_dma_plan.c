@@ -0,0 +1,110 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*!< dma_plan_calc over every framesize_t in RGB565 and the buffer sizes the drivers use: the descriptors must tile
+ *   the buffer exactly, stay under the DMA limit and split every frame into whole chunks */
+
+#include <stdio.h>
+#include "host_test.h"
+#include "sensor.h"
+#include "dma_plan.h"
+
+#define TEST_NODE_MAX_SIZE (4095) /*!< lldesc_t size field, as CAM_DMA_MAX_SIZE */
+
+static const uint32_t max_buffer_sizes[] = {2 * 1024, 4 * 1024, 8 * 1024, 16 * 1024, 32 * 1024, 64 * 1024};
+
+static void plan_check(const dma_plan_t *plan, uint32_t total_size, uint32_t max_buffer_size)
+{
+    uint32_t offset = 0;
+
+    HOST_CHECK(plan->chunk_size % 4 == 0 && plan->chunk_size > 0);
+    HOST_CHECK(plan->buffer_size == plan->chunk_size * 2);
+    HOST_CHECK(plan->buffer_size <= max_buffer_size);
+    HOST_CHECK(plan->node_cnt == plan->chunk_node_cnt * 2);
+    HOST_CHECK(plan->node_tail_size > 0 && plan->node_tail_size <= plan->node_size);
+
+    /*!< Descriptors tile the buffer in order, word aligned and within the DMA limit */
+    for (uint32_t node = 0; node < plan->node_cnt; node++) {
+        uint32_t size = dma_plan_node_size(plan, node);
+
+        HOST_CHECK(dma_plan_node_offset(plan, node) == offset);
+        HOST_CHECK(size > 0 && size <= (TEST_NODE_MAX_SIZE & ~3U) && size % 4 == 0);
+
+        if (node % plan->chunk_node_cnt == plan->chunk_node_cnt - 1) {
+            HOST_CHECK(offset + size == (node / plan->chunk_node_cnt + 1) * plan->chunk_size); /*!< A chunk ends on a descriptor end */
+        }
+
+        offset += size;
+    }
+
+    HOST_CHECK(offset == plan->buffer_size);
+
+    if (total_size) {
+        HOST_CHECK((plan->chunk_cnt - 1) * plan->chunk_size + plan->tail_size == total_size);
+        HOST_CHECK(plan->tail_size > 0 && plan->tail_size <= plan->chunk_size);
+    } else {
+        HOST_CHECK(plan->chunk_cnt == 0 && plan->tail_size == plan->chunk_size);
+    }
+}
+
+int main(void)
+{
+    dma_plan_t plan;
+    int tail_num = 0;
+
+    for (int b = 0; b < sizeof(max_buffer_sizes) / sizeof(max_buffer_sizes[0]); b++) {
+        uint32_t max_buffer_size = max_buffer_sizes[b];
+
+        for (framesize_t size = 0; size < FRAMESIZE_INVALID; size++) {
+            uint32_t total_size = resolution[size].width * resolution[size].height * 2;
+
+            HOST_CHECK(dma_plan_calc(&plan, total_size, max_buffer_size, TEST_NODE_MAX_SIZE) == 0);
+            plan_check(&plan, total_size, max_buffer_size);
+
+            /*!< A chunk is at least half the largest one, the EOF rate stays close to the best */
+            HOST_CHECK(plan.chunk_size * 2 >= (max_buffer_size / 2 & ~3U) || plan.chunk_size == total_size);
+
+            if (plan.tail_size != plan.chunk_size) {
+                tail_num++; /*!< cam_init rejects these, the frame would not end on an EOF */
+                printf("%4dx%-4d with %5u bytes: tail of %u bytes\n", resolution[size].width, resolution[size].height, max_buffer_size, plan.tail_size);
+            }
+        }
+
+        /*!< Streams of unknown length, JPEG and the LCD */
+        HOST_CHECK(dma_plan_calc(&plan, 0, max_buffer_size, TEST_NODE_MAX_SIZE) == 0);
+        plan_check(&plan, 0, max_buffer_size);
+        HOST_CHECK(plan.chunk_size == (max_buffer_size / 2 & ~3U));
+    }
+
+    /*!< Every framesize_t splits into whole chunks at the buffer sizes of the examples */
+    HOST_CHECK(tail_num == 0);
+
+    /*!< No word aligned divisor: the plan ends on a short tail */
+    HOST_CHECK(dma_plan_calc(&plan, 97 * 97 * 2, 8 * 1024, TEST_NODE_MAX_SIZE) == 0);
+    plan_check(&plan, 97 * 97 * 2, 8 * 1024);
+    HOST_CHECK(plan.tail_size < plan.chunk_size);
+
+    /*!< Buffer sizes that are not word multiples, and descriptors that do not divide the chunk */
+    HOST_CHECK(dma_plan_calc(&plan, 0, 2 * 2048 + 8, TEST_NODE_MAX_SIZE) == 0);
+    plan_check(&plan, 0, 2 * 2048 + 8);
+    HOST_CHECK(dma_plan_calc(&plan, 320 * 240 * 2, 8 * 1024 + 6, TEST_NODE_MAX_SIZE) == 0);
+    plan_check(&plan, 320 * 240 * 2, 8 * 1024 + 6);
+
+    HOST_CHECK(dma_plan_calc(NULL, 0, 2048, TEST_NODE_MAX_SIZE) == -1);
+    HOST_CHECK(dma_plan_calc(&plan, 0, 2, TEST_NODE_MAX_SIZE) == -1);
+    HOST_CHECK(dma_plan_calc(&plan, 0, 2048, 3) == -1);
+
+    printf("%d frame sizes, %d buffer sizes ok\n", FRAMESIZE_INVALID, (int)(sizeof(max_buffer_sizes) / sizeof(max_buffer_sizes[0])));
+    return 0;
+}
@@ -1,8 +1,281 @@
-#pragma once
-#include <stdint.h>
-#include "esp_err.h"
-#include "tjpgd.h"
-
-#define JPEG_WORK_BUF_SIZE 3100
-
-uint8_t *jpeg_decode(uint8_t *jpeg, int *w, int* h);
\ No newline at end of file
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "jpeg_port.h"
+#include "tjpgd.h"
+
+#define JPEG_WORK_BUF_SIZE (3100 + 4 * 1024) //tjpgd pool, plus four Huffman lookup tables of 1 << JD_HUFFLUT_BITS words
+
+#define JPEG_WORKER_MAX 4 //Most workers of jpeg_decoder_decode_parallel, each with its own work pool
+
+typedef struct jpeg_decoder jpeg_decoder_t;
+
+typedef struct {
+    int64_t decode_time;      //Last decode in us
+    uint32_t pool_used;       //Bytes of the work pool used by the last image
+    uint32_t pool_peak;       //Most bytes of the work pool used by any image so far
+    uint32_t stage_ticks[4];  //Ticks of the last decode per stage, indexed by JD_PROF_*. Zero unless JD_PROFILE is 1
+} jpeg_decoder_stats_t;
+
+typedef enum {
+    JPEG_PIXEL_FORMAT_RGB565_BE = 0, //RGB565 in LCD byte order, high byte first
+    JPEG_PIXEL_FORMAT_RGB565_LE,     //RGB565 as native uint16_t
+    JPEG_PIXEL_FORMAT_RGB888,        //R, G, B bytes
+    JPEG_PIXEL_FORMAT_GRAY8,         //8-bit Y only, see jpeg_decode_gray
+} jpeg_pixel_format_t;
+
+//Where jpeg_decode_to writes the image, e.g. a window of a larger UI framebuffer
+typedef struct {
+    uint8_t *base;              //Top left pixel of the target
+    int stride;                 //Bytes from one row of the target to the next
+    int x;                      //Position of the image in the target, in pixels. May be negative if width / height are set
+    int y;
+    int width;                  //Size of the target in pixels, the image is clipped to it. 0: no clipping
+    int height;
+    jpeg_pixel_format_t format;
+} jpeg_output_t;
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+} jpeg_chunk_t;
+
+typedef struct jpeg_reader jpeg_reader_t;
+
+//Source of the jpeg data for jpeg_decode_ex, set up by one of the jpeg_reader_init_* functions.
+//Other sources fill in read, and map if their data is in memory.
+struct jpeg_reader {
+    size_t (*read)(jpeg_reader_t *reader, uint8_t *buf, size_t len); //Copies up to len bytes to buf, skips them if buf is NULL. Returns how many, 0 at the end
+    size_t (*map)(jpeg_reader_t *reader, const uint8_t **data);      //Optional. Points data at the next bytes in place instead of copying them. Returns how many, 0 at the end
+    void *ctx;                  //FILE of the file reader, free for other readers
+    const uint8_t *data;        //Memory reader
+    size_t len;
+    size_t pos;                 //Position in data, or in the current chunk
+    const jpeg_chunk_t *chunks; //Chunk reader
+    int chunk_num;
+    int chunk;
+};
+
+uint8_t *jpeg_decode(uint8_t *jpeg, int *w, int* h);
+
+/**
+ * @brief Read jpeg data of a known length from memory, e.g. a camera frame. tjpgd decodes it in place
+ *
+ * @param reader Reader to set up
+ * @param data   jpeg data
+ * @param len    Size of data, nothing past it is read even if the EOI marker is missing
+ */
+void jpeg_reader_init_mem(jpeg_reader_t *reader, const uint8_t *data, size_t len);
+
+/**
+ * @brief Read jpeg data from a file
+ *
+ * @param reader Reader to set up
+ * @param file   File opened for reading, at the start of the jpeg data
+ */
+void jpeg_reader_init_file(jpeg_reader_t *reader, FILE *file);
+
+/**
+ * @brief Read jpeg data split over several buffers in memory, e.g. the DMA buffers of a frame. tjpgd decodes them in place
+ *
+ * @param reader    Reader to set up
+ * @param chunks    Buffers in stream order, must stay valid while decoding
+ * @param chunk_num Number of chunks
+ */
+void jpeg_reader_init_chunks(jpeg_reader_t *reader, const jpeg_chunk_t *chunks, int chunk_num);
+
+/**
+ * @brief Called for every decoded row band of the image, RGB565 in LCD byte order
+ *
+ * Two band buffers are used in turn, so data is overwritten two bands later, also across calls
+ * of jpeg_decode_band. It may be sent asynchronously as long as the previous band is done
+ * before the callback returns.
+ *
+ * @param ctx  ctx passed to jpeg_decode_band
+ * @param y    First row of the band
+ * @param w    Width of the band, the image width
+ * @param h    Rows of the band, one MCU row
+ * @param data w * h pixels
+ *
+ * @return - 0 continue
+ *         - others stop decoding
+ */
+typedef int (*jpeg_band_cb_t)(void *ctx, int y, int w, int h, uint8_t *data);
+
+/**
+ * @brief Decode a jpeg image band by band, without a full frame output buffer
+ *
+ * @param jpeg jpeg data
+ * @param len  Size of jpeg data, nothing past it is read
+ * @param cb   Called for every band
+ * @param ctx  Argument of cb
+ *
+ * @return - ESP_OK success
+ *         - ESP_ERR_NO_MEM out of memory
+ *         - ESP_FAIL bad or truncated data, or stopped by cb
+ */
+esp_err_t jpeg_decode_band(const uint8_t *jpeg, size_t len, jpeg_band_cb_t cb, void *ctx);
+
+/**
+ * @brief Create a decoder that keeps its buffers between images
+ *
+ * The work pool is allocated once, the output and band buffers on first use and only grow afterwards.
+ *
+ * @return - decoder, NULL on allocation failure
+ */
+jpeg_decoder_t *jpeg_decoder_create(void);
+
+/**
+ * @brief Delete a decoder and its buffers
+ *
+ * @param dec decoder
+ */
+void jpeg_decoder_delete(jpeg_decoder_t *dec);
+
+/**
+ * @brief Decode a jpeg image in memory into the decoder's output buffer, see jpeg_decode_ex
+ *
+ * @param dec  decoder
+ * @param jpeg jpeg data
+ * @param len  Size of jpeg data, nothing past it is read even if the EOI marker is missing
+ * @param w    Filled with the image width
+ * @param h    Filled with the image height
+ *
+ * @return - RGB565 pixels in LCD byte order, owned by the decoder and valid until the next decode
+ *         - NULL on failure
+ */
+uint8_t *jpeg_decoder_decode(jpeg_decoder_t *dec, const uint8_t *jpeg, size_t len, int *w, int *h);
+
+/**
+ * @brief Decode a jpeg image from a reader into the decoder's output buffer
+ *
+ * Truncated data fails instead of reading past its end.
+ *
+ * @param dec    decoder
+ * @param reader Source of the jpeg data
+ * @param w      Filled with the image width
+ * @param h      Filled with the image height
+ *
+ * @return - RGB565 pixels in LCD byte order, owned by the decoder and valid until the next decode
+ *         - NULL on failure
+ */
+uint8_t *jpeg_decode_ex(jpeg_decoder_t *dec, jpeg_reader_t *reader, int *w, int *h);
+
+/**
+ * @brief Decode a jpeg image straight into a caller's buffer, without an intermediate copy
+ *
+ * tjpgd emits the pixel format of the target and the rows of every MCU are copied in place. Only the
+ * MCUs inside the target are decoded when the image is clipped.
+ *
+ * @param dec    decoder
+ * @param reader Source of the jpeg data
+ * @param output Target buffer, position and pixel format
+ * @param w      Filled with the image width if not NULL
+ * @param h      Filled with the image height if not NULL
+ *
+ * @return - ESP_OK success
+ *         - ESP_ERR_INVALID_ARG the image is completely outside the target
+ *         - ESP_FAIL bad or truncated data
+ */
+esp_err_t jpeg_decode_to(jpeg_decoder_t *dec, jpeg_reader_t *reader, const jpeg_output_t *output, int *w, int *h);
+
+/**
+ * @brief Decode only the luminance of a jpeg image, for vision code
+ *
+ * The Cb/Cr blocks are entropy decoded only, dequantize, IDCT, upsampling and color conversion are skipped.
+ *
+ * @param dec    decoder
+ * @param reader Source of the jpeg data
+ * @param w      Filled with the image width
+ * @param h      Filled with the image height
+ *
+ * @return - w * h 8-bit Y pixels, owned by the decoder and valid until the next decode
+ *         - NULL on failure
+ */
+uint8_t *jpeg_decode_gray(jpeg_decoder_t *dec, jpeg_reader_t *reader, int *w, int *h);
+
+/**
+ * @brief Decode only a crop window of a jpeg image, e.g. for a digital zoom
+ *
+ * MCUs outside the window are only entropy decoded, IDCT and color conversion are skipped,
+ * and decoding stops after the last MCU row of the window. Truncated data fails instead of reading past its end.
+ *
+ * @param dec    decoder
+ * @param reader Source of the jpeg data
+ * @param x      Left of the window
+ * @param y      Top of the window
+ * @param w      Width of the window, clipped to the image on return
+ * @param h      Height of the window, clipped to the image on return
+ *
+ * @return - w * h RGB565 pixels in LCD byte order, owned by the decoder and valid until the next decode
+ *         - NULL on failure or if the window is off the image
+ */
+uint8_t *jpeg_decode_roi(jpeg_decoder_t *dec, jpeg_reader_t *reader, int x, int y, int *w, int *h);
+
+/**
+ * @brief Decode a jpeg image with restart markers on several cores
+ *
+ * The RSTn markers are indexed and the restart intervals split evenly between the workers, each
+ * decoding its MCUs with its own tjpgd pool straight into the decoder's output buffer. The
+ * calling task is the first worker. Images without a restart interval are decoded by the caller alone.
+ *
+ * @param dec     decoder
+ * @param jpeg    jpeg data
+ * @param len     Size of jpeg data, nothing past it is read even if the EOI marker is missing
+ * @param workers Number of workers, 0 for one per core, at most JPEG_WORKER_MAX
+ * @param w       Filled with the image width
+ * @param h       Filled with the image height
+ *
+ * @return - RGB565 pixels in LCD byte order, owned by the decoder and valid until the next decode
+ *         - NULL on failure, or RSTn markers missing or out of sequence
+ */
+uint8_t *jpeg_decoder_decode_parallel(jpeg_decoder_t *dec, uint8_t *jpeg, size_t len, int workers, int *w, int *h);
+
+/**
+ * @brief Decode a jpeg image band by band with the decoder's band buffers, see jpeg_decode_band
+ *
+ * @param dec  decoder
+ * @param jpeg jpeg data, e.g. a camera frame. tjpgd decodes it in place
+ * @param len  Size of jpeg data, nothing past it is read even if the EOI marker is missing
+ * @param cb   Called for every band
+ * @param ctx  Argument of cb
+ *
+ * @return - ESP_OK success
+ *         - ESP_ERR_NO_MEM out of memory
+ *         - ESP_FAIL bad or truncated data, or stopped by cb
+ */
+esp_err_t jpeg_decoder_decode_band(jpeg_decoder_t *dec, const uint8_t *jpeg, size_t len, jpeg_band_cb_t cb, void *ctx);
+
+/**
+ * @brief Decode a jpeg image from a reader band by band, see jpeg_decode_band
+ *
+ * @param dec    decoder
+ * @param reader Source of the jpeg data
+ * @param cb     Called for every band
+ * @param ctx    Argument of cb
+ *
+ * @return - ESP_OK success
+ *         - ESP_ERR_NO_MEM out of memory
+ *         - ESP_FAIL bad or truncated data, or stopped by cb
+ */
+esp_err_t jpeg_decoder_decode_band_ex(jpeg_decoder_t *dec, jpeg_reader_t *reader, jpeg_band_cb_t cb, void *ctx);
+
+/**
+ * @brief Get how long the last successful decode took, including the time spent in band callbacks
+ *
+ * @param dec decoder
+ *
+ * @return - decode time in us
+ */
+int64_t jpeg_decoder_get_decode_time(const jpeg_decoder_t *dec);
+
+/**
+ * @brief Get the decode time, work pool usage and per stage ticks of the decoder
+ *
+ * Ticks are CPU cycles on the target and nanoseconds on a host build.
+ *
+ * @param dec   decoder
+ * @param stats Filled with the statistics
+ */
+void jpeg_decoder_get_stats(const jpeg_decoder_t *dec, jpeg_decoder_stats_t *stats);
@@ -0,0 +1,104 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "jpeg_port.h"
+#include "jpeg.h"
+
+#define JPEG_ENC_OUT_BUF_SIZE 1024 //Encoded data is passed to write_cb in pieces of this size
+
+typedef struct jpeg_enc jpeg_enc_t;
+
+typedef enum {
+    JPEG_ENC_SUBSAMPLE_420 = 0, //16x16 MCUs, chroma halved both ways. Smallest files
+    JPEG_ENC_SUBSAMPLE_444,     //8x8 MCUs, full chroma
+} jpeg_enc_subsample_t;
+
+/**
+ * @brief Called with the next piece of the encoded jpeg data
+ *
+ * @param ctx  write_ctx of the config
+ * @param data Encoded data, only valid during the call
+ * @param len  Size of data
+ *
+ * @return - 0 continue
+ *         - others stop encoding
+ */
+typedef int (*jpeg_enc_write_cb_t)(void *ctx, const uint8_t *data, size_t len);
+
+typedef struct {
+    int width;
+    int height;
+    jpeg_pixel_format_t format;     //Input pixels. RGB565_BE is the camera and LCD byte order, GRAY8 gives a grayscale jpeg
+    uint8_t quality;                //1 - 100, scales the standard quantization tables like libjpeg
+    jpeg_enc_subsample_t subsample; //Ignored for GRAY8
+    jpeg_enc_write_cb_t write_cb;
+    void *write_ctx;
+} jpeg_enc_config_t;
+
+/**
+ * @brief Create an encoder for one frame size
+ *
+ * All its memory, the tables, one MCU row of input and the output buffer, is internal RAM.
+ * A QVGA RGB565 encoder takes about 16 KB.
+ *
+ * @param config Frame size, format, quality and output
+ *
+ * @return - encoder, NULL on bad config or allocation failure
+ */
+jpeg_enc_t *jpeg_enc_create(const jpeg_enc_config_t *config);
+
+/**
+ * @brief Delete an encoder
+ *
+ * @param enc encoder
+ */
+void jpeg_enc_delete(jpeg_enc_t *enc);
+
+/**
+ * @brief Start a frame, writes the jpeg headers
+ *
+ * @param enc encoder
+ *
+ * @return - ESP_OK success
+ *         - ESP_FAIL stopped by write_cb
+ */
+esp_err_t jpeg_enc_start(jpeg_enc_t *enc);
+
+/**
+ * @brief Encode the next rows of the frame
+ *
+ * Rows may come in bands of any height, e.g. as the camera delivers them. Complete MCU rows are
+ * encoded straight from data, only the rest is copied until the band that completes the MCU row.
+ *
+ * @param enc    encoder
+ * @param data   First pixel of the band
+ * @param rows   Rows in the band
+ * @param stride Bytes from one row to the next
+ *
+ * @return - ESP_OK success
+ *         - ESP_ERR_INVALID_ARG more rows than the frame has
+ *         - ESP_FAIL stopped by write_cb
+ */
+esp_err_t jpeg_enc_write_rows(jpeg_enc_t *enc, const uint8_t *data, int rows, int stride);
+
+/**
+ * @brief Finish the frame, encodes the last MCU row and writes the EOI marker
+ *
+ * @param enc encoder
+ *
+ * @return - ESP_OK success
+ *         - ESP_FAIL rows missing or stopped by write_cb
+ */
+esp_err_t jpeg_enc_finish(jpeg_enc_t *enc);
+
+/**
+ * @brief Encode a whole frame, jpeg_enc_start, jpeg_enc_write_rows and jpeg_enc_finish in one call
+ *
+ * @param enc    encoder
+ * @param image  First pixel of the frame
+ * @param stride Bytes from one row to the next
+ *
+ * @return - ESP_OK success
+ *         - ESP_FAIL stopped by write_cb
+ */
+esp_err_t jpeg_enc_encode(jpeg_enc_t *enc, const uint8_t *image, int stride);
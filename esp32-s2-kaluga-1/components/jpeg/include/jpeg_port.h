@@ -0,0 +1,131 @@
+#pragma once
+//Platform shim of the jpeg component. On the target it pulls the IDF headers, elsewhere (a Linux
+//host build of jpeg.c and tjpgd.c for benchmarks) it maps the few IDF calls used onto libc.
+
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "hal/cpu_hal.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+//CPU cycles
+#define jpeg_port_ticks() cpu_hal_get_cycle_count()
+
+#define JPEG_PORT_CORES portNUM_PROCESSORS
+
+//Worker of jpeg_decoder_decode_parallel, a task that gives done and deletes itself when fn returns
+typedef struct {
+    void (*fn)(void *arg);
+    void *arg;
+    SemaphoreHandle_t done;
+} jpeg_port_thread_t;
+
+static inline void jpeg_port_thread_entry(void *arg)
+{
+    jpeg_port_thread_t *thread = (jpeg_port_thread_t *)arg;
+    thread->fn(thread->arg);
+    xSemaphoreGive(thread->done);
+    vTaskDelete(NULL);
+}
+
+static inline int jpeg_port_thread_start(jpeg_port_thread_t *thread, void (*fn)(void *arg), void *arg, int core)
+{
+    thread->fn = fn;
+    thread->arg = arg;
+    thread->done = xSemaphoreCreateBinary();
+    if (!thread->done) {
+        return -1;
+    }
+    if (xTaskCreatePinnedToCore(jpeg_port_thread_entry, "jpeg_worker", 4096, thread, uxTaskPriorityGet(NULL), NULL, core % portNUM_PROCESSORS) != pdPASS) {
+        vSemaphoreDelete(thread->done);
+        return -1;
+    }
+    return 0;
+}
+
+static inline void jpeg_port_thread_join(jpeg_port_thread_t *thread)
+{
+    xSemaphoreTake(thread->done, portMAX_DELAY);
+    vSemaphoreDelete(thread->done);
+}
+
+#else
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK              0
+#define ESP_FAIL            -1
+#define ESP_ERR_NO_MEM      0x101
+#define ESP_ERR_INVALID_ARG 0x102
+
+#define MALLOC_CAP_DMA    (1 << 3)
+#define MALLOC_CAP_8BIT   (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+#define heap_caps_malloc(size, caps)    malloc(size)
+#define heap_caps_calloc(n, size, caps) calloc(n, size)
+
+#define ESP_LOGE(tag, format, ...) fprintf(stderr, "E (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) fprintf(stderr, "W (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) fprintf(stderr, "I (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) do { } while (0)
+
+static inline int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+//Nanoseconds, there is no portable cycle counter
+static inline uint32_t jpeg_port_ticks(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+#define JPEG_PORT_CORES ((int)sysconf(_SC_NPROCESSORS_ONLN))
+
+typedef struct {
+    void (*fn)(void *arg);
+    void *arg;
+    pthread_t thread;
+} jpeg_port_thread_t;
+
+static inline void *jpeg_port_thread_entry(void *arg)
+{
+    jpeg_port_thread_t *thread = (jpeg_port_thread_t *)arg;
+    thread->fn(thread->arg);
+    return NULL;
+}
+
+//core is ignored, the host schedules the threads
+static inline int jpeg_port_thread_start(jpeg_port_thread_t *thread, void (*fn)(void *arg), void *arg, int core)
+{
+    thread->fn = fn;
+    thread->arg = arg;
+    return pthread_create(&thread->thread, NULL, jpeg_port_thread_entry, thread) ? -1 : 0;
+}
+
+static inline void jpeg_port_thread_join(jpeg_port_thread_t *thread)
+{
+    pthread_join(thread->thread, NULL);
+}
+
+#endif
@@ -7,12 +7,19 @@
 /* System Configurations */
 
 #define	JD_SZBUF		512	/* Size of stream input buffer */
-#define JD_FORMAT		1	/* Output pixel format 0:RGB888 (3 BYTE/pix), 1:RGB565 (1 WORD/pix) */
+#define JD_FORMAT		2	/* Default output pixel format 0:RGB888 (3 BYTE/pix), 1:RGB565 (1 WORD/pix), 2:RGB565 big-endian (2 BYTE/pix) */
 #define	JD_USE_SCALE	1	/* Use descaling feature for output */
+#ifndef JD_FASTDECODE		/* May be set by the build, the host benchmarks compare both readers */
+#define JD_FASTDECODE	1	/* 0:Read the stream bit by bit, 1:32-bit bit buffer and Huffman lookup tables (needs 4 KB more pool) */
+#endif
+#define JD_HUFFLUT_BITS	9	/* Code length resolved by a single lookup table access when JD_FASTDECODE == 1 */
 #define JD_TBLCLIP		1	/* Use table for saturation (might be a bit faster but increases 1K bytes of code size) */
+#define JD_PROFILE		0	/* 1:Count ticks of each decoding stage in JDEC.prof, jpeg_port_ticks() is the tick source */
 
 /*---------------------------------------------------------------------------*/
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -32,11 +39,17 @@ typedef unsigned short	USHORT;
 typedef unsigned short	WORD;
 typedef unsigned short	WCHAR;
 
-/* These types must be 32-bit integer */
-typedef long			LONG;
-typedef unsigned long	ULONG;
-typedef unsigned long	DWORD;
+/* These types must be 32-bit integer, long is 64-bit on LP64 hosts */
+typedef int32_t			LONG;
+typedef uint32_t		ULONG;
+typedef uint32_t		DWORD;
+
 
+/* Stages counted in JDEC.prof */
+#define JD_PROF_HUFF	0
+#define JD_PROF_IDCT	1
+#define JD_PROF_COLOR	2
+#define JD_PROF_OUTPUT	3
 
 /* Error code */
 typedef enum {
@@ -68,6 +81,8 @@ struct JDEC {
 	BYTE* inbuf;			/* Bit stream input buffer */
 	BYTE dmsk;				/* Current bit in the current read byte */
 	BYTE scale;				/* Output scaling ratio */
+	BYTE gray;				/* 1:Output 8-bit Y only and skip the Cb/Cr blocks (can be set after jd_prepare) */
+	BYTE format;			/* Output pixel format of RGB output, see JD_FORMAT (can be set after jd_prepare) */
 	BYTE msx, msy;			/* MCU size in unit of block (width, height) */
 	BYTE qtid[3];			/* Quantization table ID of each component */
 	SHORT dcv[3];			/* Previous DC element of each component */
@@ -76,12 +91,22 @@ struct JDEC {
 	BYTE* huffbits[2][2];	/* Huffman bit distribution tables [id][dcac] */
 	WORD* huffcode[2][2];	/* Huffman code word tables [id][dcac] */
 	BYTE* huffdata[2][2];	/* Huffman decoded data tables [id][dcac] */
+#if JD_FASTDECODE
+	WORD* hufflut[2][2];	/* Huffman lookup tables [id][dcac], (code length << 8 | decoded data), 0 for longer codes */
+	DWORD wreg;				/* Bit buffer, the dbit low bits are valid */
+	BYTE dbit;				/* Number of valid bits in the bit buffer */
+	BYTE marker;			/* Marker found in the stream, zeros are fed from here on */
+#endif
+#if JD_PROFILE
+	DWORD prof[4];			/* Ticks spent in Huffman decode and dequantize, IDCT, color conversion and scaling, output function */
+#endif
 	LONG* qttbl[4];			/* Dequaitizer tables [id] */
 	void* workbuf;			/* Working buffer for IDCT and RGB output */
 	BYTE* mcubuf;			/* Working buffer for the MCU */
 	void* pool;				/* Pointer to available memory pool */
 	UINT sz_pool;			/* Size of momory pool (bytes available) */
 	UINT (*infunc)(JDEC*, BYTE*, UINT);/* Pointer to jpeg stream input function */
+	UINT (*inref)(JDEC*, BYTE**);/* Optional in-place input of the entropy coded data, returns the bytes available at *ptr (can be set after jd_prepare, used if JD_FASTDECODE) */
 	void* device;			/* Pointer to I/O device identifiler for the session */
 };
 
@@ -90,6 +115,8 @@ struct JDEC {
 /* TJpgDec API functions */
 JRESULT jd_prepare (JDEC*, UINT(*)(JDEC*,BYTE*,UINT), void*, UINT, void*);
 JRESULT jd_decomp (JDEC*, UINT(*)(JDEC*,void*,JRECT*), BYTE);
+JRESULT jd_decomp_rect (JDEC*, UINT(*)(JDEC*,void*,JRECT*), BYTE, const JRECT*);
+JRESULT jd_decomp_seg (JDEC*, UINT(*)(JDEC*,void*,JRECT*), BYTE, UINT, UINT);
 
 
 #ifdef __cplusplus
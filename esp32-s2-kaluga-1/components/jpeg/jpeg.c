@@ -1,80 +1,848 @@
-#include <stdio.h>
-#include <string.h>
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-#include "esp_log.h"
-#include "jpeg.h"
-
-
-const char *TAG="jpeg";
-
-typedef struct {	
-    uint8_t *in;   //Pointer to jpeg data
-    int in_pos;    //Current position in jpeg data
-    uint8_t *out;
-    int out_pos;
-} jpeg_decode_obj_t;
-
-//Input function for jpeg decoder. Just returns bytes from the inData field of the JpegDev structure.
-static UINT jpeg_decode_in_callback(JDEC *decoder, BYTE *buf, UINT len) 
-{
-    //Read bytes from input file
-    jpeg_decode_obj_t *jpeg_decode_obj = (jpeg_decode_obj_t *)decoder->device;
-
-    if (buf != NULL) {
-        memcpy(buf, &jpeg_decode_obj->in[jpeg_decode_obj->in_pos], len);
-    }
-    jpeg_decode_obj->in_pos += len;
-    return len;
-}
-
-//Output function. Re-encodes the RGB888 data from the decoder as big-endian RGB565 and
-//stores it in the outData array of the JpegDev structure.
-static UINT jpeg_decode_out_callback(JDEC *decoder, void *bitmap, JRECT *rect) 
-{
-    jpeg_decode_obj_t *jpeg_decode_obj = (jpeg_decode_obj_t *)decoder->device;
-    uint8_t *in = (uint8_t*)bitmap;
-
-    for (int y = rect->top; y <= rect->bottom; y++) {
-        for (int x = rect->left; x <= rect->right; x++) {
-            //The LCD wants the 16-bit value in big-endian, so swap bytes
-            jpeg_decode_obj->out[2 * (y * decoder->width + x)] = in[1];
-            jpeg_decode_obj->out[2 * (y * decoder->width + x) + 1] = in[0];
-            jpeg_decode_obj->out_pos += 2;
-            in += 2;
-        }
-    }
-    return 1;
-}
-
-uint8_t *jpeg_decode(uint8_t *jpeg, int *w, int* h)
-{
-    jpeg_decode_obj_t jpeg_decode_obj = {0};
-    JDEC decoder = {0};
-    int ret = -1;
-
-    jpeg_decode_obj.in = jpeg;
-    jpeg_decode_obj.in_pos = 0;
-    jpeg_decode_obj.out_pos = 0;
-    char *work_buf = (char *)heap_caps_calloc(JPEG_WORK_BUF_SIZE, sizeof(uint8_t), MALLOC_CAP_SPIRAM);
-    //Prepare and decode the jpeg.
-    ret = jd_prepare(&decoder, jpeg_decode_in_callback, work_buf, JPEG_WORK_BUF_SIZE, (void*)&jpeg_decode_obj);
-    if (ret != JDR_OK) {
-        ESP_LOGE(TAG, "Image decoder: jd_prepare failed (%d)", ret);
-        free(work_buf);
-        return NULL;
-    }
-    *w = decoder.width;
-    *h = decoder.height;
-    jpeg_decode_obj.out = (uint8_t *)heap_caps_calloc(decoder.width * decoder.height, sizeof(uint16_t), MALLOC_CAP_SPIRAM);
-    ret = jd_decomp(&decoder, jpeg_decode_out_callback, 0);
-    if (ret != JDR_OK) {
-        ESP_LOGE(TAG, "Image decoder: jd_decode failed (%d)", ret);
-        free(jpeg_decode_obj.out);
-        free(work_buf);
-        return NULL;
-    }
-
-    free(work_buf);
-    return jpeg_decode_obj.out;
-}
\ No newline at end of file
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jpeg_port.h"
+#include "jpeg.h"
+
+
+const char *TAG="jpeg";
+
+struct jpeg_decoder {
+    char *work_buf;          //tjpgd memory pool, the same size for every image
+    uint8_t *out;            //Full frame output, grown when the resolution grows
+    size_t out_size;
+    uint8_t *band_buf[2];    //Band buffers, used in turn so a band sent asynchronously stays valid
+    size_t band_size;
+    int band_index;
+    int64_t decode_time;     //Time of the last decode in us
+    uint32_t pool_used;      //Work pool used by the last image
+    uint32_t pool_peak;
+    uint32_t stage_ticks[4]; //JD_PROF_* ticks of the last decode
+    char *worker_buf[JPEG_WORKER_MAX]; //Work pools of the parallel workers but the first, which uses work_buf
+    uint32_t *rst_offs;      //Restart interval index of jpeg_decoder_decode_parallel
+    int rst_max;
+};
+
+typedef struct {	
+    uint8_t *in;   //Pointer to jpeg data
+    int in_pos;    //Current position in jpeg data
+    int in_len;    //Size of jpeg data, 0 if unknown
+    jpeg_reader_t *reader; //Reads the jpeg data instead of in if set
+    jpeg_output_t output; //Target of jpeg_decode_out_callback
+    uint8_t *out;
+    int out_pos;
+    jpeg_decoder_t *decoder;
+    jpeg_band_cb_t band_cb;
+    void *band_ctx;
+    int band_top;  //First row of the band being filled
+    JRECT roi;     //Crop window of jpeg_decode_roi, inclusive
+} jpeg_decode_obj_t;
+
+static jpeg_decoder_t *jpeg_default_decoder = NULL; //Used by jpeg_decode_band
+
+//Input function for jpeg decoder. Just returns bytes from the inData field of the JpegDev structure.
+static UINT jpeg_decode_in_callback(JDEC *decoder, BYTE *buf, UINT len) 
+{
+    //Read bytes from input file
+    jpeg_decode_obj_t *jpeg_decode_obj = (jpeg_decode_obj_t *)decoder->device;
+
+    if (jpeg_decode_obj->in_len && (int)len > jpeg_decode_obj->in_len - jpeg_decode_obj->in_pos) {
+        len = jpeg_decode_obj->in_len - jpeg_decode_obj->in_pos;
+    }
+    if (buf != NULL) {
+        memcpy(buf, &jpeg_decode_obj->in[jpeg_decode_obj->in_pos], len);
+    }
+    jpeg_decode_obj->in_pos += len;
+    return len;
+}
+
+//Input function of jpeg_decode_ex and jpeg_decoder_decode_band_ex
+static UINT jpeg_decode_reader_callback(JDEC *decoder, BYTE *buf, UINT len)
+{
+    jpeg_decode_obj_t *jpeg_decode_obj = (jpeg_decode_obj_t *)decoder->device;
+
+    return jpeg_decode_obj->reader->read(jpeg_decode_obj->reader, buf, len);
+}
+
+//Zero copy input, tjpgd reads the entropy coded data straight from the reader's memory
+static UINT jpeg_decode_reader_ref_callback(JDEC *decoder, BYTE **buf)
+{
+    jpeg_decode_obj_t *jpeg_decode_obj = (jpeg_decode_obj_t *)decoder->device;
+    const uint8_t *data = NULL;
+    size_t len = jpeg_decode_obj->reader->map(jpeg_decode_obj->reader, &data);
+
+    *buf = (BYTE *)data;
+    return len;
+}
+
+static size_t jpeg_reader_mem_read(jpeg_reader_t *reader, uint8_t *buf, size_t len)
+{
+    if (len > reader->len - reader->pos) {
+        len = reader->len - reader->pos;
+    }
+    if (buf != NULL) {
+        memcpy(buf, &reader->data[reader->pos], len);
+    }
+    reader->pos += len;
+    return len;
+}
+
+static size_t jpeg_reader_mem_map(jpeg_reader_t *reader, const uint8_t **data)
+{
+    size_t len = reader->len - reader->pos;
+
+    *data = &reader->data[reader->pos];
+    reader->pos = reader->len;
+    return len;
+}
+
+static size_t jpeg_reader_file_read(jpeg_reader_t *reader, uint8_t *buf, size_t len)
+{
+    FILE *file = (FILE *)reader->ctx;
+
+    if (buf == NULL) {
+        return fseek(file, len, SEEK_CUR) == 0 ? len : 0;
+    }
+    return fread(buf, 1, len, file);
+}
+
+//The chunk reader keeps its position in the current chunk in pos
+static size_t jpeg_reader_chunks_read(jpeg_reader_t *reader, uint8_t *buf, size_t len)
+{
+    size_t done = 0;
+
+    while (done < len && reader->chunk < reader->chunk_num) {
+        const jpeg_chunk_t *chunk = &reader->chunks[reader->chunk];
+        size_t n = chunk->len - reader->pos;
+        if (n > len - done) {
+            n = len - done;
+        }
+        if (buf != NULL) {
+            memcpy(&buf[done], &chunk->data[reader->pos], n);
+        }
+        done += n;
+        reader->pos += n;
+        if (reader->pos == chunk->len) {
+            reader->chunk++;
+            reader->pos = 0;
+        }
+    }
+    return done;
+}
+
+static size_t jpeg_reader_chunks_map(jpeg_reader_t *reader, const uint8_t **data)
+{
+    //Skip empty chunks, 0 is the end of the data
+    while (reader->chunk < reader->chunk_num && reader->pos == reader->chunks[reader->chunk].len) {
+        reader->chunk++;
+        reader->pos = 0;
+    }
+    if (reader->chunk == reader->chunk_num) {
+        return 0;
+    }
+
+    const jpeg_chunk_t *chunk = &reader->chunks[reader->chunk];
+    size_t len = chunk->len - reader->pos;
+    *data = &chunk->data[reader->pos];
+    reader->chunk++;
+    reader->pos = 0;
+    return len;
+}
+
+void jpeg_reader_init_mem(jpeg_reader_t *reader, const uint8_t *data, size_t len)
+{
+    memset(reader, 0, sizeof(jpeg_reader_t));
+    reader->read = jpeg_reader_mem_read;
+    reader->map = jpeg_reader_mem_map;
+    reader->data = data;
+    reader->len = len;
+}
+
+void jpeg_reader_init_file(jpeg_reader_t *reader, FILE *file)
+{
+    memset(reader, 0, sizeof(jpeg_reader_t));
+    reader->read = jpeg_reader_file_read;
+    reader->ctx = file;
+}
+
+void jpeg_reader_init_chunks(jpeg_reader_t *reader, const jpeg_chunk_t *chunks, int chunk_num)
+{
+    memset(reader, 0, sizeof(jpeg_reader_t));
+    reader->read = jpeg_reader_chunks_read;
+    reader->map = jpeg_reader_chunks_map;
+    reader->chunks = chunks;
+    reader->chunk_num = chunk_num;
+}
+
+static int jpeg_pixel_size(jpeg_pixel_format_t format)
+{
+    switch (format) {
+    case JPEG_PIXEL_FORMAT_GRAY8:
+        return 1;
+    case JPEG_PIXEL_FORMAT_RGB888:
+        return 3;
+    default:
+        return 2;
+    }
+}
+
+//A tightly packed buffer of w pixels per row
+static void jpeg_output_init_packed(jpeg_output_t *output, uint8_t *buf, int w, jpeg_pixel_format_t format)
+{
+    memset(output, 0, sizeof(jpeg_output_t));
+    output->base = buf;
+    output->stride = w * jpeg_pixel_size(format);
+    output->format = format;
+}
+
+//tjpgd emits the pixel format of the output itself, so the output function only copies rows
+static void jpeg_decoder_set_format(JDEC *decoder, jpeg_pixel_format_t format)
+{
+    switch (format) {
+    case JPEG_PIXEL_FORMAT_GRAY8:
+        decoder->gray = 1;
+        break;
+    case JPEG_PIXEL_FORMAT_RGB888:
+        decoder->format = 0;
+        break;
+    case JPEG_PIXEL_FORMAT_RGB565_LE:
+        decoder->format = 1; //Native WORDs, little-endian on the ESP32 family
+        break;
+    default:
+        decoder->format = 2;
+        break;
+    }
+}
+
+//Output function. Every row of the MCU is copied into the output target as a whole, clipped to its size if set
+static UINT jpeg_decode_out_callback(JDEC *decoder, void *bitmap, JRECT *rect) 
+{
+    jpeg_decode_obj_t *jpeg_decode_obj = (jpeg_decode_obj_t *)decoder->device;
+    const jpeg_output_t *output = &jpeg_decode_obj->output;
+    int bpp = jpeg_pixel_size(output->format);
+    int rect_w = rect->right - rect->left + 1;
+    int left = rect->left + output->x;
+    int right = rect->right + output->x;
+    int top = rect->top + output->y;
+    int bottom = rect->bottom + output->y;
+
+    if (output->width) {
+        left = left < 0 ? 0 : left;
+        right = right >= output->width ? output->width - 1 : right;
+    }
+    if (output->height) {
+        top = top < 0 ? 0 : top;
+        bottom = bottom >= output->height ? output->height - 1 : bottom;
+    }
+    if (left > right || top > bottom) {
+        return 1;
+    }
+
+    uint8_t *in = (uint8_t*)bitmap + bpp * ((top - output->y - rect->top) * rect_w + (left - output->x - rect->left));
+    uint8_t *out = output->base + top * output->stride + left * bpp;
+    int row_size = bpp * (right - left + 1);
+
+    for (int y = top; y <= bottom; y++) {
+        memcpy(out, in, row_size);
+        jpeg_decode_obj->out_pos += row_size;
+        out += output->stride;
+        in += bpp * rect_w;
+    }
+    return 1;
+}
+
+//ROI output function. The MCUs overlapping the crop window are clipped to it and copied row by row.
+static UINT jpeg_decode_roi_out_callback(JDEC *decoder, void *bitmap, JRECT *rect)
+{
+    jpeg_decode_obj_t *jpeg_decode_obj = (jpeg_decode_obj_t *)decoder->device;
+    JRECT *roi = &jpeg_decode_obj->roi;
+    int roi_w = roi->right - roi->left + 1;
+    int rect_w = rect->right - rect->left + 1;
+    int left = rect->left > roi->left ? rect->left : roi->left;
+    int right = rect->right < roi->right ? rect->right : roi->right;
+    int top = rect->top > roi->top ? rect->top : roi->top;
+    int bottom = rect->bottom < roi->bottom ? rect->bottom : roi->bottom;
+
+    if (left > right || top > bottom) {
+        return 1;
+    }
+
+    uint8_t *in = (uint8_t*)bitmap + 2 * ((top - rect->top) * rect_w + (left - rect->left));
+    uint8_t *out = &jpeg_decode_obj->out[2 * ((top - roi->top) * roi_w + (left - roi->left))];
+
+    for (int y = top; y <= bottom; y++) {
+        memcpy(out, in, 2 * (right - left + 1));
+        out += 2 * roi_w;
+        in += 2 * rect_w;
+    }
+    return 1;
+}
+
+//Band output function. Collects the MCUs of one MCU row into a band buffer and passes the band on
+//once the last MCU of the row is in, so the caller never needs a full frame buffer.
+static UINT jpeg_decode_band_out_callback(JDEC *decoder, void *bitmap, JRECT *rect)
+{
+    jpeg_decode_obj_t *jpeg_decode_obj = (jpeg_decode_obj_t *)decoder->device;
+    jpeg_decoder_t *dec = jpeg_decode_obj->decoder;
+    uint8_t *in = (uint8_t*)bitmap;
+    uint8_t *band = dec->band_buf[dec->band_index];
+    int row_size = 2 * (rect->right - rect->left + 1);
+    uint8_t *out = &band[2 * ((rect->top - jpeg_decode_obj->band_top) * decoder->width + rect->left)];
+
+    for (int y = rect->top; y <= rect->bottom; y++) {
+        memcpy(out, in, row_size);
+        out += 2 * decoder->width;
+        in += row_size;
+    }
+
+    if (rect->right == decoder->width - 1) {
+        int band_high = rect->bottom - jpeg_decode_obj->band_top + 1;
+        if (jpeg_decode_obj->band_cb(jpeg_decode_obj->band_ctx, jpeg_decode_obj->band_top, decoder->width, band_high, band) != 0) {
+            return 0;
+        }
+        dec->band_index = !dec->band_index;
+        jpeg_decode_obj->band_top = rect->bottom + 1;
+    }
+    return 1;
+}
+
+static void jpeg_decoder_update_stats(jpeg_decoder_t *dec, JDEC *decoder, int64_t start)
+{
+    dec->decode_time = esp_timer_get_time() - start;
+    dec->pool_used = JPEG_WORK_BUF_SIZE - decoder->sz_pool;
+    if (dec->pool_used > dec->pool_peak) {
+        dec->pool_peak = dec->pool_used;
+    }
+#if JD_PROFILE
+    memcpy(dec->stage_ticks, decoder->prof, sizeof(dec->stage_ticks));
+#endif
+}
+
+//Parses the headers from the reader of jpeg_decode_obj, or from its in without one
+static int jpeg_decoder_prepare(jpeg_decoder_t *dec, JDEC *decoder, jpeg_decode_obj_t *jpeg_decode_obj)
+{
+    int ret = -1;
+
+    jpeg_decode_obj->decoder = dec;
+    if (jpeg_decode_obj->reader) {
+        ret = jd_prepare(decoder, jpeg_decode_reader_callback, dec->work_buf, JPEG_WORK_BUF_SIZE, (void*)jpeg_decode_obj);
+        if (ret == JDR_OK && jpeg_decode_obj->reader->map) {
+            decoder->inref = jpeg_decode_reader_ref_callback;
+        }
+    } else {
+        ret = jd_prepare(decoder, jpeg_decode_in_callback, dec->work_buf, JPEG_WORK_BUF_SIZE, (void*)jpeg_decode_obj);
+    }
+    if (ret != JDR_OK) {
+        ESP_LOGE(TAG, "Image decoder: jd_prepare failed (%d)", ret);
+    }
+    return ret;
+}
+
+uint8_t *jpeg_decode(uint8_t *jpeg, int *w, int* h)
+{
+    jpeg_decode_obj_t jpeg_decode_obj = {0};
+    JDEC decoder = {0};
+    int ret = -1;
+
+    jpeg_decode_obj.in = jpeg;
+    jpeg_decode_obj.in_pos = 0;
+    jpeg_decode_obj.out_pos = 0;
+    char *work_buf = (char *)heap_caps_calloc(JPEG_WORK_BUF_SIZE, sizeof(uint8_t), MALLOC_CAP_SPIRAM);
+    //Prepare and decode the jpeg.
+    ret = jd_prepare(&decoder, jpeg_decode_in_callback, work_buf, JPEG_WORK_BUF_SIZE, (void*)&jpeg_decode_obj);
+    if (ret != JDR_OK) {
+        ESP_LOGE(TAG, "Image decoder: jd_prepare failed (%d)", ret);
+        free(work_buf);
+        return NULL;
+    }
+    *w = decoder.width;
+    *h = decoder.height;
+    jpeg_decode_obj.out = (uint8_t *)heap_caps_calloc(decoder.width * decoder.height, sizeof(uint16_t), MALLOC_CAP_SPIRAM);
+    jpeg_output_init_packed(&jpeg_decode_obj.output, jpeg_decode_obj.out, decoder.width, JPEG_PIXEL_FORMAT_RGB565_BE);
+    ret = jd_decomp(&decoder, jpeg_decode_out_callback, 0);
+    if (ret != JDR_OK) {
+        ESP_LOGE(TAG, "Image decoder: jd_decode failed (%d)", ret);
+        free(jpeg_decode_obj.out);
+        free(work_buf);
+        return NULL;
+    }
+
+    free(work_buf);
+    return jpeg_decode_obj.out;
+}
+
+jpeg_decoder_t *jpeg_decoder_create(void)
+{
+    jpeg_decoder_t *dec = (jpeg_decoder_t *)calloc(1, sizeof(jpeg_decoder_t));
+    if (!dec) {
+        return NULL;
+    }
+
+    dec->work_buf = (char *)heap_caps_calloc(JPEG_WORK_BUF_SIZE, sizeof(uint8_t), MALLOC_CAP_SPIRAM);
+    if (!dec->work_buf) {
+        ESP_LOGE(TAG, "Image decoder: work buffer malloc failed");
+        free(dec);
+        return NULL;
+    }
+    return dec;
+}
+
+void jpeg_decoder_delete(jpeg_decoder_t *dec)
+{
+    if (!dec) {
+        return;
+    }
+
+    free(dec->work_buf);
+    free(dec->out);
+    free(dec->band_buf[0]);
+    free(dec->band_buf[1]);
+    for (int i = 1; i < JPEG_WORKER_MAX; i++) {
+        free(dec->worker_buf[i]);
+    }
+    free(dec->rst_offs);
+    free(dec);
+}
+
+//Decodes into the decoder's output buffer, packed in the given format
+static uint8_t *jpeg_decoder_decode_obj(jpeg_decoder_t *dec, jpeg_decode_obj_t *jpeg_decode_obj, jpeg_pixel_format_t format, int *w, int *h)
+{
+    JDEC decoder = {0};
+    int ret = -1;
+    int64_t start = esp_timer_get_time();
+
+    ret = jpeg_decoder_prepare(dec, &decoder, jpeg_decode_obj);
+    if (ret != JDR_OK) {
+        return NULL;
+    }
+    jpeg_decoder_set_format(&decoder, format);
+
+    //Only reallocate when the image no longer fits, frames of a stream share one resolution
+    size_t out_size = decoder.width * decoder.height * jpeg_pixel_size(format);
+    if (out_size > dec->out_size) {
+        free(dec->out);
+        dec->out = (uint8_t *)heap_caps_malloc(out_size, MALLOC_CAP_SPIRAM);
+        dec->out_size = dec->out ? out_size : 0;
+        if (!dec->out) {
+            ESP_LOGE(TAG, "Image decoder: output malloc failed");
+            return NULL;
+        }
+    }
+
+    jpeg_output_init_packed(&jpeg_decode_obj->output, dec->out, decoder.width, format);
+    ret = jd_decomp(&decoder, jpeg_decode_out_callback, 0);
+    if (ret != JDR_OK) {
+        ESP_LOGE(TAG, "Image decoder: jd_decode failed (%d)", ret);
+        return NULL;
+    }
+
+    *w = decoder.width;
+    *h = decoder.height;
+    jpeg_decoder_update_stats(dec, &decoder, start);
+    return dec->out;
+}
+
+uint8_t *jpeg_decoder_decode(jpeg_decoder_t *dec, const uint8_t *jpeg, size_t len, int *w, int *h)
+{
+    jpeg_decode_obj_t jpeg_decode_obj = {0};
+    jpeg_reader_t reader;
+
+    jpeg_reader_init_mem(&reader, jpeg, len);
+    jpeg_decode_obj.reader = &reader;
+    return jpeg_decoder_decode_obj(dec, &jpeg_decode_obj, JPEG_PIXEL_FORMAT_RGB565_BE, w, h);
+}
+
+uint8_t *jpeg_decode_ex(jpeg_decoder_t *dec, jpeg_reader_t *reader, int *w, int *h)
+{
+    jpeg_decode_obj_t jpeg_decode_obj = {0};
+
+    jpeg_decode_obj.reader = reader;
+    return jpeg_decoder_decode_obj(dec, &jpeg_decode_obj, JPEG_PIXEL_FORMAT_RGB565_BE, w, h);
+}
+
+uint8_t *jpeg_decode_gray(jpeg_decoder_t *dec, jpeg_reader_t *reader, int *w, int *h)
+{
+    jpeg_decode_obj_t jpeg_decode_obj = {0};
+
+    jpeg_decode_obj.reader = reader;
+    return jpeg_decoder_decode_obj(dec, &jpeg_decode_obj, JPEG_PIXEL_FORMAT_GRAY8, w, h);
+}
+
+esp_err_t jpeg_decode_to(jpeg_decoder_t *dec, jpeg_reader_t *reader, const jpeg_output_t *output, int *w, int *h)
+{
+    jpeg_decode_obj_t jpeg_decode_obj = {0};
+    JDEC decoder = {0};
+    JRECT rect;
+    int ret = -1;
+    int64_t start = esp_timer_get_time();
+
+    jpeg_decode_obj.reader = reader;
+    jpeg_decode_obj.output = *output;
+    ret = jpeg_decoder_prepare(dec, &decoder, &jpeg_decode_obj);
+    if (ret != JDR_OK) {
+        return ESP_FAIL;
+    }
+    jpeg_decoder_set_format(&decoder, output->format);
+
+    //Part of the image inside the target, the MCUs outside it are not decoded
+    int left = output->x < 0 ? -output->x : 0;
+    int top = output->y < 0 ? -output->y : 0;
+    int right = decoder.width - 1;
+    int bottom = decoder.height - 1;
+    if (output->width && right >= output->width - output->x) {
+        right = output->width - output->x - 1;
+    }
+    if (output->height && bottom >= output->height - output->y) {
+        bottom = output->height - output->y - 1;
+    }
+    if (left > right || top > bottom) {
+        ESP_LOGE(TAG, "Image decoder: image out of the output target");
+        return ESP_ERR_INVALID_ARG;
+    }
+    rect.left = left;
+    rect.right = right;
+    rect.top = top;
+    rect.bottom = bottom;
+
+    ret = jd_decomp_rect(&decoder, jpeg_decode_out_callback, 0, &rect);
+    if (ret != JDR_OK) {
+        ESP_LOGE(TAG, "Image decoder: jd_decode failed (%d)", ret);
+        return ESP_FAIL;
+    }
+
+    if (w) {
+        *w = decoder.width;
+    }
+    if (h) {
+        *h = decoder.height;
+    }
+    jpeg_decoder_update_stats(dec, &decoder, start);
+    return ESP_OK;
+}
+
+uint8_t *jpeg_decode_roi(jpeg_decoder_t *dec, jpeg_reader_t *reader, int x, int y, int *w, int *h)
+{
+    jpeg_decode_obj_t jpeg_decode_obj = {0};
+    JDEC decoder = {0};
+    int ret = -1;
+    int64_t start = esp_timer_get_time();
+
+    jpeg_decode_obj.reader = reader;
+    ret = jpeg_decoder_prepare(dec, &decoder, &jpeg_decode_obj);
+    if (ret != JDR_OK) {
+        return NULL;
+    }
+
+    //Clip the window to the image
+    if (x < 0 || y < 0 || *w <= 0 || *h <= 0 || x >= decoder.width || y >= decoder.height) {
+        ESP_LOGE(TAG, "Image decoder: crop window out of the image");
+        return NULL;
+    }
+    if (x + *w > decoder.width) {
+        *w = decoder.width - x;
+    }
+    if (y + *h > decoder.height) {
+        *h = decoder.height - y;
+    }
+    jpeg_decode_obj.roi.left = x;
+    jpeg_decode_obj.roi.top = y;
+    jpeg_decode_obj.roi.right = x + *w - 1;
+    jpeg_decode_obj.roi.bottom = y + *h - 1;
+
+    size_t out_size = *w * *h * sizeof(uint16_t);
+    if (out_size > dec->out_size) {
+        free(dec->out);
+        dec->out = (uint8_t *)heap_caps_malloc(out_size, MALLOC_CAP_SPIRAM);
+        dec->out_size = dec->out ? out_size : 0;
+        if (!dec->out) {
+            ESP_LOGE(TAG, "Image decoder: output malloc failed");
+            return NULL;
+        }
+    }
+
+    jpeg_decode_obj.out = dec->out;
+    ret = jd_decomp_rect(&decoder, jpeg_decode_roi_out_callback, 0, &jpeg_decode_obj.roi);
+    if (ret != JDR_OK) {
+        ESP_LOGE(TAG, "Image decoder: jd_decode failed (%d)", ret);
+        return NULL;
+    }
+
+    jpeg_decoder_update_stats(dec, &decoder, start);
+    return dec->out;
+}
+
+//Finds the entropy coded data of every restart interval: offs[0] is the start of the scan, offs[i]
+//follows the RSTn marker ending interval i - 1. Returns the number of intervals, 0 if the data has
+//no scan, no EOI or a marker out of the RST0..RST7 sequence. Only the first max offsets are stored.
+//The sequence is checked here because no worker reads the marker between its run and the next one.
+static int jpeg_index_restarts(const uint8_t *jpeg, size_t len, uint32_t *offs, int max)
+{
+    size_t pos = 2;
+    int n = 0;
+
+    //Marker segments up to SOS
+    for (;;) {
+        if (pos + 4 > len || jpeg[pos] != 0xFF) {
+            return 0;
+        }
+        int marker = jpeg[pos + 1];
+        pos += 2 + ((jpeg[pos + 2] << 8) | jpeg[pos + 3]);
+        if (marker == 0xDA) {
+            break;
+        }
+    }
+
+    offs[n++] = pos;
+    for (; pos + 1 < len; pos++) {
+        if (jpeg[pos] != 0xFF) {
+            continue;
+        }
+        uint8_t marker = jpeg[pos + 1];
+        if (marker >= 0xD0 && marker <= 0xD7) {
+            if (marker != 0xD0 + (n - 1) % 8) {
+                return 0;
+            }
+            if (n < max) {
+                offs[n] = pos + 2;
+            }
+            n++;
+            pos++;
+        } else if (marker == 0xD9) {
+            return n;
+        } else if (marker == 0x00) {
+            pos++; //Stuffed byte
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    JDEC decoder;
+    jpeg_decode_obj_t obj;
+    char *work_buf;
+    int in_pos;     //First byte of the first restart interval
+    UINT mcu;       //MCUs to decode
+    UINT mcu_cnt;
+    int ret;
+    jpeg_port_thread_t thread;
+} jpeg_worker_t;
+
+static void jpeg_worker_run(void *arg)
+{
+    jpeg_worker_t *worker = (jpeg_worker_t *)arg;
+
+    //Every worker parses the headers into its own pool, only the output is shared
+    if (worker->work_buf) {
+        worker->ret = jd_prepare(&worker->decoder, jpeg_decode_in_callback, worker->work_buf, JPEG_WORK_BUF_SIZE, (void*)&worker->obj);
+        if (worker->ret != JDR_OK) {
+            return;
+        }
+    }
+    worker->obj.in_pos = worker->in_pos;
+    worker->ret = jd_decomp_seg(&worker->decoder, jpeg_decode_out_callback, 0, worker->mcu, worker->mcu_cnt);
+}
+
+uint8_t *jpeg_decoder_decode_parallel(jpeg_decoder_t *dec, uint8_t *jpeg, size_t len, int workers, int *w, int *h)
+{
+    jpeg_worker_t worker[JPEG_WORKER_MAX] = {0};
+    JDEC *decoder = &worker[0].decoder;
+    int ret = -1;
+    int64_t start = esp_timer_get_time();
+
+    worker[0].obj.in = jpeg;
+    worker[0].obj.in_len = len;
+    worker[0].obj.decoder = dec;
+    ret = jd_prepare(decoder, jpeg_decode_in_callback, dec->work_buf, JPEG_WORK_BUF_SIZE, (void*)&worker[0].obj);
+    if (ret != JDR_OK) {
+        ESP_LOGE(TAG, "Image decoder: jd_prepare failed (%d)", ret);
+        return NULL;
+    }
+
+    size_t out_size = decoder->width * decoder->height * sizeof(uint16_t);
+    if (out_size > dec->out_size) {
+        free(dec->out);
+        dec->out = (uint8_t *)heap_caps_malloc(out_size, MALLOC_CAP_SPIRAM);
+        dec->out_size = dec->out ? out_size : 0;
+        if (!dec->out) {
+            ESP_LOGE(TAG, "Image decoder: output malloc failed");
+            return NULL;
+        }
+    }
+    jpeg_output_init_packed(&worker[0].obj.output, dec->out, decoder->width, JPEG_PIXEL_FORMAT_RGB565_BE);
+
+    UINT mx = decoder->msx * 8;
+    UINT my = decoder->msy * 8;
+    UINT mcu_total = ((decoder->width + mx - 1) / mx) * ((decoder->height + my - 1) / my);
+    int intervals = decoder->nrst ? (mcu_total + decoder->nrst - 1) / decoder->nrst : 1;
+
+    if (workers <= 0) {
+        workers = JPEG_PORT_CORES;
+    }
+    if (workers > JPEG_WORKER_MAX) {
+        workers = JPEG_WORKER_MAX;
+    }
+    if (workers > intervals) {
+        workers = intervals;
+    }
+
+    //Without restart markers there is nothing to split
+    if (workers <= 1) {
+        ret = jd_decomp(decoder, jpeg_decode_out_callback, 0);
+        if (ret != JDR_OK) {
+            ESP_LOGE(TAG, "Image decoder: jd_decode failed (%d)", ret);
+            return NULL;
+        }
+        goto done;
+    }
+
+    if (intervals > dec->rst_max) {
+        free(dec->rst_offs);
+        dec->rst_offs = (uint32_t *)malloc(intervals * sizeof(uint32_t));
+        dec->rst_max = dec->rst_offs ? intervals : 0;
+        if (!dec->rst_offs) {
+            ESP_LOGE(TAG, "Image decoder: restart index malloc failed");
+            return NULL;
+        }
+    }
+    if (jpeg_index_restarts(jpeg, len, dec->rst_offs, intervals) != intervals) {
+        ESP_LOGE(TAG, "Image decoder: restart markers do not match the restart interval");
+        return NULL;
+    }
+
+    for (int i = 1; i < workers; i++) {
+        if (!dec->worker_buf[i]) {
+            dec->worker_buf[i] = (char *)heap_caps_malloc(JPEG_WORK_BUF_SIZE, MALLOC_CAP_SPIRAM);
+            if (!dec->worker_buf[i]) {
+                ESP_LOGE(TAG, "Image decoder: worker buffer malloc failed");
+                return NULL;
+            }
+        }
+    }
+
+    //Split the restart intervals evenly, each worker writes a disjoint run of MCUs into the output
+    for (int i = 0; i < workers; i++) {
+        int first = intervals * i / workers;
+        int last = intervals * (i + 1) / workers;
+        if (i) {
+            worker[i].obj = worker[0].obj;
+            worker[i].obj.in_pos = 0;
+            worker[i].work_buf = dec->worker_buf[i];
+        }
+        worker[i].in_pos = dec->rst_offs[first];
+        worker[i].mcu = first * decoder->nrst;
+        worker[i].mcu_cnt = (last == intervals ? mcu_total : last * decoder->nrst) - worker[i].mcu;
+    }
+
+    int started = 1;
+    for (; started < workers; started++) {
+        if (jpeg_port_thread_start(&worker[started].thread, jpeg_worker_run, &worker[started], started) != 0) {
+            break;
+        }
+    }
+    jpeg_worker_run(&worker[0]);
+    //Workers that did not start are run here
+    for (int i = started; i < workers; i++) {
+        jpeg_worker_run(&worker[i]);
+    }
+    for (int i = 1; i < started; i++) {
+        jpeg_port_thread_join(&worker[i].thread);
+    }
+
+    for (int i = 0; i < workers; i++) {
+        if (worker[i].ret != JDR_OK) {
+            ESP_LOGE(TAG, "Image decoder: jd_decode failed (%d) in worker %d", worker[i].ret, i);
+            return NULL;
+        }
+    }
+
+done:
+    *w = decoder->width;
+    *h = decoder->height;
+    jpeg_decoder_update_stats(dec, decoder, start);
+    return dec->out;
+}
+
+static esp_err_t jpeg_decoder_decode_band_obj(jpeg_decoder_t *dec, jpeg_decode_obj_t *jpeg_decode_obj)
+{
+    JDEC decoder = {0};
+    int ret = -1;
+    int64_t start = esp_timer_get_time();
+
+    ret = jpeg_decoder_prepare(dec, &decoder, jpeg_decode_obj);
+    if (ret != JDR_OK) {
+        return ESP_FAIL;
+    }
+
+    //One MCU row, 16 lines at most. DMA capable, so the LCD can send it in place
+    size_t band_size = decoder.width * decoder.msy * 8 * sizeof(uint16_t);
+    if (band_size > dec->band_size) {
+        for (int i = 0; i < 2; i++) {
+            free(dec->band_buf[i]);
+            dec->band_buf[i] = (uint8_t *)heap_caps_malloc(band_size, MALLOC_CAP_DMA);
+            if (!dec->band_buf[i]) {
+                dec->band_buf[i] = (uint8_t *)heap_caps_malloc(band_size, MALLOC_CAP_SPIRAM);
+            }
+        }
+        dec->band_size = band_size;
+        if (!dec->band_buf[0] || !dec->band_buf[1]) {
+            ESP_LOGE(TAG, "Image decoder: band malloc failed");
+            free(dec->band_buf[0]);
+            free(dec->band_buf[1]);
+            dec->band_buf[0] = dec->band_buf[1] = NULL;
+            dec->band_size = 0;
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    ret = jd_decomp(&decoder, jpeg_decode_band_out_callback, 0);
+    if (ret != JDR_OK) {
+        ESP_LOGE(TAG, "Image decoder: jd_decode failed (%d)", ret);
+        return ESP_FAIL;
+    }
+
+    jpeg_decoder_update_stats(dec, &decoder, start);
+    return ESP_OK;
+}
+
+esp_err_t jpeg_decoder_decode_band(jpeg_decoder_t *dec, const uint8_t *jpeg, size_t len, jpeg_band_cb_t cb, void *ctx)
+{
+    jpeg_reader_t reader;
+
+    jpeg_reader_init_mem(&reader, jpeg, len);
+    return jpeg_decoder_decode_band_ex(dec, &reader, cb, ctx);
+}
+
+esp_err_t jpeg_decoder_decode_band_ex(jpeg_decoder_t *dec, jpeg_reader_t *reader, jpeg_band_cb_t cb, void *ctx)
+{
+    jpeg_decode_obj_t jpeg_decode_obj = {0};
+
+    jpeg_decode_obj.reader = reader;
+    jpeg_decode_obj.band_cb = cb;
+    jpeg_decode_obj.band_ctx = ctx;
+    return jpeg_decoder_decode_band_obj(dec, &jpeg_decode_obj);
+}
+
+int64_t jpeg_decoder_get_decode_time(const jpeg_decoder_t *dec)
+{
+    return dec->decode_time;
+}
+
+void jpeg_decoder_get_stats(const jpeg_decoder_t *dec, jpeg_decoder_stats_t *stats)
+{
+    stats->decode_time = dec->decode_time;
+    stats->pool_used = dec->pool_used;
+    stats->pool_peak = dec->pool_peak;
+    memcpy(stats->stage_ticks, dec->stage_ticks, sizeof(stats->stage_ticks));
+}
+
+esp_err_t jpeg_decode_band(const uint8_t *jpeg, size_t len, jpeg_band_cb_t cb, void *ctx)
+{
+    if (!jpeg_default_decoder) {
+        jpeg_default_decoder = jpeg_decoder_create();
+        if (!jpeg_default_decoder) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    return jpeg_decoder_decode_band(jpeg_default_decoder, jpeg, len, cb, ctx);
+}
@@ -0,0 +1,578 @@
+#include <stdlib.h>
+#include <string.h>
+#include "jpeg_port.h"
+#include "jpeg_enc.h"
+
+static const char *TAG = "jpeg_enc";
+
+//Fixed-point constants of the AAN forward DCT, 14 fraction bits
+#define JPEG_ENC_FIX_BITS 14
+#define JPEG_ENC_FIX_0_382683433 6270
+#define JPEG_ENC_FIX_0_541196100 8867
+#define JPEG_ENC_FIX_0_707106781 11585
+#define JPEG_ENC_FIX_1_306562965 21407
+#define JPEG_ENC_MUL(v, c) (((v) * (c)) >> JPEG_ENC_FIX_BITS)
+#define JPEG_ENC_IN_BITS 2 //Extra fraction bits of the DCT input, keeps the truncation of JPEG_ENC_MUL below the quantization step at high quality
+
+struct jpeg_enc {
+    jpeg_enc_config_t config;
+    int bpp;                   //Bytes per input pixel
+    int comp_num;              //1 for gray, 3 for YCbCr
+    int mcu_w;                 //MCU size in pixels
+    int mcu_h;
+    int32_t qrecip[2][64];     //Quantization reciprocals with the DCT scale folded in, 16 fraction bits, natural order
+    uint8_t qtbl[2][64];       //Quantization tables as written to DQT, zigzag order
+    uint16_t huff_code[4][256];//Huffman codes of the DC luma, AC luma, DC chroma and AC chroma tables
+    uint8_t huff_size[4][256];
+    int dc_pred[3];
+    uint32_t bit_buf;          //Bits not written yet, the bit_cnt low bits are valid
+    int bit_cnt;
+    uint8_t *row_buf;          //Rows of an incomplete MCU row
+    int row_cnt;
+    int y;                     //Rows of the frame encoded or buffered
+    uint8_t out[JPEG_ENC_OUT_BUF_SIZE];
+    int out_len;
+    int error;                 //write_cb stopped encoding
+};
+
+//Natural order index of every zigzag position
+static const uint8_t jpeg_enc_zigzag[64] = {
+    0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+//Standard quantization tables (JPEG Annex K.1) for quality 50, natural order
+static const uint8_t jpeg_enc_std_qtbl[2][64] = {
+    {
+        16, 11, 10, 16,  24,  40,  51,  61,
+        12, 12, 14, 19,  26,  58,  60,  55,
+        14, 13, 16, 24,  40,  57,  69,  56,
+        14, 17, 22, 29,  51,  87,  80,  62,
+        18, 22, 37, 56,  68, 109, 103,  77,
+        24, 35, 55, 64,  81, 104, 113,  92,
+        49, 64, 78, 87, 103, 121, 120, 101,
+        72, 92, 95, 98, 112, 100, 103,  99
+    }, {
+        17, 18, 24, 47, 99, 99, 99, 99,
+        18, 21, 26, 66, 99, 99, 99, 99,
+        24, 26, 56, 99, 99, 99, 99, 99,
+        47, 66, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99
+    }
+};
+
+//Scale factors of the AAN DCT outputs, cos(k * pi / 16) * sqrt(2) but 1 for k = 0
+static const float jpeg_enc_aan_scale[8] = {
+    1.0f, 1.387039845f, 1.306562965f, 1.175875602f, 1.0f, 0.785694958f, 0.541196100f, 0.275899379f
+};
+
+//Standard Huffman tables (JPEG Annex K.3): code count of every length 1 - 16, then the symbols
+static const uint8_t jpeg_enc_dc_luma_bits[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t jpeg_enc_dc_chroma_bits[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+static const uint8_t jpeg_enc_dc_vals[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+static const uint8_t jpeg_enc_ac_luma_bits[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+static const uint8_t jpeg_enc_ac_luma_vals[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+static const uint8_t jpeg_enc_ac_chroma_bits[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+static const uint8_t jpeg_enc_ac_chroma_vals[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+static const uint8_t *const jpeg_enc_huff_bits[4] = {
+    jpeg_enc_dc_luma_bits, jpeg_enc_ac_luma_bits, jpeg_enc_dc_chroma_bits, jpeg_enc_ac_chroma_bits
+};
+static const uint8_t *const jpeg_enc_huff_vals[4] = {
+    jpeg_enc_dc_vals, jpeg_enc_ac_luma_vals, jpeg_enc_dc_vals, jpeg_enc_ac_chroma_vals
+};
+
+static void jpeg_enc_flush(jpeg_enc_t *enc)
+{
+    if (enc->out_len && !enc->error) {
+        enc->error = enc->config.write_cb(enc->config.write_ctx, enc->out, enc->out_len) != 0;
+    }
+    enc->out_len = 0;
+}
+
+static inline void jpeg_enc_put(jpeg_enc_t *enc, uint8_t c)
+{
+    if (enc->out_len == JPEG_ENC_OUT_BUF_SIZE) {
+        jpeg_enc_flush(enc);
+    }
+    enc->out[enc->out_len++] = c;
+}
+
+static void jpeg_enc_put_word(jpeg_enc_t *enc, uint16_t w)
+{
+    jpeg_enc_put(enc, w >> 8);
+    jpeg_enc_put(enc, w & 0xFF);
+}
+
+//Appends size bits to the entropy coded data, a 0xFF byte is followed by a stuffed 0x00
+static inline void jpeg_enc_bits(jpeg_enc_t *enc, uint32_t code, int size)
+{
+    enc->bit_buf = (enc->bit_buf << size) | (code & ((1U << size) - 1));
+    enc->bit_cnt += size;
+    while (enc->bit_cnt >= 8) {
+        uint8_t c = enc->bit_buf >> (enc->bit_cnt - 8);
+        enc->bit_cnt -= 8;
+        jpeg_enc_put(enc, c);
+        if (c == 0xFF) {
+            jpeg_enc_put(enc, 0);
+        }
+    }
+}
+
+//Huffman codes of a table from its code counts, JPEG Annex C
+static void jpeg_enc_huff_build(const uint8_t *bits, const uint8_t *vals, uint16_t *code, uint8_t *size)
+{
+    uint16_t c = 0;
+    int k = 0;
+
+    for (int len = 1; len <= 16; len++) {
+        for (int i = 0; i < bits[len - 1]; i++) {
+            code[vals[k]] = c++;
+            size[vals[k]] = len;
+            k++;
+        }
+        c <<= 1;
+    }
+}
+
+//libjpeg quality scaling of the standard tables, and the divisors of the AAN DCT output
+static void jpeg_enc_quant_build(jpeg_enc_t *enc, int quality)
+{
+    int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+
+    for (int t = 0; t < 2; t++) {
+        for (int k = 0; k < 64; k++) {
+            int n = jpeg_enc_zigzag[k];
+            int q = (jpeg_enc_std_qtbl[t][n] * scale + 50) / 100;
+            q = q < 1 ? 1 : (q > 255 ? 255 : q);
+            enc->qtbl[t][k] = q;
+            float div = q * jpeg_enc_aan_scale[n >> 3] * jpeg_enc_aan_scale[n & 7] * (8 << JPEG_ENC_IN_BITS);
+            enc->qrecip[t][n] = (int32_t)(65536.0f / div + 0.5f);
+        }
+    }
+}
+
+//AAN forward DCT in place, the outputs are scaled by 8 and jpeg_enc_aan_scale of their row and column
+static void jpeg_enc_fdct(int32_t *data)
+{
+    int32_t tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+    int32_t tmp10, tmp11, tmp12, tmp13, z1, z2, z3, z4, z5, z11, z13;
+    int32_t *p;
+
+    for (int pass = 0; pass < 2; pass++) {
+        //Rows in the first pass, columns in the second
+        int step = pass ? 8 : 1;
+        int next = pass ? 1 : 8;
+        p = data;
+        for (int i = 0; i < 8; i++, p += next) {
+            tmp0 = p[0 * step] + p[7 * step];
+            tmp7 = p[0 * step] - p[7 * step];
+            tmp1 = p[1 * step] + p[6 * step];
+            tmp6 = p[1 * step] - p[6 * step];
+            tmp2 = p[2 * step] + p[5 * step];
+            tmp5 = p[2 * step] - p[5 * step];
+            tmp3 = p[3 * step] + p[4 * step];
+            tmp4 = p[3 * step] - p[4 * step];
+
+            //Even part
+            tmp10 = tmp0 + tmp3;
+            tmp13 = tmp0 - tmp3;
+            tmp11 = tmp1 + tmp2;
+            tmp12 = tmp1 - tmp2;
+            p[0 * step] = tmp10 + tmp11;
+            p[4 * step] = tmp10 - tmp11;
+            z1 = JPEG_ENC_MUL(tmp12 + tmp13, JPEG_ENC_FIX_0_707106781);
+            p[2 * step] = tmp13 + z1;
+            p[6 * step] = tmp13 - z1;
+
+            //Odd part
+            tmp10 = tmp4 + tmp5;
+            tmp11 = tmp5 + tmp6;
+            tmp12 = tmp6 + tmp7;
+            z5 = JPEG_ENC_MUL(tmp10 - tmp12, JPEG_ENC_FIX_0_382683433);
+            z2 = JPEG_ENC_MUL(tmp10, JPEG_ENC_FIX_0_541196100) + z5;
+            z4 = JPEG_ENC_MUL(tmp12, JPEG_ENC_FIX_1_306562965) + z5;
+            z3 = JPEG_ENC_MUL(tmp11, JPEG_ENC_FIX_0_707106781);
+            z11 = tmp7 + z3;
+            z13 = tmp7 - z3;
+            p[5 * step] = z13 + z2;
+            p[3 * step] = z13 - z2;
+            p[1 * step] = z11 + z4;
+            p[7 * step] = z11 - z4;
+        }
+    }
+}
+
+//Number of bits of a magnitude category
+static inline int jpeg_enc_nbits(int v)
+{
+    return v ? 32 - __builtin_clz(v) : 0;
+}
+
+//DCT, quantization and Huffman coding of one level shifted block
+static void jpeg_enc_block(jpeg_enc_t *enc, int32_t *data, int comp)
+{
+    const int32_t *qrecip = enc->qrecip[comp ? 1 : 0];
+    const uint16_t *dc_code = enc->huff_code[comp ? 2 : 0];
+    const uint8_t *dc_size = enc->huff_size[comp ? 2 : 0];
+    const uint16_t *ac_code = enc->huff_code[comp ? 3 : 1];
+    const uint8_t *ac_size = enc->huff_size[comp ? 3 : 1];
+    int coef[64];
+
+    for (int k = 0; k < 64; k++) {
+        data[k] *= 1 << JPEG_ENC_IN_BITS;
+    }
+    jpeg_enc_fdct(data);
+    for (int k = 0; k < 64; k++) {
+        int n = jpeg_enc_zigzag[k];
+        int32_t v = data[n];
+        int32_t a = ((v < 0 ? -v : v) * qrecip[n] + 32768) >> 16;
+        int32_t max = k ? 1023 : 2047; //Largest AC and DC magnitude of 8-bit baseline, rounding may overshoot at quality 100
+        a = a > max ? max : a;
+        coef[k] = v < 0 ? -a : a;
+    }
+
+    int diff = coef[0] - enc->dc_pred[comp];
+    enc->dc_pred[comp] = coef[0];
+    int nbits = jpeg_enc_nbits(diff < 0 ? -diff : diff);
+    jpeg_enc_bits(enc, dc_code[nbits], dc_size[nbits]);
+    if (nbits) {
+        jpeg_enc_bits(enc, diff < 0 ? diff - 1 : diff, nbits);
+    }
+
+    int run = 0;
+    for (int k = 1; k < 64; k++) {
+        int v = coef[k];
+        if (!v) {
+            run++;
+            continue;
+        }
+        while (run > 15) {
+            jpeg_enc_bits(enc, ac_code[0xF0], ac_size[0xF0]); //ZRL, 16 zeros
+            run -= 16;
+        }
+        nbits = jpeg_enc_nbits(v < 0 ? -v : v);
+        jpeg_enc_bits(enc, ac_code[(run << 4) | nbits], ac_size[(run << 4) | nbits]);
+        jpeg_enc_bits(enc, v < 0 ? v - 1 : v, nbits);
+        run = 0;
+    }
+    if (run) {
+        jpeg_enc_bits(enc, ac_code[0x00], ac_size[0x00]); //EOB
+    }
+}
+
+//Converts cnt pixels of a row to Y, Cb and Cr in 0 - 255. Pixels past the right edge repeat the last one
+static void jpeg_enc_load_row(const jpeg_enc_t *enc, const uint8_t *row, int x, int cnt, int *py, int *pcb, int *pcr)
+{
+    int width = enc->config.width;
+
+    for (int i = 0; i < cnt; i++) {
+        int px = x + i < width ? x + i : width - 1;
+        const uint8_t *p = row + px * enc->bpp;
+        int r, g, b;
+        uint16_t v;
+
+        switch (enc->config.format) {
+        case JPEG_PIXEL_FORMAT_GRAY8:
+            py[i] = p[0];
+            continue;
+        case JPEG_PIXEL_FORMAT_RGB888:
+            r = p[0];
+            g = p[1];
+            b = p[2];
+            break;
+        default:
+            v = enc->config.format == JPEG_PIXEL_FORMAT_RGB565_LE ? (p[0] | (p[1] << 8)) : ((p[0] << 8) | p[1]);
+            r = ((v >> 8) & 0xF8) | (v >> 13);
+            g = ((v >> 3) & 0xFC) | ((v >> 9) & 0x03);
+            b = ((v << 3) & 0xF8) | ((v >> 2) & 0x07);
+            break;
+        }
+        py[i] = (19595 * r + 38470 * g + 7471 * b + 32768) >> 16;
+        pcb[i] = (-11059 * r - 21709 * g + 32768 * b + (128 << 16) + 32767) >> 16;
+        pcr[i] = (32768 * r - 27439 * g - 5329 * b + (128 << 16) + 32767) >> 16;
+    }
+}
+
+//Encodes one MCU row from rows of pixels at src, the last row is repeated down to the MCU height
+static void jpeg_enc_mcu_row(jpeg_enc_t *enc, const uint8_t *src, int rows, int stride)
+{
+    int32_t y_blk[4][64];
+    int32_t cb_blk[64];
+    int32_t cr_blk[64];
+    int py[16], pcb[16], pcr[16];
+    int sub = enc->mcu_w == 16; //4:2:0
+
+    for (int mx = 0; mx < enc->config.width; mx += enc->mcu_w) {
+        if (sub) {
+            memset(cb_blk, 0, sizeof(cb_blk));
+            memset(cr_blk, 0, sizeof(cr_blk));
+        }
+        for (int y = 0; y < enc->mcu_h; y++) {
+            const uint8_t *row = src + (y < rows ? y : rows - 1) * stride;
+            jpeg_enc_load_row(enc, row, mx, enc->mcu_w, py, pcb, pcr);
+            for (int x = 0; x < enc->mcu_w; x++) {
+                y_blk[(y >> 3) * 2 + (x >> 3)][(y & 7) * 8 + (x & 7)] = py[x] - 128;
+            }
+            if (enc->comp_num == 1) {
+                continue;
+            }
+            if (sub) {
+                for (int x = 0; x < 16; x++) {
+                    cb_blk[(y >> 1) * 8 + (x >> 1)] += pcb[x];
+                    cr_blk[(y >> 1) * 8 + (x >> 1)] += pcr[x];
+                }
+            } else {
+                for (int x = 0; x < 8; x++) {
+                    cb_blk[y * 8 + x] = pcb[x] - 128;
+                    cr_blk[y * 8 + x] = pcr[x] - 128;
+                }
+            }
+        }
+
+        if (sub) {
+            jpeg_enc_block(enc, y_blk[0], 0);
+            jpeg_enc_block(enc, y_blk[1], 0);
+            jpeg_enc_block(enc, y_blk[2], 0);
+            jpeg_enc_block(enc, y_blk[3], 0);
+            for (int i = 0; i < 64; i++) {
+                cb_blk[i] = ((cb_blk[i] + 2) >> 2) - 128;
+                cr_blk[i] = ((cr_blk[i] + 2) >> 2) - 128;
+            }
+        } else {
+            jpeg_enc_block(enc, y_blk[0], 0);
+        }
+        if (enc->comp_num == 3) {
+            jpeg_enc_block(enc, cb_blk, 1);
+            jpeg_enc_block(enc, cr_blk, 2);
+        }
+    }
+}
+
+jpeg_enc_t *jpeg_enc_create(const jpeg_enc_config_t *config)
+{
+    if (config->width <= 0 || config->height <= 0 || config->width > 65535 || config->height > 65535 || !config->write_cb) {
+        ESP_LOGE(TAG, "Invalid config");
+        return NULL;
+    }
+
+    jpeg_enc_t *enc = (jpeg_enc_t *)heap_caps_calloc(1, sizeof(jpeg_enc_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!enc) {
+        ESP_LOGE(TAG, "Encoder malloc failed");
+        return NULL;
+    }
+
+    enc->config = *config;
+    enc->config.quality = config->quality < 1 ? 1 : (config->quality > 100 ? 100 : config->quality);
+    switch (config->format) {
+    case JPEG_PIXEL_FORMAT_GRAY8:
+        enc->bpp = 1;
+        break;
+    case JPEG_PIXEL_FORMAT_RGB888:
+        enc->bpp = 3;
+        break;
+    default:
+        enc->bpp = 2;
+        break;
+    }
+    enc->comp_num = config->format == JPEG_PIXEL_FORMAT_GRAY8 ? 1 : 3;
+    enc->mcu_w = enc->mcu_h = (enc->comp_num == 3 && config->subsample == JPEG_ENC_SUBSAMPLE_420) ? 16 : 8;
+
+    enc->row_buf = (uint8_t *)heap_caps_malloc(enc->mcu_h * config->width * enc->bpp, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!enc->row_buf) {
+        ESP_LOGE(TAG, "Row buffer malloc failed");
+        free(enc);
+        return NULL;
+    }
+
+    jpeg_enc_quant_build(enc, enc->config.quality);
+    for (int i = 0; i < 4; i++) {
+        jpeg_enc_huff_build(jpeg_enc_huff_bits[i], jpeg_enc_huff_vals[i], enc->huff_code[i], enc->huff_size[i]);
+    }
+    return enc;
+}
+
+void jpeg_enc_delete(jpeg_enc_t *enc)
+{
+    if (!enc) {
+        return;
+    }
+
+    free(enc->row_buf);
+    free(enc);
+}
+
+esp_err_t jpeg_enc_start(jpeg_enc_t *enc)
+{
+    static const uint8_t jfif[14] = {'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0};
+    int tbl_num = enc->comp_num == 3 ? 2 : 1;
+
+    enc->out_len = 0;
+    enc->error = 0;
+    enc->bit_buf = 0;
+    enc->bit_cnt = 0;
+    enc->row_cnt = 0;
+    enc->y = 0;
+    memset(enc->dc_pred, 0, sizeof(enc->dc_pred));
+
+    jpeg_enc_put_word(enc, 0xFFD8); //SOI
+
+    jpeg_enc_put_word(enc, 0xFFE0); //APP0, JFIF 1.1 without thumbnail
+    jpeg_enc_put_word(enc, 2 + sizeof(jfif));
+    for (int i = 0; i < sizeof(jfif); i++) {
+        jpeg_enc_put(enc, jfif[i]);
+    }
+
+    jpeg_enc_put_word(enc, 0xFFDB); //DQT
+    jpeg_enc_put_word(enc, 2 + tbl_num * 65);
+    for (int t = 0; t < tbl_num; t++) {
+        jpeg_enc_put(enc, t);
+        for (int k = 0; k < 64; k++) {
+            jpeg_enc_put(enc, enc->qtbl[t][k]);
+        }
+    }
+
+    jpeg_enc_put_word(enc, 0xFFC0); //SOF0
+    jpeg_enc_put_word(enc, 8 + 3 * enc->comp_num);
+    jpeg_enc_put(enc, 8);
+    jpeg_enc_put_word(enc, enc->config.height);
+    jpeg_enc_put_word(enc, enc->config.width);
+    jpeg_enc_put(enc, enc->comp_num);
+    for (int c = 0; c < enc->comp_num; c++) {
+        jpeg_enc_put(enc, c + 1);
+        jpeg_enc_put(enc, c ? 0x11 : (enc->mcu_w == 16 ? 0x22 : 0x11)); //Sampling factors
+        jpeg_enc_put(enc, c ? 1 : 0);                                   //Quantization table
+    }
+
+    jpeg_enc_put_word(enc, 0xFFC4); //DHT
+    int len = 2;
+    for (int i = 0; i < tbl_num * 2; i++) {
+        len += 17 + (i & 1 ? 162 : 12);
+    }
+    jpeg_enc_put_word(enc, len);
+    for (int i = 0; i < tbl_num * 2; i++) {
+        jpeg_enc_put(enc, ((i & 1) << 4) | (i >> 1)); //Class and ID
+        for (int l = 0; l < 16; l++) {
+            jpeg_enc_put(enc, jpeg_enc_huff_bits[i][l]);
+        }
+        for (int k = 0; k < (i & 1 ? 162 : 12); k++) {
+            jpeg_enc_put(enc, jpeg_enc_huff_vals[i][k]);
+        }
+    }
+
+    jpeg_enc_put_word(enc, 0xFFDA); //SOS
+    jpeg_enc_put_word(enc, 6 + 2 * enc->comp_num);
+    jpeg_enc_put(enc, enc->comp_num);
+    for (int c = 0; c < enc->comp_num; c++) {
+        jpeg_enc_put(enc, c + 1);
+        jpeg_enc_put(enc, c ? 0x11 : 0x00); //DC and AC table
+    }
+    jpeg_enc_put(enc, 0);
+    jpeg_enc_put(enc, 63);
+    jpeg_enc_put(enc, 0);
+
+    return enc->error ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t jpeg_enc_write_rows(jpeg_enc_t *enc, const uint8_t *data, int rows, int stride)
+{
+    int row_size = enc->config.width * enc->bpp;
+
+    if (rows < 0 || enc->y + rows > enc->config.height) {
+        ESP_LOGE(TAG, "More rows than the frame has");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    while (rows > 0 && !enc->error) {
+        //Whole MCU rows are encoded in place
+        if (!enc->row_cnt && rows >= enc->mcu_h) {
+            jpeg_enc_mcu_row(enc, data, enc->mcu_h, stride);
+            data += enc->mcu_h * stride;
+            rows -= enc->mcu_h;
+            enc->y += enc->mcu_h;
+            continue;
+        }
+
+        int n = enc->mcu_h - enc->row_cnt;
+        n = n < rows ? n : rows;
+        for (int i = 0; i < n; i++) {
+            memcpy(enc->row_buf + (enc->row_cnt + i) * row_size, data + i * stride, row_size);
+        }
+        data += n * stride;
+        rows -= n;
+        enc->row_cnt += n;
+        enc->y += n;
+        if (enc->row_cnt == enc->mcu_h) {
+            jpeg_enc_mcu_row(enc, enc->row_buf, enc->mcu_h, row_size);
+            enc->row_cnt = 0;
+        }
+    }
+    return enc->error ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t jpeg_enc_finish(jpeg_enc_t *enc)
+{
+    if (enc->y != enc->config.height) {
+        ESP_LOGE(TAG, "Frame incomplete, %d of %d rows", enc->y, enc->config.height);
+        return ESP_FAIL;
+    }
+
+    //The bottom MCU row is shorter if the height is not a multiple of the MCU height
+    if (enc->row_cnt) {
+        jpeg_enc_mcu_row(enc, enc->row_buf, enc->row_cnt, enc->config.width * enc->bpp);
+        enc->row_cnt = 0;
+    }
+
+    //Pad the last byte with ones
+    if (enc->bit_cnt) {
+        jpeg_enc_bits(enc, 0x7F, 8 - enc->bit_cnt);
+    }
+    jpeg_enc_put_word(enc, 0xFFD9); //EOI
+    jpeg_enc_flush(enc);
+
+    return enc->error ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t jpeg_enc_encode(jpeg_enc_t *enc, const uint8_t *image, int stride)
+{
+    esp_err_t ret = jpeg_enc_start(enc);
+
+    if (ret == ESP_OK) {
+        ret = jpeg_enc_write_rows(enc, image, enc->config.height, stride);
+    }
+    if (ret == ESP_OK) {
+        ret = jpeg_enc_finish(enc);
+    }
+    return ret;
+}
@@ -0,0 +1,43 @@
+#pragma once
+//Helpers of the host benchmarks. Build them without the sanitizers for meaningful numbers:
+//
+//  cmake -S test/host -B build/bench -DHOST_TEST_SANITIZE=OFF && cmake --build build/bench
+//
+//ctest runs every benchmark with a couple of iterations only, to keep them building and working.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "host_test.h"
+#include "jpeg_port.h"
+
+#define BENCH_IMAGE_FILE TEST_EXAMPLES_DIR "/lcd/spiffs_image/image.jpg"
+
+static inline uint8_t *bench_file_load(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+
+    HOST_CHECK(f);
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    rewind(f);
+    uint8_t *data = malloc(*len);
+    HOST_CHECK(data && fread(data, 1, *len, f) == *len);
+    fclose(f);
+    return data;
+}
+
+//Iterations from the first argument, the default otherwise
+static inline int bench_iterations(int argc, char **argv, int def)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : def;
+
+    return iterations > 0 ? iterations : def;
+}
+
+//Prints a result line, us per run and the throughput in MB/s of the jpeg data and Mpixel/s of the image
+static inline void bench_report(const char *name, int64_t time, int iterations, size_t jpeg_len, int pixels)
+{
+    double run = (double)time / iterations;
+
+    printf("  %-36s %9.1f us %8.2f MB/s %8.2f Mpix/s\n", name, run, jpeg_len / run, pixels / run);
+}
@@ -0,0 +1,131 @@
+//Decode benchmark of the RGB565 output path on examples/lcd/spiffs_image: tjpgd emitting big-endian RGB565 with
+//one memcpy per MCU row (the jpeg component), against the native RGB565 output swapped pixel by pixel into the
+//frame, the output function jpeg.c had before. Both must give the same pixels.
+
+#include <string.h>
+#include "bench.h"
+#include "jpeg.h"
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    size_t pos;
+    uint8_t *out;
+    int width;
+} bench_obj_t;
+
+static UINT bench_in(JDEC *decoder, BYTE *buf, UINT len)
+{
+    bench_obj_t *obj = (bench_obj_t *)decoder->device;
+
+    if (len > obj->len - obj->pos) {
+        len = obj->len - obj->pos;
+    }
+    if (buf) {
+        memcpy(buf, obj->data + obj->pos, len);
+    }
+    obj->pos += len;
+    return len;
+}
+
+//The former output function: index computed and bytes swapped for every pixel
+static UINT bench_out_swap(JDEC *decoder, void *bitmap, JRECT *rect)
+{
+    bench_obj_t *obj = (bench_obj_t *)decoder->device;
+    uint8_t *in = (uint8_t *)bitmap;
+
+    for (int y = rect->top; y <= rect->bottom; y++) {
+        for (int x = rect->left; x <= rect->right; x++) {
+            obj->out[2 * (y * obj->width + x)] = in[1];
+            obj->out[2 * (y * obj->width + x) + 1] = in[0];
+            in += 2;
+        }
+    }
+    return 1;
+}
+
+//The output function of jpeg.c, tjpgd has the LCD byte order already
+static UINT bench_out_rows(JDEC *decoder, void *bitmap, JRECT *rect)
+{
+    bench_obj_t *obj = (bench_obj_t *)decoder->device;
+    int row_size = 2 * (rect->right - rect->left + 1);
+    uint8_t *in = (uint8_t *)bitmap;
+
+    for (int y = rect->top; y <= rect->bottom; y++) {
+        memcpy(obj->out + 2 * (y * obj->width + rect->left), in, row_size);
+        in += row_size;
+    }
+    return 1;
+}
+
+static int64_t bench_tjpgd(const uint8_t *data, size_t len, uint8_t *out, int format, UINT (*outfunc)(JDEC *, void *, JRECT *), int iterations)
+{
+    static uint8_t work[JPEG_WORK_BUF_SIZE];
+    int64_t start = esp_timer_get_time();
+
+    for (int i = 0; i < iterations; i++) {
+        bench_obj_t obj = {.data = data, .len = len, .out = out};
+        JDEC decoder;
+
+        HOST_CHECK(jd_prepare(&decoder, bench_in, work, sizeof(work), &obj) == JDR_OK);
+        decoder.format = format;
+        obj.width = decoder.width;
+        HOST_CHECK(jd_decomp(&decoder, outfunc, 0) == JDR_OK);
+    }
+    return esp_timer_get_time() - start;
+}
+
+static int bench_band(void *ctx, int y, int w, int h, uint8_t *data)
+{
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = bench_iterations(argc, argv, 500);
+    jpeg_decoder_t *dec = jpeg_decoder_create();
+    size_t len;
+    uint8_t *data = bench_file_load(BENCH_IMAGE_FILE, &len);
+    int w, h;
+    int64_t start, time;
+
+    jpeg_reader_t reader;
+
+    jpeg_reader_init_mem(&reader, data, len);
+    HOST_CHECK(dec && jpeg_decode_ex(dec, &reader, &w, &h));
+    uint8_t *swapped = malloc(w * h * 2);
+    uint8_t *rows = malloc(w * h * 2);
+    HOST_CHECK(swapped && rows);
+    printf("%s: %dx%d, %zu bytes, %d iterations\n", BENCH_IMAGE_FILE, w, h, len, iterations);
+
+    time = bench_tjpgd(data, len, swapped, 1, bench_out_swap, iterations);
+    bench_report("tjpgd, per pixel swap", time, iterations, len, w * h);
+    int64_t swap_time = time;
+
+    time = bench_tjpgd(data, len, rows, 2, bench_out_rows, iterations);
+    bench_report("tjpgd big-endian, row memcpy", time, iterations, len, w * h);
+    HOST_CHECK(memcmp(swapped, rows, w * h * 2) == 0);
+    printf("  row memcpy is x%.2f the per pixel swap\n", (double)swap_time / time);
+
+    uint8_t *out = NULL;
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        jpeg_reader_init_mem(&reader, data, len);
+        out = jpeg_decode_ex(dec, &reader, &w, &h);
+    }
+    bench_report("jpeg_decode_ex", esp_timer_get_time() - start, iterations, len, w * h);
+    HOST_CHECK(out && memcmp(out, rows, w * h * 2) == 0);
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        jpeg_reader_init_mem(&reader, data, len);
+        HOST_CHECK(jpeg_decoder_decode_band_ex(dec, &reader, bench_band, NULL) == ESP_OK);
+    }
+    bench_report("jpeg_decoder_decode_band_ex", esp_timer_get_time() - start, iterations, len, w * h);
+
+    free(rows);
+    free(swapped);
+    free(data);
+    jpeg_decoder_delete(dec);
+    return 0;
+}
@@ -0,0 +1,142 @@
+//Encoder benchmark at QVGA: frames per second of jpeg_enc on the decoded spiffs_image, a camera like RGB565
+//frame, fed whole and in bands of rows that do not line up with the MCUs, as cam_take chunks come in.
+//Both inputs must give the same jpeg, and the jpeg decoded again must stay close to the frame.
+
+#include <math.h>
+#include <string.h>
+#include "bench.h"
+#include "jpeg.h"
+#include "jpeg_enc.h"
+
+#define BENCH_BAND_ROWS 10 //Rows of a 6400 byte chunk of a QVGA RGB565 frame
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t size;
+} bench_sink_t;
+
+static int bench_write(void *ctx, const uint8_t *data, size_t len)
+{
+    bench_sink_t *sink = (bench_sink_t *)ctx;
+
+    if (sink->len + len > sink->size) {
+        return -1;
+    }
+    memcpy(sink->data + sink->len, data, len);
+    sink->len += len;
+    return 0;
+}
+
+static void bench_encode_band(jpeg_enc_t *enc, const uint8_t *frame, int w, int h)
+{
+    HOST_CHECK(jpeg_enc_start(enc) == ESP_OK);
+    for (int y = 0; y < h; y += BENCH_BAND_ROWS) {
+        int rows = h - y < BENCH_BAND_ROWS ? h - y : BENCH_BAND_ROWS;
+
+        HOST_CHECK(jpeg_enc_write_rows(enc, frame + y * w * 2, rows, w * 2) == ESP_OK);
+    }
+    HOST_CHECK(jpeg_enc_finish(enc) == ESP_OK);
+}
+
+//PSNR of an RGB565 image to another, over the 5/6/5 bit channels scaled to 8 bits
+static double bench_psnr(const uint8_t *a, const uint8_t *b, int pixels)
+{
+    double error = 0;
+
+    for (int i = 0; i < pixels; i++) {
+        uint16_t va = a[2 * i] << 8 | a[2 * i + 1];
+        uint16_t vb = b[2 * i] << 8 | b[2 * i + 1];
+        int dr = ((va >> 11) - (vb >> 11)) * 8;
+        int dg = (((va >> 5) & 0x3F) - ((vb >> 5) & 0x3F)) * 4;
+        int db = ((va & 0x1F) - (vb & 0x1F)) * 8;
+
+        error += dr * dr + dg * dg + db * db;
+    }
+    return error ? 10 * log10(255.0 * 255.0 * 3 * pixels / error) : 99.0;
+}
+
+int main(int argc, char **argv)
+{
+    static const struct {
+        const char *name;
+        jpeg_enc_subsample_t subsample;
+        uint8_t quality;
+    } cases[] = {
+        {"4:2:0 q60", JPEG_ENC_SUBSAMPLE_420, 60},
+        {"4:2:0 q80", JPEG_ENC_SUBSAMPLE_420, 80},
+        {"4:4:4 q80", JPEG_ENC_SUBSAMPLE_444, 80},
+        {"4:2:0 q95", JPEG_ENC_SUBSAMPLE_420, 95},
+    };
+    int iterations = bench_iterations(argc, argv, 200);
+    jpeg_decoder_t *dec = jpeg_decoder_create();
+    jpeg_reader_t reader;
+    size_t len;
+    uint8_t *data = bench_file_load(BENCH_IMAGE_FILE, &len);
+    int w, h;
+
+    HOST_CHECK(dec);
+    jpeg_reader_init_mem(&reader, data, len);
+    uint8_t *decoded = jpeg_decode_ex(dec, &reader, &w, &h);
+    HOST_CHECK(decoded && w == 320 && h == 240);
+    uint8_t *frame = malloc(w * h * 2);
+    HOST_CHECK(frame);
+    memcpy(frame, decoded, w * h * 2);
+    free(data);
+
+    bench_sink_t whole = {.data = malloc(w * h * 2), .size = w * h * 2};
+    bench_sink_t band = {.data = malloc(w * h * 2), .size = w * h * 2};
+    HOST_CHECK(whole.data && band.data);
+    printf("QVGA RGB565 frame from %s, %d iterations\n", BENCH_IMAGE_FILE, iterations);
+
+    for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        jpeg_enc_config_t config = {
+            .width = w,
+            .height = h,
+            .format = JPEG_PIXEL_FORMAT_RGB565_BE,
+            .quality = cases[i].quality,
+            .subsample = cases[i].subsample,
+            .write_cb = bench_write,
+        };
+        int64_t start, time;
+
+        config.write_ctx = &whole;
+        jpeg_enc_t *enc = jpeg_enc_create(&config);
+        HOST_CHECK(enc);
+        start = esp_timer_get_time();
+        for (int n = 0; n < iterations; n++) {
+            whole.len = 0;
+            HOST_CHECK(jpeg_enc_encode(enc, frame, w * 2) == ESP_OK);
+        }
+        time = esp_timer_get_time() - start;
+        jpeg_enc_delete(enc);
+
+        config.write_ctx = &band;
+        enc = jpeg_enc_create(&config);
+        HOST_CHECK(enc);
+        start = esp_timer_get_time();
+        for (int n = 0; n < iterations; n++) {
+            band.len = 0;
+            bench_encode_band(enc, frame, w, h);
+        }
+        int64_t band_time = esp_timer_get_time() - start;
+        jpeg_enc_delete(enc);
+        HOST_CHECK(band.len == whole.len && memcmp(band.data, whole.data, whole.len) == 0);
+
+        jpeg_reader_init_mem(&reader, whole.data, whole.len);
+        decoded = jpeg_decode_ex(dec, &reader, &w, &h);
+        HOST_CHECK(decoded);
+        double psnr = bench_psnr(frame, decoded, w * h);
+
+        printf("  %-10s %6zu bytes, %.1f dB: whole frame %7.1f us %6.0f fps, %d row bands %7.1f us %6.0f fps\n",
+               cases[i].name, whole.len, psnr, (double)time / iterations, 1e6 * iterations / time,
+               BENCH_BAND_ROWS, (double)band_time / iterations, 1e6 * iterations / band_time);
+        HOST_CHECK(psnr > 24.0);
+    }
+
+    free(band.data);
+    free(whole.data);
+    free(frame);
+    jpeg_decoder_delete(dec);
+    return 0;
+}
@@ -0,0 +1,81 @@
+//Luma only decode benchmark: jpeg_decode_gray against the RGB565 decode of jpeg_decode_ex on the same images.
+//The gray pixels must also be the luminance of the color ones, up to the RGB565 rounding.
+
+#include <string.h>
+#include "bench.h"
+#include "jpeg.h"
+
+static const char *const bench_images[] = {
+    BENCH_IMAGE_FILE,
+    TEST_CORPUS_DIR "/yuv420_72x40.jpg",
+    TEST_CORPUS_DIR "/yuv444_40x30.jpg",
+};
+
+//Mean absolute difference of the gray image to the BT.601 luminance of the RGB565 one
+static double bench_luma_error(const uint8_t *gray, const uint8_t *rgb565, int pixels)
+{
+    int64_t error = 0;
+
+    for (int i = 0; i < pixels; i++) {
+        uint16_t v = rgb565[2 * i] << 8 | rgb565[2 * i + 1];
+        int r = v >> 11, g = (v >> 5) & 0x3F, b = v & 0x1F;
+        int y;
+
+        r = r << 3 | r >> 2; //Back to 8 bits, the low bits repeat the high ones
+        g = g << 2 | g >> 4;
+        b = b << 3 | b >> 2;
+        y = (77 * r + 150 * g + 29 * b) >> 8;
+
+        error += abs(y - gray[i]);
+    }
+    return (double)error / pixels;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = bench_iterations(argc, argv, 500);
+    jpeg_decoder_t *dec = jpeg_decoder_create();
+
+    HOST_CHECK(dec);
+    printf("%d iterations\n", iterations);
+    for (int i = 0; i < sizeof(bench_images) / sizeof(bench_images[0]); i++) {
+        jpeg_reader_t reader;
+        size_t len;
+        uint8_t *data = bench_file_load(bench_images[i], &len);
+        uint8_t *out = NULL;
+        int w, h;
+        int64_t start, rgb_time, gray_time;
+
+        printf("%s\n", strrchr(bench_images[i], '/') + 1);
+        start = esp_timer_get_time();
+        for (int n = 0; n < iterations; n++) {
+            jpeg_reader_init_mem(&reader, data, len);
+            out = jpeg_decode_ex(dec, &reader, &w, &h);
+        }
+        rgb_time = esp_timer_get_time() - start;
+        HOST_CHECK(out);
+        bench_report("jpeg_decode_ex, RGB565", rgb_time, iterations, len, w * h);
+
+        //The output buffer of the decoder is reused by the next decode
+        uint8_t *rgb565 = malloc(w * h * 2);
+        HOST_CHECK(rgb565);
+        memcpy(rgb565, out, w * h * 2);
+
+        start = esp_timer_get_time();
+        for (int n = 0; n < iterations; n++) {
+            jpeg_reader_init_mem(&reader, data, len);
+            out = jpeg_decode_gray(dec, &reader, &w, &h);
+        }
+        gray_time = esp_timer_get_time() - start;
+        HOST_CHECK(out);
+        bench_report("jpeg_decode_gray", gray_time, iterations, len, w * h);
+
+        double error = bench_luma_error(out, rgb565, w * h);
+        printf("  gray is x%.2f the RGB565 decode, %.2f mean luma difference\n", (double)rgb_time / gray_time, error);
+        HOST_CHECK(error < 2.5);
+        free(rgb565);
+        free(data);
+    }
+    jpeg_decoder_delete(dec);
+    return 0;
+}
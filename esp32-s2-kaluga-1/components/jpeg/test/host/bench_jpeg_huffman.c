@@ -0,0 +1,76 @@
+//Entropy decode benchmark of tjpgd: the same images decoded with the bit reader this build of tjpgd.c has,
+//the 32-bit bit buffer with Huffman lookup tables (JD_FASTDECODE 1) or the original bit by bit reader
+//(JD_FASTDECODE 0, bench_jpeg_huffman_bitwise). The output function only sums the pixels, so the time
+//is the decoder's, and the sums of both builds must match.
+
+#include <string.h>
+#include "bench.h"
+#include "jpeg.h"
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    size_t pos;
+    uint32_t sum;
+} bench_obj_t;
+
+static const char *const bench_images[] = {
+    BENCH_IMAGE_FILE,
+    TEST_CORPUS_DIR "/restart_96x64.jpg",
+    TEST_CORPUS_DIR "/yuv444_40x30.jpg",
+};
+
+static UINT bench_in(JDEC *decoder, BYTE *buf, UINT len)
+{
+    bench_obj_t *obj = (bench_obj_t *)decoder->device;
+
+    if (len > obj->len - obj->pos) {
+        len = obj->len - obj->pos;
+    }
+    if (buf) {
+        memcpy(buf, obj->data + obj->pos, len);
+    }
+    obj->pos += len;
+    return len;
+}
+
+static UINT bench_out(JDEC *decoder, void *bitmap, JRECT *rect)
+{
+    bench_obj_t *obj = (bench_obj_t *)decoder->device;
+    const uint8_t *in = (const uint8_t *)bitmap;
+    int size = 2 * (rect->right - rect->left + 1) * (rect->bottom - rect->top + 1);
+
+    for (int i = 0; i < size; i++) {
+        obj->sum = obj->sum * 31 + in[i];
+    }
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t work[JPEG_WORK_BUF_SIZE];
+    int iterations = bench_iterations(argc, argv, 500);
+
+    printf("JD_FASTDECODE %d, %d iterations\n", JD_FASTDECODE, iterations);
+    for (int i = 0; i < sizeof(bench_images) / sizeof(bench_images[0]); i++) {
+        size_t len;
+        uint8_t *data = bench_file_load(bench_images[i], &len);
+        uint32_t sum = 0;
+        int pixels = 0;
+        int64_t start = esp_timer_get_time();
+
+        for (int n = 0; n < iterations; n++) {
+            bench_obj_t obj = {.data = data, .len = len};
+            JDEC decoder;
+
+            HOST_CHECK(jd_prepare(&decoder, bench_in, work, sizeof(work), &obj) == JDR_OK);
+            HOST_CHECK(jd_decomp(&decoder, bench_out, 0) == JDR_OK);
+            sum = obj.sum;
+            pixels = decoder.width * decoder.height;
+        }
+        bench_report(strrchr(bench_images[i], '/') + 1, esp_timer_get_time() - start, iterations, len, pixels);
+        printf("  %-36s %08x\n", "pixel sum", sum);
+        free(data);
+    }
+    return 0;
+}
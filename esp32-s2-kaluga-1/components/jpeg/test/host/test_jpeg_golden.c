@@ -0,0 +1,495 @@
+//Golden test of the decoder on the host: every image of corpus/ is decoded at the four tjpgd scales and compared
+//byte for byte with corpus/<image>.s<scale>.rgb565, RGB565 in LCD byte order as jpeg_decode returns it. At
+//scale 0 the image also goes through jpeg_decode_ex, jpeg_decoder_decode, jpeg_decode_roi, jpeg_decoder_decode_band,
+//jpeg_decode_to and jpeg_decoder_decode_parallel, which must give the same pixels, and the statistics of the decoder
+//are printed.
+//
+//Run with --update after an intended change of the output to rewrite the golden files, and review their diff.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "jpeg.h"
+
+#define TEST_SCALE_NUM 4
+
+typedef struct {
+    const char *name;
+    int supported;            //0: tjpgd must refuse it, there are no golden files
+} corpus_image_t;
+
+static const corpus_image_t corpus[] = {
+    {"yuv420_72x40", 1},      //MCU of 16x16, partial MCUs on the right
+    {"yuv422_48x32", 1},      //MCU of 16x8
+    {"yuv444_40x30", 1},      //MCU of 8x8, partial MCUs at the bottom
+    {"odd_33x17", 1},         //Partial MCUs on both edges, odd sizes at every scale
+    {"restart_96x64", 1},     //DRI, an RSTn marker every 4 MCUs
+    {"gray_33x17", 0},        //Single component, tjpgd decodes three only
+    {"progressive_32x32", 0}, //SOF2
+};
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    size_t pos;
+    uint8_t *out;
+    int out_w;                //Output size at the decode scale, grown from the rectangles
+    int out_h;
+    int stride;
+} golden_obj_t;
+
+static uint8_t *file_load(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    uint8_t *data = NULL;
+
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    rewind(f);
+    data = malloc(*len);
+    HOST_CHECK(data && fread(data, 1, *len, f) == *len);
+    fclose(f);
+    return data;
+}
+
+static UINT golden_in(JDEC *decoder, BYTE *buf, UINT len)
+{
+    golden_obj_t *obj = (golden_obj_t *)decoder->device;
+
+    if (len > obj->len - obj->pos) {
+        len = obj->len - obj->pos;
+    }
+    if (buf) {
+        memcpy(buf, obj->data + obj->pos, len);
+    }
+    obj->pos += len;
+    return len;
+}
+
+static UINT golden_out(JDEC *decoder, void *bitmap, JRECT *rect)
+{
+    golden_obj_t *obj = (golden_obj_t *)decoder->device;
+    int w = rect->right - rect->left + 1;
+
+    for (int y = rect->top; y <= rect->bottom; y++) {
+        memcpy(obj->out + y * obj->stride + rect->left * 2, (uint8_t *)bitmap + (y - rect->top) * w * 2, w * 2);
+    }
+    if (rect->right + 1 > obj->out_w) {
+        obj->out_w = rect->right + 1;
+    }
+    if (rect->bottom + 1 > obj->out_h) {
+        obj->out_h = rect->bottom + 1;
+    }
+    return 1;
+}
+
+//tjpgd alone, it is the only way to the scales other than 1:1
+static int golden_decode(const uint8_t *data, size_t len, int scale, golden_obj_t *obj, int *w, int *h)
+{
+    static uint8_t work[JPEG_WORK_BUF_SIZE];
+    JDEC decoder = {0};
+
+    memset(obj, 0, sizeof(*obj));
+    obj->data = data;
+    obj->len = len;
+    if (jd_prepare(&decoder, golden_in, work, sizeof(work), obj) != JDR_OK) {
+        return -1;
+    }
+    *w = decoder.width;
+    *h = decoder.height;
+    obj->stride = decoder.width * 2;
+    obj->out = calloc(decoder.width * decoder.height, 2);
+    HOST_CHECK(obj->out);
+    HOST_CHECK(jd_decomp(&decoder, golden_out, scale) == JDR_OK);
+    return 0;
+}
+
+//Packs the rows of the scaled image, the output was laid out with the stride of the full size
+static size_t golden_pack(golden_obj_t *obj)
+{
+    for (int y = 1; y < obj->out_h; y++) {
+        memmove(obj->out + y * obj->out_w * 2, obj->out + y * obj->stride, obj->out_w * 2);
+    }
+    return obj->out_w * obj->out_h * 2;
+}
+
+static int golden_compare(const char *path, const uint8_t *out, size_t len, int update)
+{
+    size_t golden_len = 0;
+    uint8_t *golden = NULL;
+    int diff = 0;
+
+    if (update) {
+        FILE *f = fopen(path, "wb");
+        HOST_CHECK(f && fwrite(out, 1, len, f) == len);
+        fclose(f);
+        return 0;
+    }
+
+    golden = file_load(path, &golden_len);
+    if (!golden) {
+        printf("  %s missing, run with --update\n", path);
+        return -1;
+    }
+    if (golden_len != len) {
+        printf("  %s has %zu bytes, the decoder gave %zu\n", path, golden_len, len);
+        free(golden);
+        return -1;
+    }
+    for (size_t i = 0; i < len; i += 2) {
+        if (memcmp(out + i, golden + i, 2)) {
+            if (!diff) {
+                printf("  %s: first pixel differing at byte %zu\n", path, i);
+            }
+            diff++;
+        }
+    }
+    if (diff) {
+        printf("  %s: %d pixels differ\n", path, diff);
+    }
+    free(golden);
+    return diff ? -1 : 0;
+}
+
+//The component API at 1:1 must give the scale 0 golden too
+static void api_check(jpeg_decoder_t *dec, const corpus_image_t *image, const uint8_t *data, size_t len, const uint8_t *golden)
+{
+    jpeg_reader_t reader;
+    jpeg_decoder_stats_t stats;
+    int w = 0, h = 0;
+
+    jpeg_reader_init_mem(&reader, data, len);
+    uint8_t *out = jpeg_decode_ex(dec, &reader, &w, &h);
+
+    if (!image->supported) {
+        HOST_CHECK(out == NULL);
+        return;
+    }
+    HOST_CHECK(out && memcmp(out, golden, w * h * 2) == 0);
+    jpeg_decoder_get_stats(dec, &stats);
+    printf("  decode_time %lld us, pool_used %u, pool_peak %u, stage_ticks %u %u %u %u\n",
+           (long long)stats.decode_time, stats.pool_used, stats.pool_peak,
+           stats.stage_ticks[0], stats.stage_ticks[1], stats.stage_ticks[2], stats.stage_ticks[3]);
+    HOST_CHECK(stats.pool_used > 0 && stats.pool_used <= JPEG_WORK_BUF_SIZE && stats.pool_peak >= stats.pool_used);
+
+    w = h = 0;
+    out = jpeg_decoder_decode(dec, data, len, &w, &h);
+    HOST_CHECK(out && memcmp(out, golden, w * h * 2) == 0);
+
+    //The copy has no byte past the cut, a read beyond it is caught by the sanitizer
+    uint8_t *cut = malloc(len / 2);
+    HOST_CHECK(cut);
+    memcpy(cut, data, len / 2);
+    HOST_CHECK(jpeg_decoder_decode(dec, cut, len / 2, &w, &h) == NULL);
+    free(cut);
+}
+
+//jpeg_decode_roi gives the crop of the scale 0 golden, and a truncated image fails within its length
+static void roi_check(jpeg_decoder_t *dec, const uint8_t *data, size_t len, const uint8_t *golden, int width, int height)
+{
+    static const int windows[][4] = {
+        {0, 0, 8, 8}, {5, 3, 17, 9}, {16, 16, 16, 16}, {1, 1, 1000, 1000},
+    };
+    jpeg_reader_t reader;
+
+    for (int i = 0; i < sizeof(windows) / sizeof(windows[0]); i++) {
+        int x = windows[i][0], y = windows[i][1], w = windows[i][2], h = windows[i][3];
+
+        if (x >= width || y >= height) {
+            continue;
+        }
+        jpeg_reader_init_mem(&reader, data, len);
+        uint8_t *out = jpeg_decode_roi(dec, &reader, x, y, &w, &h);
+        HOST_CHECK(out && w <= windows[i][2] && h <= windows[i][3] && x + w <= width && y + h <= height);
+        for (int row = 0; row < h; row++) {
+            HOST_CHECK(memcmp(out + row * w * 2, golden + ((y + row) * width + x) * 2, w * 2) == 0);
+        }
+    }
+
+    int w = width, h = height;
+    jpeg_reader_init_mem(&reader, data, len);
+    HOST_CHECK(jpeg_decode_roi(dec, &reader, width, 0, &w, &h) == NULL);
+
+    //The copy has no byte past the cut, a read beyond it is caught by the sanitizer
+    uint8_t *cut = malloc(len / 2);
+    HOST_CHECK(cut);
+    memcpy(cut, data, len / 2);
+    w = width;
+    h = height;
+    jpeg_reader_init_mem(&reader, cut, len / 2);
+    HOST_CHECK(jpeg_decode_roi(dec, &reader, 0, 0, &w, &h) == NULL);
+    free(cut);
+}
+
+typedef struct {
+    uint8_t *out;
+    int width;
+    int rows;                 //Rows received so far, the bands must come in order
+} band_obj_t;
+
+static int band_out(void *ctx, int y, int w, int h, uint8_t *data)
+{
+    band_obj_t *obj = (band_obj_t *)ctx;
+
+    HOST_CHECK(y == obj->rows && w == obj->width);
+    memcpy(obj->out + y * w * 2, data, w * h * 2);
+    obj->rows += h;
+    return 0;
+}
+
+//jpeg_decoder_decode_band puts the scale 0 golden together band by band, and fails on a truncated image within its length
+static void band_check(jpeg_decoder_t *dec, const uint8_t *data, size_t len, const uint8_t *golden, int width, int height)
+{
+    band_obj_t obj = {.out = malloc(width * height * 2), .width = width};
+
+    HOST_CHECK(obj.out);
+    HOST_CHECK(jpeg_decoder_decode_band(dec, data, len, band_out, &obj) == ESP_OK);
+    HOST_CHECK(obj.rows == height && memcmp(obj.out, golden, width * height * 2) == 0);
+
+    uint8_t *cut = malloc(len / 2);
+    HOST_CHECK(cut);
+    memcpy(cut, data, len / 2);
+    obj.rows = 0;
+    HOST_CHECK(jpeg_decoder_decode_band(dec, cut, len / 2, band_out, &obj) == ESP_FAIL);
+    free(cut);
+    free(obj.out);
+}
+
+#define TO_GUARD 4           //Canary pixels around the target of jpeg_decode_to
+#define TO_CANARY 0xA5       //Byte of the canary
+#define TO_GRAY_ERROR 4.0    //Largest mean difference of the GRAY8 image to the luminance of the golden RGB565 one
+
+//Pixel i of the scale 0 golden in format, at px. tjpgd outputs Y itself for GRAY8, which differs from the
+//luminance of the clipped RGB on saturated colors, so it is compared with the jpeg_decode_gray image instead
+static int to_pixel_check(jpeg_pixel_format_t format, const uint8_t *px, const uint8_t *golden, const uint8_t *gray, int i)
+{
+    uint16_t v = golden[2 * i] << 8 | golden[2 * i + 1];
+
+    switch (format) {
+    case JPEG_PIXEL_FORMAT_RGB565_BE:
+        return px[0] == golden[2 * i] && px[1] == golden[2 * i + 1];
+    case JPEG_PIXEL_FORMAT_RGB565_LE:
+        return px[0] == golden[2 * i + 1] && px[1] == golden[2 * i];
+    case JPEG_PIXEL_FORMAT_RGB888:
+        return px[0] >> 3 == v >> 11 && px[1] >> 2 == ((v >> 5) & 0x3F) && px[2] >> 3 == (v & 0x1F);
+    default:
+        return px[0] == gray[i];
+    }
+}
+
+//Mean absolute difference of the gray image to the BT.601 luminance of the RGB565 golden, as bench_jpeg_gray
+static double to_gray_error(const uint8_t *gray, const uint8_t *golden, int pixels)
+{
+    int64_t error = 0;
+
+    for (int i = 0; i < pixels; i++) {
+        uint16_t v = golden[2 * i] << 8 | golden[2 * i + 1];
+        int r = v >> 11, g = (v >> 5) & 0x3F, b = v & 0x1F;
+
+        r = r << 3 | r >> 2;
+        g = g << 2 | g >> 4;
+        b = b << 3 | b >> 2;
+        error += abs(((77 * r + 150 * g + 29 * b) >> 8) - gray[i]);
+    }
+    return (double)error / pixels;
+}
+
+//jpeg_decode_to puts the scale 0 golden at a positive or negative position of a larger framebuffer in every
+//pixel format, clipped to the target, and writes nothing else: the canary around the image and the target stays
+static void to_check(jpeg_decoder_t *dec, const uint8_t *data, size_t len, const uint8_t *golden, int width, int height)
+{
+    static const jpeg_pixel_format_t formats[] = {
+        JPEG_PIXEL_FORMAT_RGB565_BE, JPEG_PIXEL_FORMAT_RGB565_LE, JPEG_PIXEL_FORMAT_RGB888, JPEG_PIXEL_FORMAT_GRAY8,
+    };
+    const int layouts[][4] = {        //x, y, target width, target height
+        {5, 3, width + 16, height + 10},
+        {-5, -3, width - 4, height - 2},
+        {width / 2, height / 3, width, height},
+        {0, 0, 0, 0},                 //No clipping, the target is the image
+    };
+    jpeg_reader_t reader;
+    int w = 0, h = 0;
+
+    //The GRAY8 reference, it must be the luminance of the golden
+    uint8_t *gray = malloc(width * height);
+    HOST_CHECK(gray);
+    jpeg_reader_init_mem(&reader, data, len);
+    uint8_t *out = jpeg_decode_gray(dec, &reader, &w, &h);
+    HOST_CHECK(out && w == width && h == height);
+    memcpy(gray, out, width * height);
+    HOST_CHECK(to_gray_error(gray, golden, width * height) <= TO_GRAY_ERROR);
+
+    for (int f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        int bpp = formats[f] == JPEG_PIXEL_FORMAT_RGB888 ? 3 : formats[f] == JPEG_PIXEL_FORMAT_GRAY8 ? 1 : 2;
+
+        for (int l = 0; l < sizeof(layouts) / sizeof(layouts[0]); l++) {
+            int x = layouts[l][0], y = layouts[l][1];
+            int tw = layouts[l][2] ? layouts[l][2] : width;
+            int th = layouts[l][3] ? layouts[l][3] : height;
+            int cw = tw + 2 * TO_GUARD, ch = th + 2 * TO_GUARD;
+            uint8_t *canvas = malloc(cw * ch * bpp);
+            jpeg_output_t output = {
+                .stride = cw * bpp, .x = x, .y = y,
+                .width = layouts[l][2], .height = layouts[l][3], .format = formats[f],
+            };
+
+            HOST_CHECK(canvas);
+            memset(canvas, TO_CANARY, cw * ch * bpp);
+            output.base = canvas + (TO_GUARD * cw + TO_GUARD) * bpp;
+            jpeg_reader_init_mem(&reader, data, len);
+            w = h = 0;
+            HOST_CHECK(jpeg_decode_to(dec, &reader, &output, &w, &h) == ESP_OK && w == width && h == height);
+
+            for (int cy = 0; cy < ch; cy++) {
+                for (int cx = 0; cx < cw; cx++) {
+                    const uint8_t *px = canvas + (cy * cw + cx) * bpp;
+                    int tx = cx - TO_GUARD, ty = cy - TO_GUARD;
+                    int ix = tx - x, iy = ty - y;
+
+                    if (tx >= 0 && tx < tw && ty >= 0 && ty < th && ix >= 0 && ix < width && iy >= 0 && iy < height) {
+                        HOST_CHECK(to_pixel_check(formats[f], px, golden, gray, iy * width + ix));
+                    } else {
+                        for (int b = 0; b < bpp; b++) {
+                            HOST_CHECK(px[b] == TO_CANARY);
+                        }
+                    }
+                }
+            }
+            free(canvas);
+        }
+    }
+    free(gray);
+
+    //Completely outside the target
+    uint8_t canvas[4] = {0};
+    jpeg_output_t output = {.base = canvas, .stride = 2, .x = -width, .width = 1, .height = 1, .format = JPEG_PIXEL_FORMAT_RGB565_BE};
+    jpeg_reader_init_mem(&reader, data, len);
+    HOST_CHECK(jpeg_decode_to(dec, &reader, &output, NULL, NULL) == ESP_ERR_INVALID_ARG);
+}
+
+//Offsets of the RSTn markers of the scan, returns their number
+static int rst_find(const uint8_t *data, size_t len, size_t *offs, int max)
+{
+    size_t pos = 2;
+    int n = 0;
+
+    while (pos + 1 < len && !(data[pos] == 0xFF && data[pos + 1] == 0xDA)) {
+        pos++;
+    }
+    for (; pos + 1 < len && n < max; pos++) {
+        if (data[pos] == 0xFF && data[pos + 1] >= 0xD0 && data[pos + 1] <= 0xD7) {
+            offs[n++] = pos;
+        }
+    }
+    return n;
+}
+
+//jpeg_decoder_decode_parallel gives the scale 0 golden with any number of workers, an image without DRI is
+//decoded by jd_decomp alone, and a missing or renumbered RSTn marker fails instead of shifting the MCUs
+static void parallel_check(jpeg_decoder_t *dec, const uint8_t *data, size_t len, const uint8_t *golden, int width, int height)
+{
+    size_t rst[64];
+    int w, h;
+    uint8_t *copy = malloc(len);
+
+    HOST_CHECK(copy);
+    for (int workers = 1; workers <= JPEG_WORKER_MAX; workers++) {
+        memcpy(copy, data, len);
+        w = h = 0;
+        uint8_t *out = jpeg_decoder_decode_parallel(dec, copy, len, workers, &w, &h);
+        HOST_CHECK(out && w == width && h == height && memcmp(out, golden, width * height * 2) == 0);
+    }
+
+    int rst_num = rst_find(data, len, rst, sizeof(rst) / sizeof(rst[0]));
+    if (rst_num == 0) {
+        free(copy);
+        return;
+    }
+    printf("  parallel: %d RSTn markers\n", rst_num);
+
+    //The middle marker ends the run of the first of two workers, only the index sees it
+    size_t mid = rst[rst_num / 2];
+    for (int workers = 2; workers <= JPEG_WORKER_MAX; workers++) {
+        memcpy(copy, data, len);
+        copy[mid + 1] = 0xD0 + (copy[mid + 1] - 0xD0 + 1) % 8;
+        HOST_CHECK(jpeg_decoder_decode_parallel(dec, copy, len, workers, &w, &h) == NULL);
+
+        memcpy(copy, data, mid);
+        memcpy(copy + mid, data + mid + 2, len - mid - 2);
+        HOST_CHECK(jpeg_decoder_decode_parallel(dec, copy, len - 2, workers, &w, &h) == NULL);
+    }
+    free(copy);
+}
+
+int main(int argc, char **argv)
+{
+    int update = argc > 1 && strcmp(argv[1], "--update") == 0;
+    jpeg_decoder_t *dec = jpeg_decoder_create();
+    int fail = 0;
+    char path[512];
+
+    HOST_CHECK(dec);
+    for (int i = 0; i < sizeof(corpus) / sizeof(corpus[0]); i++) {
+        const corpus_image_t *image = &corpus[i];
+        uint8_t *golden0 = NULL;
+        int width = 0, height = 0;
+        size_t len;
+
+        snprintf(path, sizeof(path), "%s/%s.jpg", TEST_CORPUS_DIR, image->name);
+        uint8_t *data = file_load(path, &len);
+        HOST_CHECK(data);
+        printf("%s\n", image->name);
+
+        for (int scale = 0; scale < TEST_SCALE_NUM; scale++) {
+            golden_obj_t obj;
+            int w, h;
+
+            if (golden_decode(data, len, scale, &obj, &w, &h) != 0) {
+                HOST_CHECK(!image->supported);
+                printf("  refused\n");
+                break;
+            }
+            HOST_CHECK(image->supported);
+
+            //tjpgd scales the part of an edge MCU on its own, the size lies between the rounded down and up ones
+            HOST_CHECK(obj.out_w >= w >> scale && obj.out_w <= (w + (1 << scale) - 1) >> scale);
+            HOST_CHECK(obj.out_h >= h >> scale && obj.out_h <= (h + (1 << scale) - 1) >> scale);
+            size_t out_len = golden_pack(&obj);
+            snprintf(path, sizeof(path), "%s/%s.s%d.rgb565", TEST_CORPUS_DIR, image->name, scale);
+            if (golden_compare(path, obj.out, out_len, update) != 0) {
+                fail++;
+            }
+            printf("  1/%d: %dx%d\n", 1 << scale, obj.out_w, obj.out_h);
+
+            if (scale == 0) {
+                golden0 = obj.out;
+                width = w;
+                height = h;
+            } else {
+                free(obj.out);
+            }
+        }
+
+        api_check(dec, image, data, len, golden0);
+        if (golden0) {
+            roi_check(dec, data, len, golden0, width, height);
+            band_check(dec, data, len, golden0, width, height);
+            to_check(dec, data, len, golden0, width, height);
+            parallel_check(dec, data, len, golden0, width, height);
+        }
+        free(golden0);
+        free(data);
+    }
+    jpeg_decoder_delete(dec);
+
+    if (fail) {
+        printf("%d golden files differ\n", fail);
+        return 1;
+    }
+    printf("%s\n", update ? "golden files written" : "all golden files match");
+    return 0;
+}
@@ -20,6 +20,11 @@
 
 #include "tjpgd.h"
 
+#if JD_PROFILE
+#include "jpeg_port.h"
+#define JD_TICKS()	jpeg_port_ticks()
+#endif
+
 #define SUPPORT_JPEG 1
 
 #ifdef SUPPORT_JPEG
@@ -239,6 +244,26 @@ UINT create_huffman_tbl (	/* 0:OK, !0:Failed */
 			if (!cls && d > 11) return JDR_FMT1;
 			*pd++ = d;
 		}
+
+#if JD_FASTDECODE
+		/* Create the lookup table, every short code fills all the entries it is a prefix of */
+		ph = alloc_pool(jd, (1 << JD_HUFFLUT_BITS) * sizeof (WORD));
+		if (!ph) return JDR_MEM1;			/* Err: not enough memory */
+		jd->hufflut[num][cls] = ph;
+		for (i = 0; i < (1 << JD_HUFFLUT_BITS); i++) ph[i] = 0;
+		hc = 0; pd = jd->huffdata[num][cls];
+		for (i = 0; i < JD_HUFFLUT_BITS; i++) {
+			for (b = pb[i]; b; b--) {
+				if (hc >= (1U << (i + 1))) return JDR_FMT1;	/* Err: over-subscribed code lengths */
+				j = (UINT)hc << (JD_HUFFLUT_BITS - 1 - i);	/* First entry of the code */
+				for (np = 1 << (JD_HUFFLUT_BITS - 1 - i); np; np--) {
+					ph[j++] = (WORD)((i + 1) << 8 | *pd);
+				}
+				hc++; pd++;
+			}
+			hc <<= 1;
+		}
+#endif
 	}
 
 	return JDR_OK;
@@ -247,6 +272,154 @@ UINT create_huffman_tbl (	/* 0:OK, !0:Failed */
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Get the next block of the entropy coded data                          */
+/*-----------------------------------------------------------------------*/
+
+static
+UINT refill (	/* Number of bytes available at *dp, 0:end of stream */
+	JDEC* jd,	/* Pointer to the decompressor object */
+	BYTE** dp	/* Pointer to the read pointer */
+)
+{
+#if JD_FASTDECODE
+	if (jd->inref) return jd->inref(jd, dp);	/* Read the stream in place, only the bit buffer leaves it untouched */
+#endif
+	*dp = jd->inbuf;							/* Copy the stream into the input buffer */
+	return jd->infunc(jd, *dp, JD_SZBUF);
+}
+
+
+
+
+#if JD_FASTDECODE
+/*-----------------------------------------------------------------------*/
+/* Fill the bit buffer up to at least 25 bits                            */
+/*-----------------------------------------------------------------------*/
+
+static
+void bitfill (
+	JDEC* jd	/* Pointer to the decompressor object */
+)
+{
+	BYTE *dp, d;
+	UINT dc, nb;
+	DWORD w;
+
+
+	dp = jd->dptr; dc = jd->dctr;	/* Read ptr, number of data available */
+	w = jd->wreg; nb = jd->dbit;	/* Bit buffer */
+	while (nb <= 24) {
+		if (jd->marker) {		/* Past a marker, the remaining codes are padded with zeros */
+			w <<= 8; nb += 8;
+			continue;
+		}
+		if (!dc) {				/* No input data is available, re-fill input buffer */
+			dc = refill(jd, &dp);
+			if (!dc) break;		/* End of stream, the consumer fails if it needs more bits */
+		} else {
+			dp++;
+		}
+		dc--;
+		d = *dp;
+		if (d == 0xFF) {		/* Stuffed byte or marker, resolved here once instead of on every bit */
+			if (!dc) {
+				dc = refill(jd, &dp);
+				if (!dc) break;
+			} else {
+				dp++;
+			}
+			dc--;
+			if (*dp) {			/* Marker (RSTn or EOI), keep it for restart() */
+				jd->marker = *dp;
+				continue;
+			}
+		}
+		w = (w << 8) | d;	/* Append a byte */
+		nb += 8;
+	}
+	jd->dptr = dp; jd->dctr = dc;
+	jd->wreg = w; jd->dbit = (BYTE)nb;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Extract N bits from input stream                                      */
+/*-----------------------------------------------------------------------*/
+
+static
+INT bitext (	/* >=0: extracted data, <0: error code */
+	JDEC* jd,	/* Pointer to the decompressor object */
+	UINT nbit	/* Number of bits to extract (1 to 11) */
+)
+{
+	if (jd->dbit < nbit) {
+		bitfill(jd);
+		if (jd->dbit < nbit) return 0 - (INT)JDR_INP;	/* Err: wrong stream termination */
+	}
+	jd->dbit -= nbit;
+
+	return (INT)((jd->wreg >> jd->dbit) & ((1UL << nbit) - 1));
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Extract a huffman decoded data from input stream                      */
+/*-----------------------------------------------------------------------*/
+
+static
+INT huffext (			/* >=0: decoded data, <0: error code */
+	JDEC* jd,			/* Pointer to the decompressor object */
+	UINT id,			/* Huffman table ID */
+	UINT cls			/* Huffman table class, 0:DC, 1:AC */
+)
+{
+	const BYTE* hbits;
+	const WORD* hcode;
+	const BYTE* hdata;
+	UINT v, nb, bl, nd;
+	WORD e;
+
+
+	if (jd->dbit < 16) bitfill(jd);
+	nb = jd->dbit;
+	v = (UINT)(nb >= 16 ? jd->wreg >> (nb - 16) : jd->wreg << (16 - nb)) & 0xFFFF;	/* Next 16 bits, zero padded at the end of stream */
+
+	e = jd->hufflut[id][cls][v >> (16 - JD_HUFFLUT_BITS)];	/* Short code, a single lookup */
+	if (e) {
+		bl = e >> 8;
+		if (bl > nb) return 0 - (INT)JDR_INP;	/* Err: wrong stream termination */
+		jd->dbit = (BYTE)(nb - bl);
+		return e & 0xFF;
+	}
+
+	/* Long code, search the code word tables from JD_HUFFLUT_BITS + 1 bits */
+	hbits = jd->huffbits[id][cls]; hcode = jd->huffcode[id][cls]; hdata = jd->huffdata[id][cls];
+	for (bl = 1; bl <= 16; bl++) {
+		nd = *hbits++;
+		if (bl > JD_HUFFLUT_BITS) {
+			for ( ; nd; nd--) {
+				if ((v >> (16 - bl)) == *hcode) {	/* Matched? */
+					if (bl > nb) return 0 - (INT)JDR_INP;
+					jd->dbit = (BYTE)(nb - bl);
+					return *hdata;					/* Return the decoded data */
+				}
+				hcode++; hdata++;
+			}
+		} else {
+			hcode += nd; hdata += nd;
+		}
+	}
+
+	return 0 - (INT)JDR_FMT1;	/* Err: code not found (may be collapted data) */
+}
+
+#else	/* JD_FASTDECODE */
+
 /*-----------------------------------------------------------------------*/
 /* Extract N bits from input stream                                      */
 /*-----------------------------------------------------------------------*/
@@ -266,8 +439,7 @@ INT bitext (	/* >=0: extracted data, <0: error code */
 	do {
 		if (!msk) {				/* Next byte? */
 			if (!dc) {			/* No input data is available, re-fill input buffer */
-				dp = jd->inbuf;	/* Top of input buffer */
-				dc = jd->infunc(jd, dp, JD_SZBUF);
+				dc = refill(jd, &dp);
 				if (!dc) return 0 - (INT)JDR_INP;	/* Err: read error or wrong stream termination */
 			} else {
 				dp++;			/* Next data ptr */
@@ -305,11 +477,13 @@ INT bitext (	/* >=0: extracted data, <0: error code */
 static
 INT huffext (			/* >=0: decoded data, <0: error code */
 	JDEC* jd,			/* Pointer to the decompressor object */
-	const BYTE* hbits,	/* Pointer to the bit distribution table */
-	const WORD* hcode,	/* Pointer to the code word table */
-	const BYTE* hdata	/* Pointer to the data table */
+	UINT id,			/* Huffman table ID */
+	UINT cls			/* Huffman table class, 0:DC, 1:AC */
 )
 {
+	const BYTE* hbits = jd->huffbits[id][cls];	/* Pointer to the bit distribution table */
+	const WORD* hcode = jd->huffcode[id][cls];	/* Pointer to the code word table */
+	const BYTE* hdata = jd->huffdata[id][cls];	/* Pointer to the data table */
 	BYTE msk, s, *dp;
 	UINT dc, v, f, bl, nd;
 
@@ -320,8 +494,7 @@ INT huffext (			/* >=0: decoded data, <0: error code */
 	do {
 		if (!msk) {		/* Next byte? */
 			if (!dc) {	/* No input data is available, re-fill input buffer */
-				dp = jd->inbuf;	/* Top of input buffer */
-				dc = jd->infunc(jd, dp, JD_SZBUF);
+				dc = refill(jd, &dp);
 				if (!dc) return 0 - (INT)JDR_INP;	/* Err: read error or wrong stream termination */
 			} else {
 				dp++;	/* Next data ptr */
@@ -357,6 +530,8 @@ INT huffext (			/* >=0: decoded data, <0: error code */
 	return 0 - (INT)JDR_FMT1;	/* Err: code not found (may be collapted data) */
 }
 
+#endif	/* JD_FASTDECODE */
+
 
 
 
@@ -479,15 +654,15 @@ void block_idct (
 
 static
 JRESULT mcu_load (
-	JDEC* jd		/* Pointer to the decompressor object */
+	JDEC* jd,		/* Pointer to the decompressor object */
+	BYTE skip		/* 1:Only walk the stream and keep the DC prediction, the MCU is not output */
+					/* The Cb/Cr blocks are always walked this way in gray mode */
 )
 {
 	LONG *tmp = (LONG*)jd->workbuf;	/* Block working buffer for de-quantize and IDCT */
 	UINT blk, nby, nbc, i, z, id, cmp;
 	INT b, d, e;
 	BYTE *bp;
-	const BYTE *hb, *hd;
-	const WORD *hc;
 	const LONG *dqf;
 
 
@@ -496,14 +671,14 @@ JRESULT mcu_load (
 	bp = jd->mcubuf;			/* Pointer to the first block */
 
 	for (blk = 0; blk < nby + nbc; blk++) {
+#if JD_PROFILE
+		DWORD t0 = JD_TICKS(), t1;
+#endif
 		cmp = (blk < nby) ? 0 : blk - nby + 1;	/* Component number 0:Y, 1:Cb, 2:Cr */
 		id = cmp ? 1 : 0;						/* Huffman table ID of the component */
 
 		/* Extract a DC element from input stream */
-		hb = jd->huffbits[id][0];				/* Huffman table for the DC element */
-		hc = jd->huffcode[id][0];
-		hd = jd->huffdata[id][0];
-		b = huffext(jd, hb, hc, hd);			/* Extract a huffman coded data (bit length) */
+		b = huffext(jd, id, 0);					/* Extract a huffman coded data (bit length) */
 		if (b < 0) return 0 - b;				/* Err: invalid code or input */
 		d = jd->dcv[cmp];						/* DC value of previous block */
 		if (b) {								/* If there is any difference from previous block */
@@ -514,17 +689,33 @@ JRESULT mcu_load (
 			d += e;								/* Get current value */
 			jd->dcv[cmp] = (SHORT)d;			/* Save current DC value for next block */
 		}
+
+		if (skip || (jd->gray && cmp)) {	/* Walk the AC codes without de-quantizing, the block needs no IDCT */
+			for (i = 1; i < 64; i++) {
+				b = huffext(jd, id, 1);
+				if (b == 0) break;				/* EOB? */
+				if (b < 0) return 0 - b;		/* Err: invalid code or input error */
+				i += (UINT)b >> 4;				/* Skip zero elements */
+				if (i >= 64) return JDR_FMT1;	/* Too long zero run */
+				if (b &= 0x0F) {
+					d = bitext(jd, b);			/* Discard data bits */
+					if (d < 0) return 0 - d;
+				}
+			}
+#if JD_PROFILE
+			jd->prof[JD_PROF_HUFF] += JD_TICKS() - t0;
+#endif
+			continue;
+		}
+
 		dqf = jd->qttbl[jd->qtid[cmp]];			/* De-quantizer table ID for this component */
 		tmp[0] = d * dqf[0] >> 8;				/* De-quantize, apply scale factor of Arai algorithm and descale 8 bits */
 
 		/* Extract following 63 AC elements from input stream */
 		for (i = 1; i < 64; i++) tmp[i] = 0;	/* Clear rest of elements */
-		hb = jd->huffbits[id][1];				/* Huffman table for the AC elements */
-		hc = jd->huffcode[id][1];
-		hd = jd->huffdata[id][1];
 		i = 1;					/* Top of the AC elements */
 		do {
-			b = huffext(jd, hb, hc, hd);		/* Extract a huffman coded value (zero runs and bit length) */
+			b = huffext(jd, id, 1);				/* Extract a huffman coded value (zero runs and bit length) */
 			if (b == 0) break;					/* EOB? */
 			if (b < 0) return 0 - b;			/* Err: invalid code or input error */
 			z = (UINT)b >> 4;					/* Number of leading zero elements */
@@ -542,10 +733,17 @@ JRESULT mcu_load (
 			}
 		} while (++i < 64);		/* Next AC element */
 
+#if JD_PROFILE
+		t1 = JD_TICKS();
+		jd->prof[JD_PROF_HUFF] += t1 - t0;
+#endif
 		if (JD_USE_SCALE && jd->scale == 3)
 			*bp = (*tmp / 256) + 128;	/* If scale ratio is 1/8, IDCT can be ommited and only DC element is used */
 		else
 			block_idct(tmp, bp);		/* Apply IDCT and store the block to the MCU buffer */
+#if JD_PROFILE
+		jd->prof[JD_PROF_IDCT] += JD_TICKS() - t1;
+#endif
 
 		bp += 64;				/* Next block */
 	}
@@ -558,6 +756,7 @@ JRESULT mcu_load (
 
 /*-----------------------------------------------------------------------*/
 /* Output an MCU: Convert YCrCb to RGB and output it in RGB form         */
+/* or output its Y component alone in gray mode                          */
 /*-----------------------------------------------------------------------*/
 
 static
@@ -571,8 +770,12 @@ JRESULT mcu_output (
 	const INT CVACC = (sizeof (INT) > 2) ? 1024 : 128;
 	UINT ix, iy, mx, my, rx, ry;
 	INT yy, cb, cr;
-	BYTE *py, *pc, *rgb24;
+	BYTE *py, *pc, *rgb24, *op;
 	JRECT rect;
+#if JD_PROFILE
+	DWORD t0 = JD_TICKS(), t1;
+	JRESULT rc;
+#endif
 
 
 	mx = jd->msx * 8; my = jd->msy * 8;					/* MCU size (pixel) */
@@ -587,107 +790,159 @@ JRESULT mcu_output (
 	rect.top = y; rect.bottom = y + ry - 1;
 
 
-	if (!JD_USE_SCALE || jd->scale != 3) {	/* Not for 1/8 scaling */
+	if (jd->gray) {	/* Y only, the Cb/Cr blocks have not been decoded */
 
-		/* Build an RGB MCU from discrete comopnents */
-		rgb24 = (BYTE*)jd->workbuf;
-		for (iy = 0; iy < my; iy++) {
-			pc = jd->mcubuf;
-			py = pc + iy * 8;
-			if (my == 16) {		/* Double block height? */
-				pc += 64 * 4 + (iy >> 1) * 8;
-				if (iy >= 8) py += 64;
-			} else {			/* Single block height */
-				pc += mx * 8 + iy * 8;
-			}
-			for (ix = 0; ix < mx; ix++) {
-				cb = pc[0] - 128; 	/* Get Cb/Cr component and restore right level */
-				cr = pc[64] - 128;
-				if (mx == 16) {					/* Double block width? */
-					if (ix == 8) py += 64 - 8;	/* Jump to next block if double block heigt */
-					pc += ix & 1;				/* Increase chroma pointer every two pixels */
-				} else {						/* Single block width */
-					pc++;						/* Increase chroma pointer every pixel */
+		if (!JD_USE_SCALE || jd->scale != 3) {	/* Not for 1/8 scaling */
+
+			/* Gather the Y blocks into a luma MCU */
+			op = (BYTE*)jd->workbuf;
+			for (iy = 0; iy < my; iy++) {
+				py = jd->mcubuf + iy * 8;
+				if (iy >= 8) py += 64;			/* Lower blocks of double block height */
+				for (ix = 0; ix < mx; ix++) {
+					if (ix == 8) py += 64 - 8;	/* Jump to next block if double block width */
+					*op++ = *py++;
 				}
-				yy = *py++;			/* Get Y component */
+			}
 
-				/* Convert YCbCr to RGB */
-				*rgb24++ = /* R */ BYTECLIP(yy + ((INT)(1.402 * CVACC) * cr) / CVACC);
-				*rgb24++ = /* G */ BYTECLIP(yy - ((INT)(0.344 * CVACC) * cb + (INT)(0.714 * CVACC) * cr) / CVACC);
-				*rgb24++ = /* B */ BYTECLIP(yy + ((INT)(1.772 * CVACC) * cb) / CVACC);
+			/* Descale the MCU rectangular if needed */
+			if (JD_USE_SCALE && jd->scale) {
+				UINT x, y, v, s, w, a;
+
+				s = jd->scale * 2;	/* Number of shifts for averaging */
+				w = 1 << jd->scale;	/* Width of square */
+				a = mx - w;			/* Bytes to skip for next line in the square */
+				op = (BYTE*)jd->workbuf;
+				for (iy = 0; iy < my; iy += w) {
+					for (ix = 0; ix < mx; ix += w) {
+						py = (BYTE*)jd->workbuf + iy * mx + ix;
+						v = 0;
+						for (y = 0; y < w; y++) {	/* Accumulate Y value in the square */
+							for (x = 0; x < w; x++) v += *py++;
+							py += a;
+						}
+						*op++ = (BYTE)(v >> s);		/* Put the averaged Y value as a pixel */
+					}
+				}
 			}
-		}
 
-		/* Descale the MCU rectangular if needed */
-		if (JD_USE_SCALE && jd->scale) {
-			UINT x, y, r, g, b, s, w, a;
-			BYTE *op;
+		} else {	/* For only 1/8 scaling, the DC value of each Y block */
 
-			/* Get averaged RGB value of each square correcponds to a pixel */
-			s = jd->scale * 2;	/* Bumber of shifts for averaging */
-			w = 1 << jd->scale;	/* Width of square */
-			a = (mx - w) * 3;	/* Bytes to skip for next line in the square */
 			op = (BYTE*)jd->workbuf;
-			for (iy = 0; iy < my; iy += w) {
-				for (ix = 0; ix < mx; ix += w) {
-					rgb24 = (BYTE*)jd->workbuf + (iy * mx + ix) * 3;
-					r = g = b = 0;
-					for (y = 0; y < w; y++) {	/* Accumulate RGB value in the square */
-						for (x = 0; x < w; x++) {
-							r += *rgb24++;
-							g += *rgb24++;
-							b += *rgb24++;
-						}
-						rgb24 += a;
-					}							/* Put the averaged RGB value as a pixel */
-					*op++ = (BYTE)(r >> s);
-					*op++ = (BYTE)(g >> s);
-					*op++ = (BYTE)(b >> s);
+			for (iy = 0; iy < my; iy += 8) {
+				py = jd->mcubuf;
+				if (iy == 8) py += 64 * 2;
+				for (ix = 0; ix < mx; ix += 8) {
+					*op++ = *py;
+					py += 64;
 				}
 			}
 		}
 
-	} else {	/* For only 1/8 scaling (left-top pixel in each block are the DC value of the block) */
-
-		/* Build a 1/8 descaled RGB MCU from discrete comopnents */
-		rgb24 = (BYTE*)jd->workbuf;
-		pc = jd->mcubuf + mx * my;
-		cb = pc[0] - 128;		/* Get Cb/Cr component and restore right level */
-		cr = pc[64] - 128;
-		for (iy = 0; iy < my; iy += 8) {
-			py = jd->mcubuf;
-			if (iy == 8) py += 64 * 2;
-			for (ix = 0; ix < mx; ix += 8) {
-				yy = *py;	/* Get Y component */
-				py += 64;
-
-				/* Convert YCbCr to RGB */
-				*rgb24++ = /* R */ BYTECLIP(yy + ((INT)(1.402 * CVACC) * cr / CVACC));
-				*rgb24++ = /* G */ BYTECLIP(yy - ((INT)(0.344 * CVACC) * cb + (INT)(0.714 * CVACC) * cr) / CVACC);
-				*rgb24++ = /* B */ BYTECLIP(yy + ((INT)(1.772 * CVACC) * cb / CVACC));
+	} else {
+
+		if (!JD_USE_SCALE || jd->scale != 3) {	/* Not for 1/8 scaling */
+
+			/* Build an RGB MCU from discrete comopnents */
+			rgb24 = (BYTE*)jd->workbuf;
+			for (iy = 0; iy < my; iy++) {
+				pc = jd->mcubuf;
+				py = pc + iy * 8;
+				if (my == 16) {		/* Double block height? */
+					pc += 64 * 4 + (iy >> 1) * 8;
+					if (iy >= 8) py += 64;
+				} else {			/* Single block height */
+					pc += mx * 8 + iy * 8;
+				}
+				for (ix = 0; ix < mx; ix++) {
+					cb = pc[0] - 128; 	/* Get Cb/Cr component and restore right level */
+					cr = pc[64] - 128;
+					if (mx == 16) {					/* Double block width? */
+						if (ix == 8) py += 64 - 8;	/* Jump to next block if double block heigt */
+						pc += ix & 1;				/* Increase chroma pointer every two pixels */
+					} else {						/* Single block width */
+						pc++;						/* Increase chroma pointer every pixel */
+					}
+					yy = *py++;			/* Get Y component */
+
+					/* Convert YCbCr to RGB */
+					*rgb24++ = /* R */ BYTECLIP(yy + ((INT)(1.402 * CVACC) * cr) / CVACC);
+					*rgb24++ = /* G */ BYTECLIP(yy - ((INT)(0.344 * CVACC) * cb + (INT)(0.714 * CVACC) * cr) / CVACC);
+					*rgb24++ = /* B */ BYTECLIP(yy + ((INT)(1.772 * CVACC) * cb) / CVACC);
+				}
+			}
+
+			/* Descale the MCU rectangular if needed */
+			if (JD_USE_SCALE && jd->scale) {
+				UINT x, y, r, g, b, s, w, a;
+				BYTE *op;
+
+				/* Get averaged RGB value of each square correcponds to a pixel */
+				s = jd->scale * 2;	/* Bumber of shifts for averaging */
+				w = 1 << jd->scale;	/* Width of square */
+				a = (mx - w) * 3;	/* Bytes to skip for next line in the square */
+				op = (BYTE*)jd->workbuf;
+				for (iy = 0; iy < my; iy += w) {
+					for (ix = 0; ix < mx; ix += w) {
+						rgb24 = (BYTE*)jd->workbuf + (iy * mx + ix) * 3;
+						r = g = b = 0;
+						for (y = 0; y < w; y++) {	/* Accumulate RGB value in the square */
+							for (x = 0; x < w; x++) {
+								r += *rgb24++;
+								g += *rgb24++;
+								b += *rgb24++;
+							}
+							rgb24 += a;
+						}							/* Put the averaged RGB value as a pixel */
+						*op++ = (BYTE)(r >> s);
+						*op++ = (BYTE)(g >> s);
+						*op++ = (BYTE)(b >> s);
+					}
+				}
+			}
+
+		} else {	/* For only 1/8 scaling (left-top pixel in each block are the DC value of the block) */
+
+			/* Build a 1/8 descaled RGB MCU from discrete comopnents */
+			rgb24 = (BYTE*)jd->workbuf;
+			pc = jd->mcubuf + mx * my;
+			cb = pc[0] - 128;		/* Get Cb/Cr component and restore right level */
+			cr = pc[64] - 128;
+			for (iy = 0; iy < my; iy += 8) {
+				py = jd->mcubuf;
+				if (iy == 8) py += 64 * 2;
+				for (ix = 0; ix < mx; ix += 8) {
+					yy = *py;	/* Get Y component */
+					py += 64;
+
+					/* Convert YCbCr to RGB */
+					*rgb24++ = /* R */ BYTECLIP(yy + ((INT)(1.402 * CVACC) * cr / CVACC));
+					*rgb24++ = /* G */ BYTECLIP(yy - ((INT)(0.344 * CVACC) * cb + (INT)(0.714 * CVACC) * cr) / CVACC);
+					*rgb24++ = /* B */ BYTECLIP(yy + ((INT)(1.772 * CVACC) * cb / CVACC));
+				}
 			}
 		}
+
 	}
 
 	/* Squeeze up pixel table if a part of MCU is to be truncated */
 	mx >>= jd->scale;
 	if (rx < mx) {
 		BYTE *s, *d;
-		UINT x, y;
+		UINT x, y, n;
 
+		n = jd->gray ? 1 : 3;	/* Bytes per pixel */
 		s = d = (BYTE*)jd->workbuf;
 		for (y = 0; y < ry; y++) {
-			for (x = 0; x < rx; x++) {	/* Copy effective pixels */
-				*d++ = *s++;
-				*d++ = *s++;
+			for (x = 0; x < rx * n; x++) {	/* Copy effective pixels */
 				*d++ = *s++;
 			}
-			s += (mx - rx) * 3;	/* Skip truncated pixels */
+			s += (mx - rx) * n;	/* Skip truncated pixels */
 		}
 	}
 
 	/* Convert RGB888 to RGB565 if needed */
-	if (JD_FORMAT == 1) {
+	if (jd->format == 1 && !jd->gray) {
 		BYTE *s = (BYTE*)jd->workbuf;
 		WORD w, *d = (WORD*)s;
 		UINT n = rx * ry;
@@ -700,8 +955,30 @@ JRESULT mcu_output (
 		} while (--n);
 	}
 
+	/* Convert RGB888 to big-endian RGB565, the byte order SPI LCDs take, no swap pass is needed afterwards */
+	if (jd->format == 2 && !jd->gray) {
+		BYTE *s = (BYTE*)jd->workbuf;
+		BYTE *d = s;
+		UINT n = rx * ry;
+		BYTE r, g, b;
+
+		do {
+			r = *s++; g = *s++; b = *s++;
+			*d++ = (r & 0xF8) | (g >> 5);			/* RRRRRGGG */
+			*d++ = ((g & 0x1C) << 3) | (b >> 3);	/* GGGBBBBB */
+		} while (--n);
+	}
+
 	/* Output the RGB rectangular */
+#if JD_PROFILE
+	t1 = JD_TICKS();
+	jd->prof[JD_PROF_COLOR] += t1 - t0;
+	rc = outfunc(jd, jd->workbuf, &rect) ? JDR_OK : JDR_INTR;
+	jd->prof[JD_PROF_OUTPUT] += JD_TICKS() - t1;
+	return rc;
+#else
 	return outfunc(jd, jd->workbuf, &rect) ? JDR_OK : JDR_INTR; 
+#endif
 }
 
 
@@ -725,10 +1002,21 @@ JRESULT restart (
 	/* Discard padding bits and get two bytes from the input stream */
 	dp = jd->dptr; dc = jd->dctr;
 	d = 0;
+#if JD_FASTDECODE
+	jd->wreg = 0; jd->dbit = 0;
+	if (jd->marker) {	/* The bit buffer has already read the marker */
+		d = 0xFF00 | jd->marker;
+		jd->marker = 0;
+		i = 2;
+	} else {
+		i = 0;
+	}
+	for ( ; i < 2; i++) {
+#else
 	for (i = 0; i < 2; i++) {
+#endif
 		if (!dc) {	/* No input data is available, re-fill input buffer */
-			dp = jd->inbuf;
-			dc = jd->infunc(jd, dp, JD_SZBUF);
+			dc = refill(jd, &dp);
 			if (!dc) return JDR_INP;
 		} else {
 			dp++;
@@ -778,6 +1066,9 @@ JRESULT jd_prepare (
 	jd->pool = pool;		/* Work memroy */
 	jd->sz_pool = sz_pool;	/* Size of given work memory */
 	jd->infunc = infunc;	/* Stream input function */
+	jd->inref = 0;			/* The stream is copied into inbuf (default) */
+	jd->gray = 0;			/* RGB output (default) */
+	jd->format = JD_FORMAT;	/* Output pixel format (default) */
 	jd->device = dev;		/* I/O device identifier */
 	jd->nrst = 0;			/* No restart interval (default) */
 
@@ -789,6 +1080,12 @@ JRESULT jd_prepare (
 		}
 	}
 	for (i = 0; i < 4; i++) jd->qttbl[i] = 0;
+#if JD_FASTDECODE
+	jd->wreg = 0; jd->dbit = 0; jd->marker = 0;	/* Empty bit buffer */
+#endif
+#if JD_PROFILE
+	for (i = 0; i < 4; i++) jd->prof[i] = 0;
+#endif
 
 	jd->inbuf = seg = alloc_pool(jd, JD_SZBUF);		/* Allocate stream input buffer */
 	if (!seg) return JDR_MEM1;
@@ -934,13 +1231,32 @@ JRESULT jd_decomp (
 	UINT (*outfunc)(JDEC*, void*, JRECT*),	/* RGB output function */
 	BYTE scale								/* Output de-scaling factor (0 to 3) */
 )
+{
+	return jd_decomp_rect(jd, outfunc, scale, 0);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Decompress only the MCUs overlapping a rectangle of the picture       */
+/*-----------------------------------------------------------------------*/
+
+JRESULT jd_decomp_rect (
+	JDEC* jd,								/* Initialized decompression object */
+	UINT (*outfunc)(JDEC*, void*, JRECT*),	/* RGB output function */
+	BYTE scale,								/* Output de-scaling factor (0 to 3) */
+	const JRECT* rect						/* Area of the picture to output in unscaled pixels, 0:whole picture */
+)
 {
 	UINT x, y, mx, my;
 	WORD rst, rsc;
+	BYTE skip;
 	JRESULT rc;
 
 
 	if (scale > (JD_USE_SCALE ? 3 : 0)) return JDR_PAR;
+	if (rect && (rect->left > rect->right || rect->top > rect->bottom)) return JDR_PAR;
 	jd->scale = scale;
 
 	mx = jd->msx * 8; my = jd->msy * 8;			/* Size of the MCU (pixel) */
@@ -950,14 +1266,18 @@ JRESULT jd_decomp (
 
 	rc = JDR_OK;
 	for (y = 0; y < jd->height; y += my) {		/* Vertical loop of MCUs */
+		if (rect && y > rect->bottom) break;	/* The rest of the picture is below the rectangle */
 		for (x = 0; x < jd->width; x += mx) {	/* Horizontal loop of MCUs */
 			if (jd->nrst && rst++ == jd->nrst) {	/* Process restart interval if enabled */
 				rc = restart(jd, rsc++);
 				if (rc != JDR_OK) return rc;
 				rst = 1;
 			}
-			rc = mcu_load(jd);					/* Load an MCU (decompress huffman coded stream and apply IDCT) */
+			/* MCUs outside the rectangle are entropy decoded only, the DC prediction runs across them */
+			skip = rect && (x + mx <= rect->left || x > rect->right || y + my <= rect->top);
+			rc = mcu_load(jd, skip);			/* Load an MCU (decompress huffman coded stream and apply IDCT) */
 			if (rc != JDR_OK) return rc;
+			if (skip) continue;
 			rc = mcu_output(jd, outfunc, x, y);	/* Output the MCU (color space conversion, scaling and output) */
 			if (rc != JDR_OK) return rc;
 		}
@@ -965,6 +1285,65 @@ JRESULT jd_decomp (
 
 	return rc;
 }
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Decompress a run of restart intervals                                 */
+/*-----------------------------------------------------------------------*/
+/* The input function has to deliver the stream from the first byte of the
+/  entropy coded data of restart interval (mcu / nrst), i.e. just behind the
+/  RSTn marker in front of it. As the DC prediction is reset at every
+/  interval, separate decompressor objects can decode disjoint runs of one
+/  picture in parallel. */
+
+JRESULT jd_decomp_seg (
+	JDEC* jd,								/* Initialized decompression object */
+	UINT (*outfunc)(JDEC*, void*, JRECT*),	/* RGB output function */
+	BYTE scale,								/* Output de-scaling factor (0 to 3) */
+	UINT mcu,								/* First MCU to decompress, a multiple of the restart interval */
+	UINT nmcu								/* Number of MCUs to decompress */
+)
+{
+	UINT mx, my, mcol, end;
+	WORD rst, rsc;
+	JRESULT rc;
+
+
+	if (scale > (JD_USE_SCALE ? 3 : 0)) return JDR_PAR;
+	if (!jd->nrst || mcu % jd->nrst) return JDR_PAR;	/* Err: the run does not start at a restart interval */
+	jd->scale = scale;
+
+	mx = jd->msx * 8; my = jd->msy * 8;			/* Size of the MCU (pixel) */
+	mcol = (jd->width + mx - 1) / mx;			/* Number of MCUs in a row */
+	end = mcol * ((jd->height + my - 1) / my);	/* Number of MCUs in the picture */
+	if (!nmcu || mcu >= end || nmcu > end - mcu) return JDR_PAR;
+	end = mcu + nmcu;
+
+	/* Discard the buffered stream, the input function has been moved to the interval */
+	jd->dptr = jd->inbuf; jd->dctr = 0; jd->dmsk = 0;
+#if JD_FASTDECODE
+	jd->wreg = 0; jd->dbit = 0; jd->marker = 0;
+#endif
+	jd->dcv[2] = jd->dcv[1] = jd->dcv[0] = 0;	/* Initialize DC values */
+	rst = 0; rsc = (WORD)(mcu / jd->nrst);		/* The next marker is RSTn of this interval */
+
+	rc = JDR_OK;
+	for ( ; mcu < end; mcu++) {
+		if (rst++ == jd->nrst) {				/* Process restart interval */
+			rc = restart(jd, rsc++);
+			if (rc != JDR_OK) return rc;
+			rst = 1;
+		}
+		rc = mcu_load(jd, 0);					/* Load an MCU (decompress huffman coded stream and apply IDCT) */
+		if (rc != JDR_OK) return rc;
+		rc = mcu_output(jd, outfunc, mcu % mcol * mx, mcu / mcol * my);	/* Output the MCU (color space conversion, scaling and output) */
+		if (rc != JDR_OK) return rc;
+	}
+
+	return rc;
+}
 #endif//SUPPORT_JPEG
 
 
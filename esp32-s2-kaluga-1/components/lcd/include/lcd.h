@@ -31,8 +31,23 @@ typedef struct {
     uint8_t pin_bk;
     uint8_t horizontal;
     uint32_t max_buffer_size; // DMA used
+    uint32_t task_stack;      /*!< Stack of the transfer task, 0 for the default */
+    uint8_t task_pri;         /*!< Priority of the transfer task, 0 for the default */
+    uint8_t trans_queue_depth; /*!< Async transfers that can be queued, 0 for the default */
 } lcd_config_t;
 
+typedef struct {
+    uint64_t bounce_bytes;    /*!< Bytes copied through the internal DMA buffer, the source is not DMA capable */
+    uint64_t direct_bytes;    /*!< Bytes sent by the DMA straight from the caller's buffer */
+} lcd_dma_stats_t;
+
+/**
+ * @brief Called from the transfer task once an async transfer is shifted out
+ *
+ * @param ctx ctx passed to lcd_write_data_async
+ */
+typedef void (*lcd_trans_cb_t)(void *ctx);
+
 /**
  * @brief  lcd restart
  */
@@ -46,6 +61,36 @@ void lcd_rst();
  */
 void lcd_write_data(uint8_t *data, size_t len);
 
+/**
+ * @brief Queue data for the LCD and return without waiting for it to be sent
+ *
+ * Blocks only while the transfer queue is full. The data must stay valid until cb is called.
+ * Synchronous calls such as lcd_write_data and lcd_set_index wait for the queued transfers first.
+ *
+ * @param data spi data
+ * @param len len of data
+ * @param cb called once the data is sent, NULL if not needed
+ * @param ctx argument of cb
+ *
+ * @return - 0 success
+ *         - -1 len is 0
+ */
+int lcd_write_data_async(uint8_t *data, size_t len, lcd_trans_cb_t cb, void *ctx);
+
+/**
+ * @brief Wait until all the queued async transfers are sent
+ */
+void lcd_wait_idle();
+
+/**
+ * @brief Get how many bytes were sent with and without the bounce buffer
+ *
+ * Word aligned data in DMA capable memory is sent in place, anything else, e.g. PSRAM, is copied first.
+ *
+ * @param stats Filled with the counters since lcd_init
+ */
+void lcd_get_dma_stats(lcd_dma_stats_t *stats);
+
 /**
  * @brief set lcd address from start to end
  *
@@ -0,0 +1,134 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LCD_FB_DIRTY_MAX_NUM (16) /*!< Dirty rectangles tracked before the closest ones are merged */
+
+typedef struct lcd_fb *lcd_fb_handle_t;
+
+typedef struct {
+    uint16_t x_start;
+    uint16_t y_start;
+    uint16_t x_end;           /*!< Inclusive, as in lcd_set_index */
+    uint16_t y_end;           /*!< Inclusive, as in lcd_set_index */
+} lcd_fb_rect_t;
+
+typedef struct {
+    uint32_t flush_num;       /*!< Calls of lcd_fb_flush that sent something */
+    uint32_t rect_num;        /*!< Rectangles sent */
+    uint64_t sent_bytes;      /*!< Pixel bytes sent, without the address commands */
+} lcd_fb_stats_t;
+
+/**
+ * @brief Create a framebuffer of the screen size
+ *
+ * Pixels are RGB565 in the byte order of the LCD. The framebuffer is put in PSRAM if there is some.
+ *
+ * @param width     Screen width
+ * @param height    Screen height
+ * @param band_size Bytes of the DMA capable buffer that packs the rows of narrow rectangles
+ *
+ * @return - framebuffer handle, NULL on allocation failure
+ */
+lcd_fb_handle_t lcd_fb_create(uint16_t width, uint16_t height, size_t band_size);
+
+/**
+ * @brief Delete a framebuffer
+ *
+ * @param fb Framebuffer handle
+ */
+void lcd_fb_delete(lcd_fb_handle_t fb);
+
+/**
+ * @brief Get the pixels of the framebuffer, width * height pixels, row by row
+ *
+ * Call lcd_fb_mark_dirty for the areas changed through this pointer.
+ *
+ * @param fb Framebuffer handle
+ *
+ * @return - framebuffer pixels
+ */
+uint16_t *lcd_fb_get_buffer(lcd_fb_handle_t fb);
+
+/**
+ * @brief Mark an area to be sent on the next flush
+ *
+ * Overlapping and adjacent rectangles are merged. Once LCD_FB_DIRTY_MAX_NUM are tracked,
+ * the new one is merged with the rectangle whose bounding box grows the least.
+ *
+ * @param fb      Framebuffer handle
+ * @param x_start start address of x
+ * @param y_start start address of y
+ * @param x_end   end address of x, inclusive
+ * @param y_end   end address of y, inclusive
+ *
+ * @return - 0 success
+ *         - -1 the area is empty or off the screen
+ */
+int lcd_fb_mark_dirty(lcd_fb_handle_t fb, uint16_t x_start, uint16_t y_start, uint16_t x_end, uint16_t y_end);
+
+/**
+ * @brief Copy pixels to the framebuffer and mark them dirty
+ *
+ * @param fb     Framebuffer handle
+ * @param x      Left of the area
+ * @param y      Top of the area
+ * @param w      Width of the area
+ * @param h      Height of the area
+ * @param pixels w * h pixels, row by row, clipped to the screen
+ *
+ * @return - 0 success
+ *         - -1 the area is empty or off the screen
+ */
+int lcd_fb_draw_bitmap(lcd_fb_handle_t fb, uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t *pixels);
+
+/**
+ * @brief Get the dirty rectangles the next flush would send
+ *
+ * @param fb   Framebuffer handle
+ * @param rect Filled with up to max_num rectangles
+ * @param max_num Size of rect
+ *
+ * @return - number of dirty rectangles
+ */
+int lcd_fb_get_dirty(lcd_fb_handle_t fb, lcd_fb_rect_t *rect, int max_num);
+
+/**
+ * @brief Send the dirty rectangles through lcd_set_index and clear them
+ *
+ * @param fb Framebuffer handle
+ *
+ * @return - pixel bytes sent
+ */
+size_t lcd_fb_flush(lcd_fb_handle_t fb);
+
+/**
+ * @brief Get the flush counters
+ *
+ * @param fb    Framebuffer handle
+ * @param stats Filled with the counters since lcd_fb_create
+ */
+void lcd_fb_get_stats(lcd_fb_handle_t fb, lcd_fb_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -13,35 +13,59 @@
 // limitations under the License.
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "esp_heap_caps.h"
 #include "esp32s2/rom/lldesc.h"
 #include "soc/system_reg.h"
+#include "soc/soc_memory_layout.h"
 #include "esp_log.h"
 #include "lcd.h"
+#include "dma_plan.h"
 
 static const char *TAG = "lcd";
 
 #define LCD_DMA_MAX_SIZE     (4095)
+#define LCD_TASK_STACK       (2048)
+#define LCD_TASK_PRI         (configMAX_PRIORITIES - 1)
+#define LCD_TRANS_QUEUE_DEPTH (4)
+#define LCD_DIRECT_NODE_CNT  (16)   /*!< Two halves, one is sent while the other is linked */
+#define LCD_DIRECT_NODE_SIZE (4092) /*!< Word aligned, so every node but the last starts aligned */
 
 typedef struct {
+    uint8_t *data;
+    size_t len;
+    uint8_t dc;
+    lcd_trans_cb_t cb;
+    void *ctx;
+} lcd_trans_t;
+
+typedef struct {
+    dma_plan_t plan;
     uint32_t buffer_size;
     uint32_t half_buffer_size;
     uint32_t node_cnt;
     uint32_t half_node_cnt;
-    uint32_t dma_size;
     uint8_t horizontal;
-    uint8_t dc_state;
     uint8_t pin_dc;
     uint8_t pin_cs;
     uint8_t pin_rst;
     uint8_t pin_bk;
     lldesc_t *dma;
     uint8_t *buffer;
+    lldesc_t *direct_dma;        /*!< Linked over the caller's buffer, no bounce buffer */
+    uint64_t bounce_bytes;
+    uint64_t direct_bytes;
+    portMUX_TYPE stats_lock;     /*!< The 64 bit counters take two stores, lcd_task and the writers both update them */
     QueueHandle_t event_queue;
+    QueueHandle_t trans_queue;
+    SemaphoreHandle_t idle_sem;
+    atomic_uint trans_pending;   /*!< Queued data transfers not completed yet, lcd_task and the writers both touch it */
+    TaskHandle_t task_handle;
 } lcd_obj_t;
 
 static lcd_obj_t *lcd_obj = NULL;
@@ -81,18 +105,72 @@ static void IRAM_ATTR lcd_isr(void *arg)
     }
 }
 
-static void spi_write_data(uint8_t *data, size_t len)
+/*!< The DMA reads the caller's buffer in place, each transfer covers up to half of the direct nodes */
+static void spi_write_direct(uint8_t *data, size_t len)
+{
+    int event  = 0;
+    int x = 0, cnt = 0, size = 0;
+    lldesc_t *dma = NULL;
+
+    /*!< Start the signal */
+    xQueueSend(lcd_obj->event_queue, &event, 0);
+
+    for (x = 0; len; x++) {
+        dma = &lcd_obj->direct_dma[(x % 2) * (LCD_DIRECT_NODE_CNT / 2)];
+
+        /*!< Link the next transfer while the previous one is still running on the other half */
+        for (cnt = 0, size = 0; cnt < LCD_DIRECT_NODE_CNT / 2 && len; cnt++) {
+            uint32_t node_size = len > LCD_DIRECT_NODE_SIZE ? LCD_DIRECT_NODE_SIZE : len;
+            dma[cnt].size = node_size;
+            dma[cnt].length = node_size;
+            dma[cnt].buf = data;
+            dma[cnt].eof = 0;
+            dma[cnt].owner = 1;
+            dma[cnt].empty = (uint32_t)&dma[cnt + 1];
+            data += node_size;
+            len -= node_size;
+            size += node_size;
+        }
+
+        dma[cnt - 1].eof = 1;
+        dma[cnt - 1].empty = 0;
+        xQueueReceive(lcd_obj->event_queue, (void *)&event, portMAX_DELAY);
+        GPSPI3.mosi_dlen.usr_mosi_bit_len = size * 8 - 1;
+        GPSPI3.dma_out_link.addr = ((uint32_t)dma) & 0xfffff;
+        GPSPI3.dma_out_link.start = 1;
+        ets_delay_us(1);
+        GPSPI3.cmd.usr = 1;
+    }
+
+    xQueueReceive(lcd_obj->event_queue, (void *)&event, portMAX_DELAY);
+}
+
+static void spi_write_data(uint8_t *data, size_t len, uint8_t dc)
 {
     int event  = 0;
     int x = 0, cnt = 0, size = 0;
     int end_pos = 0;
-    lcd_set_dc(lcd_obj->dc_state);
+    lcd_set_dc(dc);
+
+    /*!< Only the bytes the DMA cannot reach go through the bounce buffer */
+    if (lcd_obj->direct_dma && esp_ptr_dma_capable(data) && ((uint32_t)data & 0x3) == 0) {
+        portENTER_CRITICAL(&lcd_obj->stats_lock);
+        lcd_obj->direct_bytes += len;
+        portEXIT_CRITICAL(&lcd_obj->stats_lock);
+        spi_write_direct(data, len);
+        return;
+    }
+
+    portENTER_CRITICAL(&lcd_obj->stats_lock);
+    lcd_obj->bounce_bytes += len;
+    portEXIT_CRITICAL(&lcd_obj->stats_lock);
 
     /*!< Generate a data DMA linked list */
     for (x = 0; x < lcd_obj->node_cnt; x++) {
-        lcd_obj->dma[x].size = lcd_obj->dma_size;
-        lcd_obj->dma[x].length = lcd_obj->dma_size;
-        lcd_obj->dma[x].buf = (lcd_obj->buffer + lcd_obj->dma_size * x);
+        size = dma_plan_node_size(&lcd_obj->plan, x);
+        lcd_obj->dma[x].size = size;
+        lcd_obj->dma[x].length = size;
+        lcd_obj->dma[x].buf = (lcd_obj->buffer + dma_plan_node_offset(&lcd_obj->plan, x));
         lcd_obj->dma[x].eof = !((x + 1) % lcd_obj->half_node_cnt);
         lcd_obj->dma[x].empty = (uint32_t)&lcd_obj->dma[(x + 1) % lcd_obj->node_cnt];
     }
@@ -121,14 +199,10 @@ static void spi_write_data(uint8_t *data, size_t len)
     if (cnt) {
         memcpy((uint8_t *)lcd_obj->dma[(x % 2) * lcd_obj->half_node_cnt].buf, data, cnt);
 
-        /*!< Handle the case where the data length is an integer multiple of lcd_obj->dma_size */
-        if (cnt % lcd_obj->dma_size) {
-            end_pos = (x % 2) * lcd_obj->half_node_cnt + cnt / lcd_obj->dma_size;
-            size = cnt % lcd_obj->dma_size;
-        } else {
-            end_pos = (x % 2) * lcd_obj->half_node_cnt + cnt / lcd_obj->dma_size - 1;
-            size = lcd_obj->dma_size;
-        }
+        /*!< Find the node holding the last byte, every node before it is full size */
+        end_pos = (cnt - 1) / lcd_obj->plan.node_size;
+        size = cnt - end_pos * lcd_obj->plan.node_size;
+        end_pos += (x % 2) * lcd_obj->half_node_cnt;
 
         /*!< Handle the tail node to make it a DMA tail */
         lcd_obj->dma[end_pos].size = size;
@@ -151,16 +225,58 @@ static void lcd_delay_ms(uint32_t time)
     vTaskDelay(time / portTICK_RATE_MS);
 }
 
+/*!< Shift the queued transfers out in order, the writers only wait when the queue is full */
+static void lcd_task(void *arg)
+{
+    lcd_trans_t trans;
+
+    while (1) {
+        xQueueReceive(lcd_obj->trans_queue, (void *)&trans, portMAX_DELAY);
+
+        if (trans.len) {
+            spi_write_data(trans.data, trans.len, trans.dc);
+        }
+
+        if (trans.cb) {
+            trans.cb(trans.ctx);
+        }
+
+        if (trans.len) {
+            atomic_fetch_sub(&lcd_obj->trans_pending, 1);
+        }
+    }
+}
+
+static void lcd_idle_cb(void *ctx)
+{
+    xSemaphoreGive(lcd_obj->idle_sem);
+}
+
+void lcd_wait_idle()
+{
+    if (atomic_load(&lcd_obj->trans_pending) == 0) {
+        return;
+    }
+
+    /*!< An empty transfer behind the queued ones, it completes once they all did */
+    lcd_trans_t trans = {
+        .cb = lcd_idle_cb,
+    };
+
+    xQueueSend(lcd_obj->trans_queue, (void *)&trans, portMAX_DELAY);
+    xSemaphoreTake(lcd_obj->idle_sem, portMAX_DELAY);
+}
+
 static void lcd_write_cmd(uint8_t data)
 {
-    lcd_obj->dc_state = 0;
-    spi_write_data(&data, 1);
+    lcd_wait_idle();
+    spi_write_data(&data, 1, 0);
 }
 
 static void lcd_write_byte(uint8_t data)
 {
-    lcd_obj->dc_state = 1;
-    spi_write_data(&data, 1);
+    lcd_wait_idle();
+    spi_write_data(&data, 1, 1);
 }
 
 void lcd_write_data(uint8_t *data, size_t len)
@@ -169,8 +285,28 @@ void lcd_write_data(uint8_t *data, size_t len)
         return;
     }
 
-    lcd_obj->dc_state = 1;
-    spi_write_data(data, len);
+    lcd_wait_idle();
+    spi_write_data(data, len, 1);
+}
+
+int lcd_write_data_async(uint8_t *data, size_t len, lcd_trans_cb_t cb, void *ctx)
+{
+    if (len <= 0) {
+        return -1;
+    }
+
+    lcd_trans_t trans = {
+        .data = data,
+        .len = len,
+        .dc = 1,
+        .cb = cb,
+        .ctx = ctx,
+    };
+
+    atomic_fetch_add(&lcd_obj->trans_pending, 1);
+    xQueueSend(lcd_obj->trans_queue, (void *)&trans, portMAX_DELAY);
+
+    return 0;
 }
 
 void lcd_rst()
@@ -549,32 +685,49 @@ static void lcd_set_pin(lcd_config_t *config)
 
 void lcd_dma_config(lcd_config_t *config)
 {
-    int cnt = 0;
+    dma_plan_calc(&lcd_obj->plan, 0, config->max_buffer_size, LCD_DMA_MAX_SIZE); /*!< Writes have no fixed size, stream through the whole buffer */
 
-    if (config->max_buffer_size >= LCD_DMA_MAX_SIZE * 2) {
-        lcd_obj->dma_size = LCD_DMA_MAX_SIZE;
+    lcd_obj->buffer_size = lcd_obj->plan.buffer_size;
+    lcd_obj->half_buffer_size = lcd_obj->plan.chunk_size;
 
-        for (cnt = 0;; cnt++) { /*!< Find the buffer size that is divisible by dma_size */
-            if ((config->max_buffer_size - cnt) % lcd_obj->dma_size == 0) {
-                break;
-            }
-        }
+    lcd_obj->node_cnt = lcd_obj->plan.node_cnt; /*!< Number of DMA nodes */
+    lcd_obj->half_node_cnt = lcd_obj->plan.chunk_node_cnt;
 
-        lcd_obj->buffer_size = config->max_buffer_size - cnt;
-    } else {
-        lcd_obj->dma_size = config->max_buffer_size / 2;
-        lcd_obj->buffer_size = lcd_obj->dma_size * 2;
-    }
+    ESP_LOGI(TAG, "lcd_buffer_size: %d, lcd_dma_size: %d, lcd_dma_node_cnt: %d\n", lcd_obj->buffer_size, lcd_obj->plan.node_size, lcd_obj->node_cnt);
 
-    lcd_obj->half_buffer_size = lcd_obj->buffer_size / 2;
+    lcd_obj->dma    = (lldesc_t *)heap_caps_malloc(lcd_obj->node_cnt * sizeof(lldesc_t), MALLOC_CAP_DMA);
+    lcd_obj->buffer = (uint8_t *)heap_caps_malloc(lcd_obj->buffer_size * sizeof(uint8_t), MALLOC_CAP_DMA);
+    lcd_obj->direct_dma = (lldesc_t *)heap_caps_calloc(LCD_DIRECT_NODE_CNT, sizeof(lldesc_t), MALLOC_CAP_DMA); /*!< Optional, every write bounces without it */
+}
 
-    lcd_obj->node_cnt = (lcd_obj->buffer_size) / lcd_obj->dma_size; /*!< Number of DMA nodes */
-    lcd_obj->half_node_cnt = lcd_obj->node_cnt / 2;
+void lcd_get_dma_stats(lcd_dma_stats_t *stats)
+{
+    portENTER_CRITICAL(&lcd_obj->stats_lock);
+    stats->bounce_bytes = lcd_obj->bounce_bytes;
+    stats->direct_bytes = lcd_obj->direct_bytes;
+    portEXIT_CRITICAL(&lcd_obj->stats_lock);
+}
 
-    ESP_LOGI(TAG, "lcd_buffer_size: %d, lcd_dma_size: %d, lcd_dma_node_cnt: %d\n", lcd_obj->buffer_size, lcd_obj->dma_size, lcd_obj->node_cnt);
+/*!< Release what lcd_init allocated before it failed, any part may be missing */
+static void lcd_obj_free(void)
+{
+    if (lcd_obj->event_queue) {
+        vQueueDelete(lcd_obj->event_queue);
+    }
 
-    lcd_obj->dma    = (lldesc_t *)heap_caps_malloc(lcd_obj->node_cnt * sizeof(lldesc_t), MALLOC_CAP_DMA);
-    lcd_obj->buffer = (uint8_t *)heap_caps_malloc(lcd_obj->buffer_size * sizeof(uint8_t), MALLOC_CAP_DMA);
+    if (lcd_obj->trans_queue) {
+        vQueueDelete(lcd_obj->trans_queue);
+    }
+
+    if (lcd_obj->idle_sem) {
+        vSemaphoreDelete(lcd_obj->idle_sem);
+    }
+
+    free(lcd_obj->direct_dma);
+    free(lcd_obj->buffer);
+    free(lcd_obj->dma);
+    free(lcd_obj);
+    lcd_obj = NULL;
 }
 
 int lcd_init(lcd_config_t *config)
@@ -586,13 +739,37 @@ int lcd_init(lcd_config_t *config)
         return -1;
     }
 
-    lcd_set_pin(config);
-    lcd_config(config);
-    lcd_dma_config(config);
+    vPortCPUInitializeMutex(&lcd_obj->stats_lock);
+    atomic_init(&lcd_obj->trans_pending, 0);
 
+    /*!< Allocate everything before the pins and the interrupt are set up, a failure then only has memory to free */
+    lcd_dma_config(config);
     lcd_obj->event_queue = xQueueCreate(1, sizeof(int));
+    lcd_obj->trans_queue = xQueueCreate(config->trans_queue_depth ? config->trans_queue_depth : LCD_TRANS_QUEUE_DEPTH, sizeof(lcd_trans_t));
+    lcd_obj->idle_sem = xSemaphoreCreateBinary();
 
-    lcd_obj->buffer_size = config->max_buffer_size;
+    if (!lcd_obj->dma || !lcd_obj->buffer) {
+        ESP_LOGE(TAG, "lcd dma malloc error");
+        lcd_obj_free();
+        return -1;
+    }
+
+    if (!lcd_obj->event_queue || !lcd_obj->trans_queue || !lcd_obj->idle_sem) {
+        ESP_LOGE(TAG, "lcd queue create error");
+        lcd_obj_free();
+        return -1;
+    }
+
+    /*!< Without lcd_task every async write and lcd_wait_idle would block forever */
+    if (xTaskCreate(lcd_task, "lcd_task", config->task_stack ? config->task_stack : LCD_TASK_STACK, NULL,
+                    config->task_pri ? config->task_pri : LCD_TASK_PRI, &lcd_obj->task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "lcd task create error");
+        lcd_obj_free();
+        return -1;
+    }
+
+    lcd_set_pin(config);
+    lcd_config(config);
 
     lcd_obj->pin_dc = config->pin_dc;
     lcd_obj->pin_cs = config->pin_cs;
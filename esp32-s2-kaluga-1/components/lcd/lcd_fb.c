@@ -0,0 +1,258 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "lcd.h"
+#include "lcd_fb.h"
+
+static const char *TAG = "lcd_fb";
+
+struct lcd_fb {
+    uint16_t width;
+    uint16_t height;
+    uint16_t *buffer;
+    uint8_t *band;            /*!< Rows of a narrow rectangle are packed here, the screen rows are not contiguous */
+    size_t band_size;
+    lcd_fb_rect_t dirty[LCD_FB_DIRTY_MAX_NUM];
+    int dirty_num;
+    lcd_fb_stats_t stats;
+};
+
+#define LCD_FB_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define LCD_FB_MAX(a, b) ((a) > (b) ? (a) : (b))
+
+static uint32_t lcd_fb_rect_area(const lcd_fb_rect_t *rect)
+{
+    return (uint32_t)(rect->x_end - rect->x_start + 1) * (rect->y_end - rect->y_start + 1);
+}
+
+/*!< Overlapping or sharing an edge, their bounding box then covers nothing clean in between */
+static int lcd_fb_rect_touch(const lcd_fb_rect_t *a, const lcd_fb_rect_t *b)
+{
+    return a->x_start <= b->x_end + 1 && b->x_start <= a->x_end + 1 &&
+           a->y_start <= b->y_end + 1 && b->y_start <= a->y_end + 1;
+}
+
+static void lcd_fb_rect_union(lcd_fb_rect_t *a, const lcd_fb_rect_t *b)
+{
+    a->x_start = LCD_FB_MIN(a->x_start, b->x_start);
+    a->y_start = LCD_FB_MIN(a->y_start, b->y_start);
+    a->x_end = LCD_FB_MAX(a->x_end, b->x_end);
+    a->y_end = LCD_FB_MAX(a->y_end, b->y_end);
+}
+
+static void lcd_fb_dirty_remove(lcd_fb_handle_t fb, int index)
+{
+    fb->dirty[index] = fb->dirty[--fb->dirty_num];
+}
+
+/*!< Absorb every rectangle touching dirty[index], a grown rectangle may touch new ones so repeat until stable */
+static void lcd_fb_dirty_absorb(lcd_fb_handle_t fb, int index)
+{
+    int merged = 1;
+
+    while (merged) {
+        merged = 0;
+
+        for (int x = 0; x < fb->dirty_num; x++) {
+            if (x != index && lcd_fb_rect_touch(&fb->dirty[index], &fb->dirty[x])) {
+                lcd_fb_rect_union(&fb->dirty[index], &fb->dirty[x]);
+                lcd_fb_dirty_remove(fb, x);
+
+                if (index == fb->dirty_num) { /*!< dirty[index] was the last one, it moved to x */
+                    index = x;
+                }
+
+                merged = 1;
+                break;
+            }
+        }
+    }
+}
+
+static void lcd_fb_dirty_add(lcd_fb_handle_t fb, const lcd_fb_rect_t *rect)
+{
+    int index = -1;
+
+    for (int x = 0; x < fb->dirty_num; x++) {
+        if (lcd_fb_rect_touch(&fb->dirty[x], rect)) {
+            index = x;
+            break;
+        }
+    }
+
+    if (index < 0 && fb->dirty_num == LCD_FB_DIRTY_MAX_NUM) {
+        uint32_t min_growth = UINT32_MAX;
+
+        /*!< Full, merge with the rectangle whose bounding box grows the least */
+        for (int x = 0; x < fb->dirty_num; x++) {
+            lcd_fb_rect_t box = fb->dirty[x];
+            lcd_fb_rect_union(&box, rect);
+            uint32_t growth = lcd_fb_rect_area(&box) - lcd_fb_rect_area(&fb->dirty[x]);
+
+            if (growth < min_growth) {
+                min_growth = growth;
+                index = x;
+            }
+        }
+    }
+
+    if (index < 0) {
+        fb->dirty[fb->dirty_num++] = *rect;
+        return;
+    }
+
+    lcd_fb_rect_union(&fb->dirty[index], rect);
+    lcd_fb_dirty_absorb(fb, index);
+}
+
+lcd_fb_handle_t lcd_fb_create(uint16_t width, uint16_t height, size_t band_size)
+{
+    if (width == 0 || height == 0 || band_size < width * sizeof(uint16_t)) {
+        ESP_LOGE(TAG, "band_size must hold one row\n");
+        return NULL;
+    }
+
+    lcd_fb_handle_t fb = (lcd_fb_handle_t)calloc(1, sizeof(struct lcd_fb));
+
+    if (!fb) {
+        return NULL;
+    }
+
+    fb->width = width;
+    fb->height = height;
+    fb->band_size = band_size & ~3;
+    fb->buffer = (uint16_t *)heap_caps_calloc(width * height, sizeof(uint16_t), MALLOC_CAP_SPIRAM);
+
+    if (!fb->buffer) {
+        fb->buffer = (uint16_t *)heap_caps_calloc(width * height, sizeof(uint16_t), MALLOC_CAP_8BIT);
+    }
+
+    fb->band = (uint8_t *)heap_caps_malloc(fb->band_size, MALLOC_CAP_DMA); /*!< Sent in place, see lcd_get_dma_stats */
+
+    if (!fb->buffer || !fb->band) {
+        ESP_LOGE(TAG, "framebuffer malloc error\n");
+        lcd_fb_delete(fb);
+        return NULL;
+    }
+
+    return fb;
+}
+
+void lcd_fb_delete(lcd_fb_handle_t fb)
+{
+    if (!fb) {
+        return;
+    }
+
+    free(fb->buffer);
+    free(fb->band);
+    free(fb);
+}
+
+uint16_t *lcd_fb_get_buffer(lcd_fb_handle_t fb)
+{
+    return fb->buffer;
+}
+
+int lcd_fb_mark_dirty(lcd_fb_handle_t fb, uint16_t x_start, uint16_t y_start, uint16_t x_end, uint16_t y_end)
+{
+    if (x_start > x_end || y_start > y_end || x_start >= fb->width || y_start >= fb->height) {
+        return -1;
+    }
+
+    lcd_fb_rect_t rect = {
+        .x_start = x_start,
+        .y_start = y_start,
+        .x_end = LCD_FB_MIN(x_end, fb->width - 1),
+        .y_end = LCD_FB_MIN(y_end, fb->height - 1),
+    };
+
+    lcd_fb_dirty_add(fb, &rect);
+
+    return 0;
+}
+
+int lcd_fb_draw_bitmap(lcd_fb_handle_t fb, uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t *pixels)
+{
+    if (w == 0 || h == 0 || x >= fb->width || y >= fb->height) {
+        return -1;
+    }
+
+    uint16_t copy_w = LCD_FB_MIN(w, fb->width - x);
+    uint16_t copy_h = LCD_FB_MIN(h, fb->height - y);
+
+    for (int row = 0; row < copy_h; row++) {
+        memcpy(&fb->buffer[(y + row) * fb->width + x], &pixels[row * w], copy_w * sizeof(uint16_t));
+    }
+
+    return lcd_fb_mark_dirty(fb, x, y, x + copy_w - 1, y + copy_h - 1);
+}
+
+int lcd_fb_get_dirty(lcd_fb_handle_t fb, lcd_fb_rect_t *rect, int max_num)
+{
+    int num = LCD_FB_MIN(fb->dirty_num, max_num);
+
+    memcpy(rect, fb->dirty, num * sizeof(lcd_fb_rect_t));
+
+    return fb->dirty_num;
+}
+
+size_t lcd_fb_flush(lcd_fb_handle_t fb)
+{
+    size_t sent = 0;
+
+    for (int x = 0; x < fb->dirty_num; x++) {
+        lcd_fb_rect_t *rect = &fb->dirty[x];
+        uint32_t row_size = (rect->x_end - rect->x_start + 1) * sizeof(uint16_t);
+        uint32_t band_rows = fb->band_size / row_size;
+
+        lcd_set_index(rect->x_start, rect->y_start, rect->x_end, rect->y_end);
+
+        if (rect->x_start == 0 && rect->x_end == fb->width - 1) { /*!< Full rows are contiguous in the framebuffer */
+            lcd_write_data((uint8_t *)&fb->buffer[rect->y_start * fb->width], row_size * (rect->y_end - rect->y_start + 1));
+        } else {
+            for (int y = rect->y_start; y <= rect->y_end; y += band_rows) {
+                uint32_t rows = LCD_FB_MIN(band_rows, rect->y_end - y + 1);
+
+                for (int row = 0; row < rows; row++) {
+                    memcpy(&fb->band[row * row_size], &fb->buffer[(y + row) * fb->width + rect->x_start], row_size);
+                }
+
+                lcd_write_data(fb->band, rows * row_size);
+            }
+        }
+
+        sent += row_size * (rect->y_end - rect->y_start + 1);
+    }
+
+    if (fb->dirty_num) {
+        fb->stats.flush_num++;
+        fb->stats.rect_num += fb->dirty_num;
+        fb->stats.sent_bytes += sent;
+    }
+
+    fb->dirty_num = 0;
+
+    return sent;
+}
+
+void lcd_fb_get_stats(lcd_fb_handle_t fb, lcd_fb_stats_t *stats)
+{
+    *stats = fb->stats;
+}
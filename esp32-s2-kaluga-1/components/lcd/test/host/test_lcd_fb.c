@@ -0,0 +1,267 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*!< Dirty rectangle merging and flushing of lcd_fb against a panel model: the merged rectangles must cover every
+ *   marked pixel and never touch each other, and a flush must leave the panel equal to the framebuffer while
+ *   sending exactly the bytes it reports */
+
+#include <stdio.h>
+#include <string.h>
+#include "host_test.h"
+#include "lcd.h"
+#include "lcd_fb.h"
+
+#define TEST_WIDTH     (320)
+#define TEST_HEIGHT    (240)
+#define TEST_BAND_SIZE (2048)
+
+/*!< The panel as the ST7789 sees it: a window set by lcd_set_index, filled row by row from its top left */
+static struct {
+    uint16_t pixels[TEST_WIDTH * TEST_HEIGHT];
+    lcd_fb_rect_t window;
+    uint32_t cursor;          /*!< Pixels written into the window */
+    uint32_t index_num;
+    uint32_t write_num;
+    uint64_t write_bytes;
+} panel;
+
+void lcd_set_index(uint16_t x_start, uint16_t y_start, uint16_t x_end, uint16_t y_end)
+{
+    HOST_CHECK(x_start <= x_end && x_end < TEST_WIDTH && y_start <= y_end && y_end < TEST_HEIGHT);
+    HOST_CHECK(panel.cursor == 0 || panel.cursor == (uint32_t)(panel.window.x_end - panel.window.x_start + 1) *
+               (panel.window.y_end - panel.window.y_start + 1)); /*!< The window before was filled exactly */
+    panel.window = (lcd_fb_rect_t) {
+        x_start, y_start, x_end, y_end
+    };
+    panel.cursor = 0;
+    panel.index_num++;
+}
+
+void lcd_write_data(uint8_t *data, size_t len)
+{
+    uint32_t width = panel.window.x_end - panel.window.x_start + 1;
+    uint32_t area = width * (panel.window.y_end - panel.window.y_start + 1);
+
+    HOST_CHECK(len % sizeof(uint16_t) == 0);
+    HOST_CHECK(panel.cursor + len / sizeof(uint16_t) <= area);
+
+    for (size_t x = 0; x < len / sizeof(uint16_t); x++, panel.cursor++) {
+        uint32_t px = panel.window.x_start + panel.cursor % width;
+        uint32_t py = panel.window.y_start + panel.cursor / width;
+
+        memcpy(&panel.pixels[py * TEST_WIDTH + px], data + x * sizeof(uint16_t), sizeof(uint16_t));
+    }
+
+    panel.write_num++;
+    panel.write_bytes += len;
+}
+
+static uint32_t lcg = 1;
+
+static uint32_t test_rand(uint32_t max)
+{
+    lcg = lcg * 1103515245 + 12345;
+    return (lcg >> 8) % max;
+}
+
+static int rect_touch(const lcd_fb_rect_t *a, const lcd_fb_rect_t *b)
+{
+    return a->x_start <= b->x_end + 1 && b->x_start <= a->x_end + 1 &&
+           a->y_start <= b->y_end + 1 && b->y_start <= a->y_end + 1;
+}
+
+static int rect_contains(const lcd_fb_rect_t *rect, uint16_t x, uint16_t y)
+{
+    return x >= rect->x_start && x <= rect->x_end && y >= rect->y_start && y <= rect->y_end;
+}
+
+/*!< The dirty set is small, disjoint and covers every pixel marked since the last flush */
+static int dirty_check(lcd_fb_handle_t fb, const uint8_t *marked)
+{
+    lcd_fb_rect_t rect[LCD_FB_DIRTY_MAX_NUM + 1];
+    int num = lcd_fb_get_dirty(fb, rect, LCD_FB_DIRTY_MAX_NUM + 1);
+
+    HOST_CHECK(num <= LCD_FB_DIRTY_MAX_NUM);
+
+    for (int x = 0; x < num; x++) {
+        HOST_CHECK(rect[x].x_start <= rect[x].x_end && rect[x].x_end < TEST_WIDTH);
+        HOST_CHECK(rect[x].y_start <= rect[x].y_end && rect[x].y_end < TEST_HEIGHT);
+
+        for (int y = x + 1; y < num; y++) {
+            HOST_CHECK(!rect_touch(&rect[x], &rect[y]));
+        }
+    }
+
+    for (int y = 0; y < TEST_HEIGHT; y++) {
+        for (int x = 0; x < TEST_WIDTH; x++) {
+            int covered = 0;
+
+            for (int r = 0; r < num && !covered; r++) {
+                covered = rect_contains(&rect[r], x, y);
+            }
+
+            HOST_CHECK(covered || !marked[y * TEST_WIDTH + x]);
+        }
+    }
+
+    return num;
+}
+
+/*!< Flush and check the panel against the framebuffer and the byte count against the rectangles */
+static size_t flush_check(lcd_fb_handle_t fb)
+{
+    lcd_fb_rect_t rect[LCD_FB_DIRTY_MAX_NUM];
+    int num = lcd_fb_get_dirty(fb, rect, LCD_FB_DIRTY_MAX_NUM);
+    uint64_t expected = 0;
+    uint32_t index_num = panel.index_num;
+    uint64_t write_bytes = panel.write_bytes;
+
+    for (int x = 0; x < num; x++) {
+        expected += (uint32_t)(rect[x].x_end - rect[x].x_start + 1) * (rect[x].y_end - rect[x].y_start + 1) * sizeof(uint16_t);
+    }
+
+    size_t sent = lcd_fb_flush(fb);
+
+    HOST_CHECK(sent == expected);
+    HOST_CHECK(panel.write_bytes - write_bytes == sent);
+    HOST_CHECK(panel.index_num - index_num == num);
+    HOST_CHECK(memcmp(panel.pixels, lcd_fb_get_buffer(fb), sizeof(panel.pixels)) == 0);
+    HOST_CHECK(lcd_fb_get_dirty(fb, rect, LCD_FB_DIRTY_MAX_NUM) == 0);
+    return sent;
+}
+
+static void merge_basic(lcd_fb_handle_t fb)
+{
+    lcd_fb_rect_t rect[LCD_FB_DIRTY_MAX_NUM];
+
+    /*!< Overlapping */
+    HOST_CHECK(lcd_fb_mark_dirty(fb, 10, 10, 19, 19) == 0);
+    HOST_CHECK(lcd_fb_mark_dirty(fb, 15, 15, 30, 30) == 0);
+    HOST_CHECK(lcd_fb_get_dirty(fb, rect, LCD_FB_DIRTY_MAX_NUM) == 1);
+    HOST_CHECK(rect[0].x_start == 10 && rect[0].y_start == 10 && rect[0].x_end == 30 && rect[0].y_end == 30);
+
+    /*!< Sharing an edge */
+    HOST_CHECK(lcd_fb_mark_dirty(fb, 31, 10, 40, 12) == 0);
+    HOST_CHECK(lcd_fb_get_dirty(fb, rect, LCD_FB_DIRTY_MAX_NUM) == 1);
+    HOST_CHECK(rect[0].x_end == 40);
+
+    /*!< Apart, then bridged by a third one that touches both */
+    HOST_CHECK(lcd_fb_mark_dirty(fb, 100, 100, 110, 110) == 0);
+    HOST_CHECK(lcd_fb_mark_dirty(fb, 200, 100, 210, 110) == 0);
+    HOST_CHECK(lcd_fb_get_dirty(fb, rect, LCD_FB_DIRTY_MAX_NUM) == 3);
+    HOST_CHECK(lcd_fb_mark_dirty(fb, 111, 100, 199, 100) == 0);
+    HOST_CHECK(lcd_fb_get_dirty(fb, rect, LCD_FB_DIRTY_MAX_NUM) == 2);
+
+    /*!< A rectangle that grows over a later one in the list absorbs it too */
+    flush_check(fb);
+    HOST_CHECK(lcd_fb_mark_dirty(fb, 0, 0, 9, 9) == 0);
+    HOST_CHECK(lcd_fb_mark_dirty(fb, 50, 0, 59, 9) == 0);
+    HOST_CHECK(lcd_fb_mark_dirty(fb, 100, 0, 109, 9) == 0);
+    HOST_CHECK(lcd_fb_mark_dirty(fb, 5, 5, 104, 6) == 0);
+    HOST_CHECK(lcd_fb_get_dirty(fb, rect, LCD_FB_DIRTY_MAX_NUM) == 1);
+    HOST_CHECK(rect[0].x_start == 0 && rect[0].x_end == 109 && rect[0].y_end == 9);
+
+    /*!< Clipped to the screen, rejected off it */
+    HOST_CHECK(lcd_fb_mark_dirty(fb, 300, 230, 400, 400) == 0);
+    HOST_CHECK(lcd_fb_mark_dirty(fb, TEST_WIDTH, 0, TEST_WIDTH, 0) == -1);
+    HOST_CHECK(lcd_fb_mark_dirty(fb, 0, TEST_HEIGHT, 0, TEST_HEIGHT) == -1);
+    HOST_CHECK(lcd_fb_mark_dirty(fb, 20, 0, 10, 0) == -1);
+    HOST_CHECK(lcd_fb_get_dirty(fb, rect, LCD_FB_DIRTY_MAX_NUM) == 2);
+    HOST_CHECK(rect[1].x_end == TEST_WIDTH - 1 && rect[1].y_end == TEST_HEIGHT - 1);
+    flush_check(fb);
+    printf("%-30s ok\n", "merge");
+}
+
+/*!< Random bitmaps, more than LCD_FB_DIRTY_MAX_NUM apart between flushes */
+static void draw_random(lcd_fb_handle_t fb)
+{
+    static uint8_t marked[TEST_WIDTH * TEST_HEIGHT];
+    static uint16_t pixels[64 * 64];
+    uint64_t drawn_bytes = 0, sent_bytes = 0;
+
+    for (int round = 0; round < 50; round++) {
+        int rect_num = 1 + test_rand(40);
+
+        memset(marked, 0, sizeof(marked));
+
+        for (int r = 0; r < rect_num; r++) {
+            uint16_t x = test_rand(TEST_WIDTH), y = test_rand(TEST_HEIGHT);
+            uint16_t w = 1 + test_rand(64), h = 1 + test_rand(64);
+
+            for (int p = 0; p < w * h; p++) {
+                pixels[p] = test_rand(0x10000);
+            }
+
+            HOST_CHECK(lcd_fb_draw_bitmap(fb, x, y, w, h, pixels) == 0);
+
+            for (int py = y; py < y + h && py < TEST_HEIGHT; py++) {
+                for (int px = x; px < x + w && px < TEST_WIDTH; px++) {
+                    drawn_bytes += !marked[py * TEST_WIDTH + px] * sizeof(uint16_t);
+                    marked[py * TEST_WIDTH + px] = 1;
+                }
+            }
+        }
+
+        dirty_check(fb, marked);
+        sent_bytes += flush_check(fb);
+    }
+
+    HOST_CHECK(sent_bytes >= drawn_bytes);
+    printf("%-30s %llu bytes drawn, %llu sent\n", "random bitmaps", (unsigned long long)drawn_bytes, (unsigned long long)sent_bytes);
+}
+
+/*!< Full rows go out in one write from the framebuffer, narrow rectangles in bands of whole rows */
+static void flush_writes(lcd_fb_handle_t fb)
+{
+    uint32_t write_num = panel.write_num;
+
+    HOST_CHECK(lcd_fb_mark_dirty(fb, 0, 0, 400, 400) == 0);
+    HOST_CHECK(flush_check(fb) == TEST_WIDTH * TEST_HEIGHT * sizeof(uint16_t));
+    HOST_CHECK(panel.write_num - write_num == 1);
+
+    /*!< 100 pixel rows of 200 bytes, 10 rows a band */
+    write_num = panel.write_num;
+    HOST_CHECK(lcd_fb_mark_dirty(fb, 20, 10, 119, 104) == 0);
+    HOST_CHECK(flush_check(fb) == 100 * 95 * sizeof(uint16_t));
+    HOST_CHECK(panel.write_num - write_num == (95 + 9) / 10);
+
+    /*!< Nothing dirty, nothing sent */
+    write_num = panel.write_num;
+    HOST_CHECK(flush_check(fb) == 0);
+    HOST_CHECK(panel.write_num == write_num);
+    printf("%-30s ok\n", "flush writes");
+}
+
+int main(void)
+{
+    lcd_fb_stats_t stats;
+
+    HOST_CHECK(lcd_fb_create(TEST_WIDTH, TEST_HEIGHT, TEST_WIDTH * sizeof(uint16_t) - 1) == NULL);
+    HOST_CHECK(lcd_fb_create(0, TEST_HEIGHT, TEST_BAND_SIZE) == NULL);
+
+    lcd_fb_handle_t fb = lcd_fb_create(TEST_WIDTH, TEST_HEIGHT, TEST_BAND_SIZE);
+
+    HOST_CHECK(fb);
+    merge_basic(fb);
+    draw_random(fb);
+    flush_writes(fb);
+
+    /*!< The counters add up what the panel received */
+    lcd_fb_get_stats(fb, &stats);
+    HOST_CHECK(stats.sent_bytes == panel.write_bytes);
+    HOST_CHECK(stats.rect_num == panel.index_num);
+    printf("%u flushes, %u rectangles, %llu bytes\n", stats.flush_num, stats.rect_num, (unsigned long long)stats.sent_bytes);
+    lcd_fb_delete(fb);
+    return 0;
+}
@@ -3,3 +3,6 @@
 #
 # (Uses default behaviour of compiling all source files in directory, adding 'include' to include path.)
 
+ifndef CONFIG_SCCB_SIM_ENABLE
+COMPONENT_OBJEXCLUDE := sccb_sim.o
+endif
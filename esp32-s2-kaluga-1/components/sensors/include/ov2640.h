@@ -263,6 +263,17 @@ esp_err_t OV2640_ImageWin_Set(uint16_t offx, uint16_t offy, uint16_t width, uint
  */
 esp_err_t OV2640_ImageSize_Set(uint16_t width, uint16_t height);
 
+/**
+ * @brief Get the size of the image set by OV2640_ImageSize_Set, the largest output size
+ *
+ * @param width Filled with the width (horizontal)
+ * @param height Filled with the height (vertical), both left untouched on failure
+ *
+ * @return -ESP_OK   success
+ *         -ESP_FAIL the sensor did not answer
+ */
+esp_err_t OV2640_ImageSize_Get(uint16_t *width, uint16_t *height);
+
 #ifdef __cplusplus
 }
 #endif
@@ -17,6 +17,20 @@ extern "C"
 {
 #endif
 
+typedef struct {
+    float fps;                /*!< Frame rate the timing gives */
+    int sysclk;               /*!< Hz */
+    int pclk;                 /*!< Hz */
+    uint16_t hts;             /*!< Total line length, in SYSCLK cycles */
+    uint16_t vts;             /*!< Total frame length, in lines */
+    uint8_t multiplier;       /*!< PLL settings, see sensor_t.set_pll */
+    uint8_t sys_div;
+    uint8_t pre_div;
+    bool root_2x;
+    uint8_t pclk_div;
+    bool binning;
+} ov3660_timing_t;
+
 /**
  * @brief Initialize OV3660
  *
@@ -27,6 +41,61 @@ extern "C"
  */
 esp_err_t ov3660_init(sensor_t *sensor);
 
+/**
+ * @brief Re-read every register of the shadow from the sensor
+ *
+ * The driver keeps a RAM shadow of the registers it wrote or read, read-modify-write operations
+ * are served from it. Call this when something else may have changed the sensor registers.
+ * Registers that fail to read are dropped from the shadow, the next read goes to the sensor.
+ *
+ * @param sensor   pointers of sensor
+ *
+ * @return - number of registers that differed from the shadow or failed to read
+ */
+int ov3660_shadow_sync(sensor_t *sensor);
+
+/**
+ * @brief Drop the register shadow, the next read of every register goes to the sensor
+ *
+ * @param sensor   pointers of sensor
+ */
+void ov3660_shadow_invalidate(sensor_t *sensor);
+
+/**
+ * @brief Compare the register shadow with the sensor and log every mismatch
+ *
+ * Mismatching registers take the sensor value, registers that fail to read leave the shadow and
+ * count as mismatches. Define REG_SHADOW_VERIFY in ov3660.c to check
+ * every cached read instead.
+ *
+ * @param sensor   pointers of sensor
+ *
+ * @return - number of mismatches, 0 if the shadow is consistent
+ */
+int ov3660_shadow_verify(sensor_t *sensor);
+
+/**
+ * @brief Configure the window, the PLL and the frame timing for an output size and frame rate
+ *
+ * Every PLL setting is searched, with the line (HTS) and frame (VTS) lengths that bring the frame
+ * rate closest to target_fps. PCLK stays within what the cam driver sustains and is fast enough
+ * to send every output line before the next one, so the result may be slower than asked.
+ *
+ * The frame rate is kept: set_framesize solves again for the new size instead of applying its PLL
+ * presets, until reset, set_pll or set_res_raw take the timing back.
+ *
+ * @param sensor     pointers of sensor
+ * @param width      output width
+ * @param height     output height
+ * @param target_fps frame rate wanted
+ * @param xclk       XCLK given to the sensor, in Hz
+ * @param timing     Filled with the chosen timing, may be NULL
+ *
+ * @return - 0 success
+ *         - -1 no timing for this size, or the registers could not be written
+ */
+int ov3660_configure_for_fps(sensor_t *sensor, int width, int height, float target_fps, int xclk, ov3660_timing_t *timing);
+
 #ifdef __cplusplus
 }
 #endif
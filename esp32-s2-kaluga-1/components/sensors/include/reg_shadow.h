@@ -0,0 +1,89 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint16_t reg;
+    uint8_t value;
+} reg_shadow_entry_t;
+
+/**
+ * @brief Copy of the sensor registers with known values, sorted by register
+ *
+ * Only registers that were written or read are present, so a few hundred entries cover a sensor.
+ */
+typedef struct {
+    reg_shadow_entry_t *entries;
+    uint16_t num;             /*!< Entries in use */
+    uint16_t size;            /*!< Capacity of entries */
+} reg_shadow_t;
+
+/**
+ * @brief Initialize an empty shadow on caller provided storage
+ *
+ * @param shadow shadow
+ * @param entries storage for size entries
+ * @param size capacity
+ */
+void reg_shadow_init(reg_shadow_t *shadow, reg_shadow_entry_t *entries, uint16_t size);
+
+/**
+ * @brief Look a register up
+ *
+ * @param shadow shadow
+ * @param reg register
+ * @param value filled with the cached value
+ *
+ * @return - true the register is cached
+ *         - false unknown, read the sensor
+ */
+bool reg_shadow_get(const reg_shadow_t *shadow, uint16_t reg, uint8_t *value);
+
+/**
+ * @brief Record the value of a register
+ *
+ * @param shadow shadow
+ * @param reg register
+ * @param value value the sensor has now
+ *
+ * @return - true cached
+ *         - false the shadow is full, the register stays unknown
+ */
+bool reg_shadow_set(reg_shadow_t *shadow, uint16_t reg, uint8_t value);
+
+/**
+ * @brief Forget one register
+ *
+ * @param shadow shadow
+ * @param reg register
+ */
+void reg_shadow_remove(reg_shadow_t *shadow, uint16_t reg);
+
+/**
+ * @brief Forget every register, e.g. after a sensor reset
+ *
+ * @param shadow shadow
+ */
+void reg_shadow_clear(reg_shadow_t *shadow);
+
+#ifdef __cplusplus
+}
+#endif
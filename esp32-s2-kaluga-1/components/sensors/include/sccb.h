@@ -15,11 +15,34 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @brief SCCB bus backend, replaces the I2C driver, e.g. with a simulated sensor
+ *
+ * A transaction is the bytes sent after the slave address: the register address, high byte first
+ * for 16-bit registers, then the data. The functions return 0 on success, -1 on NACK.
+ */
+typedef struct {
+    int (*write)(void *ctx, uint8_t slv_addr, const uint8_t *data, size_t len);                 /*!< One write transaction */
+    int (*read)(void *ctx, uint8_t slv_addr, const uint8_t *reg, size_t reg_len, uint8_t *value); /*!< Register address write, then a one byte read */
+    int (*probe)(void *ctx, uint8_t slv_addr);                                                   /*!< Address only transaction, 0 on ACK */
+    void *ctx;
+} sccb_backend_t;
+
+/**
+ * @brief Route the SCCB functions to a backend instead of the I2C driver
+ *
+ * Call it before SCCB_Init. While a backend is set, SCCB_Init and SCCB_Deinit leave the I2C driver alone.
+ *
+ * @param backend backend, kept by reference, NULL for the I2C driver
+ */
+void SCCB_Set_Backend(const sccb_backend_t *backend);
+
 /**
  * @brief Initializes the GPIO port of the SCCB 
  */
@@ -53,6 +76,20 @@ uint8_t SCCB_Write(uint8_t slv_addr, uint8_t reg, uint8_t data);
  */
 uint8_t SCCB_Read(uint8_t slv_addr, uint8_t reg);
 
+/**
+ * @brief read the register and report a failed transfer
+ *
+ * SCCB_Read cannot tell a NACK from a register that holds 0xFF, use this one when the value is kept.
+ *
+ * @param slv_addr slave address
+ * @param reg register
+ * @param out read data, left untouched on failure
+ *
+ * @return - 0 success
+ *          -1 fail
+ */
+int SCCB_Read_Checked(uint8_t slv_addr, uint8_t reg, uint8_t *out);
+
 /**
  * @brief read the 16-bit register
  *
@@ -63,6 +100,20 @@ uint8_t SCCB_Read(uint8_t slv_addr, uint8_t reg);
  */
 uint8_t SCCB_Read16(uint8_t slv_addr, uint16_t reg);
 
+/**
+ * @brief read the 16-bit register and report a failed transfer
+ *
+ * SCCB_Read16 cannot tell a NACK from a register that holds 0xFF, use this one when the value is kept.
+ *
+ * @param slv_addr slave address
+ * @param reg register
+ * @param out read data, left untouched on failure
+ *
+ * @return - 0 success
+ *          -1 fail
+ */
+int SCCB_Read16_Checked(uint8_t slv_addr, uint16_t reg, uint8_t *out);
+
 /**
  * @brief write the 16-bit register
  *
@@ -75,6 +126,36 @@ uint8_t SCCB_Read16(uint8_t slv_addr, uint16_t reg);
  */
 uint8_t SCCB_Write16(uint8_t slv_addr, uint16_t reg, uint8_t data);
 
+/**
+ * @brief write a table of registers
+ *
+ * Each write is a separate transaction, as sensors with a bank select register may not
+ * auto-increment the address.
+ *
+ * @param slv_addr slave address
+ * @param regs {register, data} pairs, written in order
+ * @param num number of pairs
+ *
+ * @return - 0 success
+ *          -1 fail
+ */
+int SCCB_Write_Regs(uint8_t slv_addr, const uint8_t (*regs)[2], size_t num);
+
+/**
+ * @brief write a table of 16-bit registers
+ *
+ * Consecutive registers are coalesced into one sequential write, a single transaction
+ * of up to 128 bytes.
+ *
+ * @param slv_addr slave address
+ * @param regs {register, data} pairs, written in order
+ * @param num number of pairs
+ *
+ * @return - 0 success
+ *          -1 fail
+ */
+int SCCB_Write16_Regs(uint8_t slv_addr, const uint16_t (*regs)[2], size_t num);
+
 #ifdef __cplusplus
 }
 #endif
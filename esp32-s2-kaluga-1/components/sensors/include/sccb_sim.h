@@ -0,0 +1,125 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "sccb.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!< Simulated SCCB sensor, a register model behind sccb_backend_t. It has no hardware or FreeRTOS dependency */
+
+typedef enum {
+    SCCB_SIM_OV2640 = 0, /*!< Slave address 0x30, 8-bit registers in two banks selected by 0xFF, no auto-increment */
+    SCCB_SIM_OV3660,     /*!< Slave address 0x3C, 16-bit registers, sequential writes auto-increment */
+} sccb_sim_model_t;
+
+typedef struct {
+    uint32_t transactions;     /*!< Bus transactions, including NACKed ones */
+    uint32_t reads;            /*!< Register reads */
+    uint32_t writes;           /*!< Register writes */
+    uint32_t writes_redundant; /*!< Register writes of the value the register already had */
+    uint32_t nacks;            /*!< Transactions to another slave address, or NACKed on request */
+    uint32_t resets;           /*!< Soft resets */
+    uint32_t bytes;            /*!< Bytes on the bus, slave address bytes included */
+    uint64_t bus_time_us;      /*!< Bus time at the SCCB clock, without the driver overhead between transactions */
+} sccb_sim_stats_t;
+
+typedef struct sccb_sim sccb_sim_t;
+
+/**
+ * @brief Create a simulated sensor, with its registers at their reset values
+ *
+ * @param model sensor model
+ * @param freq  SCCB clock in Hz, for the bus time
+ *
+ * @return - NULL no memory
+ *         - others simulated sensor
+ */
+sccb_sim_t *sccb_sim_create(sccb_sim_model_t model, uint32_t freq);
+
+/**
+ * @brief Delete a simulated sensor, detach it first
+ *
+ * @param sim simulated sensor
+ */
+void sccb_sim_delete(sccb_sim_t *sim);
+
+/**
+ * @brief Route the SCCB functions to the simulated sensor, see SCCB_Set_Backend
+ *
+ * @param sim simulated sensor, NULL to go back to the I2C driver
+ */
+void sccb_sim_attach(sccb_sim_t *sim);
+
+/**
+ * @brief Slave address the simulated sensor answers to
+ *
+ * @param sim simulated sensor
+ *
+ * @return slave address
+ */
+uint8_t sccb_sim_get_addr(sccb_sim_t *sim);
+
+/**
+ * @brief Read a register without a bus transaction
+ *
+ * @param sim simulated sensor
+ * @param reg register, OV2640: bank << 8 | register
+ *
+ * @return register value
+ */
+uint8_t sccb_sim_get_reg(sccb_sim_t *sim, uint16_t reg);
+
+/**
+ * @brief Write a register without a bus transaction, e.g. a status register the sensor updates itself
+ *
+ * @param sim   simulated sensor
+ * @param reg   register, OV2640: bank << 8 | register
+ * @param value register value
+ */
+void sccb_sim_set_reg(sccb_sim_t *sim, uint16_t reg, uint8_t value);
+
+/**
+ * @brief NACK the next transactions to the sensor address, e.g. to test the error paths of a driver
+ *
+ * @param sim  simulated sensor
+ * @param skip transactions to answer first
+ * @param num  transactions to NACK after them, 0 to answer again
+ */
+void sccb_sim_nack_next(sccb_sim_t *sim, uint32_t skip, uint32_t num);
+
+/**
+ * @brief Get the bus statistics
+ *
+ * @param sim   simulated sensor
+ * @param stats Filled with the statistics
+ */
+void sccb_sim_get_stats(sccb_sim_t *sim, sccb_sim_stats_t *stats);
+
+/**
+ * @brief Clear the bus statistics
+ *
+ * @param sim simulated sensor
+ */
+void sccb_sim_reset_stats(sccb_sim_t *sim);
+
+#ifdef __cplusplus
+}
+#endif
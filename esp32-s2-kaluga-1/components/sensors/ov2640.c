@@ -19,6 +19,7 @@
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "esp_err.h"
+#include "esp_timer.h"
 #include "sensor.h"
 
 static const char *TAG = "OV2640";
@@ -26,10 +27,10 @@ static const char *TAG = "OV2640";
 #define SCCB_ID 0x30
 
 #define delay_ms(a) vTaskDelay(a / portTICK_RATE_MS);
+#define OV2640_WRITE_TABLE(tbl) SCCB_Write_Regs(SCCB_ID, tbl, sizeof(tbl) / sizeof(tbl[0]))
 
 esp_err_t OV2640_Init(uint8_t mode, uint8_t fre_double_en)
 {
-    uint16_t i = 0;
     uint16_t reg;
 
     SCCB_Write(SCCB_ID ,OV2640_DSP_RA_DLMT, 0x01);	/*!< Operate sensor register */
@@ -53,18 +54,18 @@ esp_err_t OV2640_Init(uint8_t mode, uint8_t fre_double_en)
         //return ESP_FAIL;
     }
 
+    int64_t start = esp_timer_get_time();
+
     if (mode == 0) {
         /*!< Initialize OV2640 with SVGA resolution (800*600) */
-        for (i = 0; i < sizeof(ov2640_svga_init_reg_tbl) / 2; i++) {
-            SCCB_Write(SCCB_ID ,ov2640_svga_init_reg_tbl[i][0], ov2640_svga_init_reg_tbl[i][1]);
-        }
+        OV2640_WRITE_TABLE(ov2640_svga_init_reg_tbl);
     } else {
         /*!< Initialize OV2640 with UXGA resolution (1600*1200) */
-        for (i = 0; i < sizeof(ov2640_uxga_init_reg_tbl) / 2; i++) {
-            SCCB_Write(SCCB_ID ,ov2640_uxga_init_reg_tbl[i][0], ov2640_uxga_init_reg_tbl[i][1]);
-        }
+        OV2640_WRITE_TABLE(ov2640_uxga_init_reg_tbl);
     }
 
+    ESP_LOGI(TAG, "init registers written in %lld us", (long long)(esp_timer_get_time() - start));
+
     if (fre_double_en) {
         SCCB_Write(SCCB_ID ,0xFF, 0x01);
         uint8_t temp = SCCB_Read(SCCB_ID, OV2640_SENSOR_CLKRC);
@@ -76,37 +77,25 @@ esp_err_t OV2640_Init(uint8_t mode, uint8_t fre_double_en)
 
 void OV2640_YUV_Mode(void)
 {
-    uint16_t i = 0;
-
     /*!< Setting :YUV422 format */
-    for (i = 0; i < (sizeof(ov2640_yuv422_reg_tbl) / 2); i++) {
-        SCCB_Write(SCCB_ID ,ov2640_yuv422_reg_tbl[i][0], ov2640_yuv422_reg_tbl[i][1]);
-    }
-
+    OV2640_WRITE_TABLE(ov2640_yuv422_reg_tbl);
 }
 
 void OV2640_JPEG_Mode(void)
 {
-    uint16_t i = 0;
     OV2640_YUV_Mode();
     SCCB_Write(SCCB_ID ,0xFF, 0x00);
     uint8_t temp = SCCB_Read(SCCB_ID, OV2640_DSP_IMAGE_MODE);
     SCCB_Write(SCCB_ID ,OV2640_DSP_IMAGE_MODE, temp | 0x10);
 
     /*!< Settings: output JPEG data */
-    for (i = 0; i < (sizeof(ov2640_jpeg_reg_tbl) / 2); i++) {
-        SCCB_Write(SCCB_ID ,ov2640_jpeg_reg_tbl[i][0], ov2640_jpeg_reg_tbl[i][1]);
-    }
+    OV2640_WRITE_TABLE(ov2640_jpeg_reg_tbl);
 }
 
 void OV2640_RGB565_Mode(uint8_t byte_swap_en)
 {
-    uint16_t i = 0;
-
     /*!< Setting :RGB565 output */
-    for (i = 0; i < (sizeof(ov2640_rgb565_reg_tbl) / 2); i++) {
-        SCCB_Write(SCCB_ID ,ov2640_rgb565_reg_tbl[i][0], ov2640_rgb565_reg_tbl[i][1]);
-    }
+    OV2640_WRITE_TABLE(ov2640_rgb565_reg_tbl);
 
     if (byte_swap_en) {
         SCCB_Write(SCCB_ID ,0xFF, 0x00);
@@ -150,12 +139,7 @@ const static uint8_t OV2640_AUTOEXPOSURE_LEVEL[5][8] = {
 
 void OV2640_Auto_Exposure(uint8_t level)
 {
-    uint8_t i;
-    uint8_t *p = (uint8_t *)OV2640_AUTOEXPOSURE_LEVEL[level];
-
-    for (i = 0; i < 4; i++) {
-        SCCB_Write(SCCB_ID ,p[i * 2], p[i * 2 + 1]);
-    }
+    SCCB_Write_Regs(SCCB_ID, (const uint8_t (*)[2])OV2640_AUTOEXPOSURE_LEVEL[level], 4);
 }
 
 void OV2640_Light_Mode(uint8_t mode)
@@ -356,15 +340,15 @@ esp_err_t OV2640_OutSize_Set(uint16_t width, uint16_t height)
 
     outw = width / 4;
     outh = height / 4;
-    SCCB_Write(SCCB_ID ,0XFF, 0X00);
-    SCCB_Write(SCCB_ID ,0XE0, 0X04);
-    SCCB_Write(SCCB_ID ,0X5A, outw & 0XFF);		/*!< Set the lower 8 bits of OUTW */
-    SCCB_Write(SCCB_ID ,0X5B, outh & 0XFF);		/*!< Set the lower 8 bits of OUTH */
+    uint8_t ret = SCCB_Write(SCCB_ID ,0XFF, 0X00);
+    ret |= SCCB_Write(SCCB_ID ,0XE0, 0X04);
+    ret |= SCCB_Write(SCCB_ID ,0X5A, outw & 0XFF);		/*!< Set the lower 8 bits of OUTW */
+    ret |= SCCB_Write(SCCB_ID ,0X5B, outh & 0XFF);		/*!< Set the lower 8 bits of OUTH */
     temp = (outw >> 8) & 0X03;
     temp |= (outh >> 6) & 0X04;
-    SCCB_Write(SCCB_ID ,0X5C, temp);				/*!< Set the high bits of OUTH/OUTW */
-    SCCB_Write(SCCB_ID ,0XE0, 0X00);
-    return ESP_OK;
+    ret |= SCCB_Write(SCCB_ID ,0X5C, temp);				/*!< Set the high bits of OUTH/OUTW */
+    ret |= SCCB_Write(SCCB_ID ,0XE0, 0X00);			/*!< Always sent, the DSP must leave reset */
+    return ret ? ESP_FAIL : ESP_OK;
 }
 
 esp_err_t OV2640_ImageWin_Set(uint16_t offx, uint16_t offy, uint16_t width, uint16_t height)
@@ -412,4 +396,17 @@ esp_err_t OV2640_ImageSize_Set(uint16_t width, uint16_t height)
     SCCB_Write(SCCB_ID ,0X8C, temp);
     SCCB_Write(SCCB_ID ,0XE0, 0X00);
     return ESP_OK;
+}
+
+esp_err_t OV2640_ImageSize_Get(uint16_t *width, uint16_t *height)
+{
+    uint8_t temp, hsize, vsize;
+    /*!< A NACK read as 0xFF would give about 2047x2047 */
+    if (SCCB_Write(SCCB_ID ,0XFF, 0X00) || SCCB_Read_Checked(SCCB_ID, 0X8C, &temp)
+            || SCCB_Read_Checked(SCCB_ID, 0XC0, &hsize) || SCCB_Read_Checked(SCCB_ID, 0XC1, &vsize)) {
+        return ESP_FAIL;
+    }
+    *width = hsize << 3 | ((temp >> 3) & 0X07) | ((temp & 0X80) << 4);
+    *height = vsize << 3 | (temp & 0X07);
+    return ESP_OK;
 }
\ No newline at end of file
@@ -13,22 +13,62 @@
 #include "ov3660.h"
 #include "ov3660_regs.h"
 #include "ov3660_settings.h"
+#include "reg_shadow.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 static const char *TAG = "ov3660";
 
 #define REG_DEBUG_ON 
+// #define REG_SHADOW_VERIFY /*!< Read the sensor on every shadow hit and log mismatches */
+
+#define REG_SHADOW_SIZE 384
+
+static reg_shadow_entry_t reg_shadow_entries[REG_SHADOW_SIZE];
+static reg_shadow_t reg_shadow = { reg_shadow_entries, 0, REG_SHADOW_SIZE };
+static bool reg_write_delta = false; /*!< Skip writes of the value the shadow already holds */
+static float fps_target = 0;         /*!< Frame rate of the last ov3660_configure_for_fps, 0: the PLL presets of set_framesize */
+
+/*!< Registers the sensor changes by itself are never cached: the self clearing reset, AWB gains, AEC/AGC values and the average luma */
+static bool reg_is_volatile(uint16_t reg)
+{
+    return reg == SYSTEM_CTROL0 || (reg >= 0x3400 && reg <= 0x3405) || (reg >= 0x3500 && reg <= 0x350b) || reg == 0x56a1;
+}
+
+static void reg_shadow_update(uint16_t reg, uint8_t value)
+{
+    if (reg == SYSTEM_CTROL0 && (value & 0x80)) {
+        reg_shadow_clear(&reg_shadow); /*!< Software reset, every register is back to its default */
+    } else if (!reg_is_volatile(reg)) {
+        reg_shadow_set(&reg_shadow, reg, value);
+    }
+}
 
 static int read_reg(uint8_t slv_addr, const uint16_t reg){
-    int ret = SCCB_Read16(slv_addr, reg);
-#ifdef REG_DEBUG_ON
-    if (ret < 0) {
-        ESP_LOGE(TAG, "READ REG 0x%04x FAILED: %d", reg, ret);
+    uint8_t value;
+    if (reg_shadow_get(&reg_shadow, reg, &value)) {
+#ifdef REG_SHADOW_VERIFY
+        uint8_t hw_value;
+        if (SCCB_Read16_Checked(slv_addr, reg, &hw_value) == 0 && hw_value != value) {
+            ESP_LOGE(TAG, "SHADOW REG 0x%04x: 0x%02x, sensor: 0x%02x", reg, value, hw_value);
+            reg_shadow_set(&reg_shadow, reg, hw_value);
+            return hw_value;
+        }
+#endif
+        return value;
     }
+    if (SCCB_Read16_Checked(slv_addr, reg, &value) != 0) {
+#ifdef REG_DEBUG_ON
+        ESP_LOGE(TAG, "READ REG 0x%04x FAILED", reg);
 #endif
-    return ret;
+        return -1; /*!< Never cached, the next read goes to the sensor again */
+    }
+    if (!reg_is_volatile(reg)) {
+        reg_shadow_set(&reg_shadow, reg, value);
+    }
+    return value;
 }
 
 static int check_reg_mask(uint8_t slv_addr, uint16_t reg, uint8_t mask){
@@ -53,6 +93,10 @@ static int read_reg16(uint8_t slv_addr, const uint16_t reg){
 
 static int write_reg(uint8_t slv_addr, const uint16_t reg, uint8_t value){
     int ret = 0;
+    uint8_t shadow_value;
+    if (reg_write_delta && reg_shadow_get(&reg_shadow, reg, &shadow_value) && shadow_value == value) {
+        return 0;
+    }
 #ifndef REG_DEBUG_ON
     ret = SCCB_Write16(slv_addr, reg, value);
 #else
@@ -71,6 +115,11 @@ static int write_reg(uint8_t slv_addr, const uint16_t reg, uint8_t value){
         ESP_LOGE(TAG, "WRITE REG 0x%04x FAILED: %d", reg, ret);
     }
 #endif
+    if (ret == 0) {
+        reg_shadow_update(reg, value);
+    } else {
+        reg_shadow_remove(&reg_shadow, reg);
+    }
     return ret;
 }
 
@@ -88,17 +137,31 @@ static int set_reg_bits(uint8_t slv_addr, uint16_t reg, uint8_t offset, uint8_t
     return ret;
 }
 
+/*!< Tables bypass the REG_DEBUG_ON read back, the registers between two delays go out in sequential writes */
 static int write_regs(uint8_t slv_addr, const uint16_t (*regs)[2])
 {
     int i = 0, ret = 0;
+    int64_t start = esp_timer_get_time();
     while (!ret && regs[i][0] != REGLIST_TAIL) {
         if (regs[i][0] == REG_DLY) {
             vTaskDelay(regs[i][1] / portTICK_PERIOD_MS);
+            i++;
         } else {
-            ret = write_reg(slv_addr, regs[i][0], regs[i][1]);
+            int num = 0;
+            while (regs[i + num][0] != REGLIST_TAIL && regs[i + num][0] != REG_DLY) {
+                num++;
+            }
+            ret = SCCB_Write16_Regs(slv_addr, &regs[i], num);
+            for (; num > 0; num--, i++) {
+                if (ret == 0) {
+                    reg_shadow_update(regs[i][0], regs[i][1]);
+                } else {
+                    reg_shadow_remove(&reg_shadow, regs[i][0]); /*!< Unknown how far the batch got */
+                }
+            }
         }
-        i++;
     }
+    ESP_LOGD(TAG, "%d regs written in %lld us", i, (long long)(esp_timer_get_time() - start));
     return ret;
 }
 
@@ -120,7 +183,8 @@ static int write_addr_reg(uint8_t slv_addr, const uint16_t reg, uint16_t x_value
 
 #define write_reg_bits(slv_addr, reg, mask, enable) set_reg_bits(slv_addr, reg, 0, mask, enable?mask:0)
 
-static int calc_sysclk(int xclk, bool pll_bypass, int pll_multiplier, int pll_sys_div, int pll_pre_div, bool pll_root_2x, int pll_seld5, bool pclk_manual, int pclk_div)
+/*!< Returns PLLCLK, VCO in kHz */
+static int calc_pllclk(int xclk, bool pll_bypass, int pll_multiplier, int pll_sys_div, int pll_pre_div, bool pll_root_2x, int pll_seld5, int *vco)
 {
     const int pll_pre_div2x_map[] = { 2, 3, 4, 6 };/*!< values are multiplied by two to avoid floats */
     const int pll_seld52x_map[] = { 2, 2, 4, 5 };
@@ -133,8 +197,14 @@ static int calc_sysclk(int xclk, bool pll_bypass, int pll_multiplier, int pll_sy
     int pll_root_div = pll_root_2x?2:1;
     int pll_seld52x = pll_seld52x_map[pll_seld5];
 
-    int VCO = (xclk / 1000) * pll_multiplier * pll_root_div * 2 / pll_pre_div2x;
-    int PLLCLK = pll_bypass?(xclk):(VCO * 1000 * 2 / pll_sys_div / pll_seld52x);
+    *vco = (xclk / 1000) * pll_multiplier * pll_root_div * 2 / pll_pre_div2x;
+    return pll_bypass?(xclk):(*vco * 1000 * 2 / pll_sys_div / pll_seld52x);
+}
+
+static int calc_sysclk(int xclk, bool pll_bypass, int pll_multiplier, int pll_sys_div, int pll_pre_div, bool pll_root_2x, int pll_seld5, bool pclk_manual, int pclk_div)
+{
+    int VCO = 0;
+    int PLLCLK = calc_pllclk(xclk, pll_bypass, pll_multiplier, pll_sys_div, pll_pre_div, pll_root_2x, pll_seld5, &VCO);
     int PCLK = PLLCLK / 2 / ((pclk_manual && pclk_div)?pclk_div:1);
     int SYSCLK = PLLCLK / 4;
 
@@ -184,10 +254,12 @@ static int reset(sensor_t *sensor)
         ESP_LOGE(TAG, "Software Reset FAILED!");
         return ret;
     }
+    fps_target = 0; /*!< The default timing is back */
     vTaskDelay(100 / portTICK_PERIOD_MS);
+    int64_t start = esp_timer_get_time();
     ret = write_regs(sensor->slv_addr, sensor_default_regs);
     if (ret == 0) {
-        ESP_LOGD(TAG, "Camera defaults loaded");
+        ESP_LOGI(TAG, "Camera defaults loaded in %lld us", (long long)(esp_timer_get_time() - start));
         ret = set_ae_level(sensor, 0);
         vTaskDelay(100 / portTICK_PERIOD_MS);
     }
@@ -303,7 +375,7 @@ static int set_image_options(sensor_t *sensor)
     return ret;
 }
 
-static int set_framesize(sensor_t *sensor, framesize_t framesize)
+static int _set_framesize(sensor_t *sensor, framesize_t framesize)
 {
     int ret = 0;
     framesize_t old_framesize = sensor->status.framesize;
@@ -379,6 +451,28 @@ fail:
     return ret;
 }
 
+/*!< No reset, only the window, timing and PLL registers that differ go on the bus, so streaming goes on.
+ *   A frame rate set with ov3660_configure_for_fps is solved again for the new size instead of the PLL presets */
+static int set_framesize(sensor_t *sensor, framesize_t framesize)
+{
+    int64_t start = esp_timer_get_time();
+    int ret = -1;
+    reg_write_delta = true;
+    if (fps_target <= 0) {
+        ret = _set_framesize(sensor, framesize);
+    } else if (framesize <= FRAMESIZE_QXGA) {
+        ret = ov3660_configure_for_fps(sensor, resolution[framesize].width, resolution[framesize].height, fps_target, sensor->xclk_freq_hz, NULL);
+        if (ret == 0) {
+            sensor->status.framesize = framesize;
+        }
+    } else {
+        ESP_LOGE(TAG, "Invalid framesize: %u", framesize);
+    }
+    reg_write_delta = false;
+    ESP_LOGD(TAG, "framesize switched in %lld us", (long long)(esp_timer_get_time() - start));
+    return ret;
+}
+
 static int set_hmirror(sensor_t *sensor, int enable)
 {
     int ret = 0;
@@ -930,6 +1024,7 @@ static int set_reg(sensor_t *sensor, int reg, int mask, int value)
 static int set_res_raw(sensor_t *sensor, int startX, int startY, int endX, int endY, int offsetX, int offsetY, int totalX, int totalY, int outputX, int outputY, bool scale, bool binning)
 {
     int ret = 0;
+    fps_target = 0; /*!< The application sets the timing */
     ret  = write_addr_reg(sensor->slv_addr, X_ADDR_ST_H, startX, startY)
         || write_addr_reg(sensor->slv_addr, X_ADDR_END_H, endX, endY)
         || write_addr_reg(sensor->slv_addr, X_OFFSET_H, offsetX, offsetY)
@@ -946,6 +1041,7 @@ static int set_res_raw(sensor_t *sensor, int startX, int startY, int endX, int e
 
 static int _set_pll(sensor_t *sensor, int bypass, int multiplier, int sys_div, int root_2x, int pre_div, int seld5, int pclk_manual, int pclk_div)
 {
+    fps_target = 0; /*!< The application sets the timing */
     return set_pll(sensor, bypass > 0, multiplier, sys_div, pre_div, root_2x > 0, seld5, pclk_manual > 0, pclk_div);
 }
 
@@ -988,8 +1084,220 @@ static int init_status(sensor_t *sensor)
     return 0;
 }
 
+static int reg_shadow_reload(sensor_t *sensor, bool verify)
+{
+    int mismatch = 0;
+    for (int i = 0; i < reg_shadow.num; i++) {
+        reg_shadow_entry_t *entry = &reg_shadow.entries[i];
+        uint8_t value;
+        if (SCCB_Read16_Checked(sensor->slv_addr, entry->reg, &value) != 0) {
+            reg_shadow_remove(&reg_shadow, entry->reg); /*!< The sensor value is unknown, read it again when needed */
+            i--;
+            mismatch++;
+            continue;
+        }
+        if (value != entry->value) {
+            if (verify) {
+                ESP_LOGE(TAG, "SHADOW REG 0x%04x: 0x%02x, sensor: 0x%02x", entry->reg, entry->value, value);
+            }
+            entry->value = value;
+            mismatch++;
+        }
+    }
+    return mismatch;
+}
+
+int ov3660_shadow_sync(sensor_t *sensor)
+{
+    return reg_shadow_reload(sensor, false);
+}
+
+void ov3660_shadow_invalidate(sensor_t *sensor)
+{
+    reg_shadow_clear(&reg_shadow);
+}
+
+int ov3660_shadow_verify(sensor_t *sensor)
+{
+    int mismatch = reg_shadow_reload(sensor, true);
+    ESP_LOGI(TAG, "shadow verified, %d regs, %d mismatches", reg_shadow.num, mismatch);
+    return mismatch;
+}
+
+#define OV3660_SYSCLK_MAX      (60 * 1000 * 1000) /*!< Fastest SYSCLK in use, the camera example at 39 fps */
+#define OV3660_PCLK_MAX        (24 * 1000 * 1000) /*!< Fastest PCLK the cam driver captured in 8-bit mode */
+#define OV3660_HTS_MIN_BINNING (1920)             /*!< Shortest binned line in use, the camera example */
+#define OV3660_HTS_MAX         (0xfff)
+#define OV3660_VTS_MAX         (0xffff)
+
+/*!< Pick the HTS/VTS pair closest to frame_clk SYSCLK cycles a frame, returns the frame length */
+static uint32_t fps_fit_totals(uint32_t frame_clk, uint32_t hts_min, uint32_t vts_min, uint16_t *hts, uint16_t *vts)
+{
+    uint32_t best = 0;
+
+    /*!< The shortest line gives the finest steps, VTS rounds both ways, HTS stretches when VTS is at its minimum */
+    uint32_t vts_fit = (frame_clk + hts_min / 2) / hts_min;
+    uint32_t vts_try[2] = { vts_fit, vts_fit + 1 };
+
+    for (int i = 0; i < 2; i++) {
+        uint32_t v = vts_try[i] < vts_min ? vts_min : vts_try[i];
+        v = v > OV3660_VTS_MAX ? OV3660_VTS_MAX : v;
+        uint32_t h = (frame_clk + v / 2) / v;
+        h = h < hts_min ? hts_min : h;
+        h = h > OV3660_HTS_MAX ? OV3660_HTS_MAX : h;
+
+        uint32_t len = h * v;
+
+        if (!best || (len > frame_clk ? len - frame_clk : frame_clk - len) < (best > frame_clk ? best - frame_clk : frame_clk - best)) {
+            best = len;
+            *hts = h;
+            *vts = v;
+        }
+    }
+
+    return best;
+}
+
+int ov3660_configure_for_fps(sensor_t *sensor, int width, int height, float target_fps, int xclk, ov3660_timing_t *timing)
+{
+    ov3660_timing_t best = {0};
+    uint64_t best_err = UINT64_MAX;
+    int ratio = -1;
+
+    if (target_fps <= 0 || width <= 0 || height <= 0) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return -1;
+    }
+
+    /*!< The window of the aspect ratio closest to the output, large enough for it */
+    for (int i = 0; i < sizeof(ratio_table) / sizeof(ratio_table[0]); i++) {
+        if (ratio_table[i].max_width < width || ratio_table[i].max_height < height) {
+            continue;
+        }
+
+        /*!< |width / height - max_width / max_height|, cross multiplied */
+        if (ratio < 0 || abs(width * ratio_table[i].max_height - height * ratio_table[i].max_width) * ratio_table[ratio].max_height
+            < abs(width * ratio_table[ratio].max_height - height * ratio_table[ratio].max_width) * ratio_table[i].max_height) {
+            ratio = i;
+        }
+    }
+
+    if (ratio < 0) {
+        ESP_LOGE(TAG, "Output %dx%d is larger than the sensor", width, height);
+        return -1;
+    }
+
+    ratio_settings_t settings = ratio_table[ratio];
+    bool binning = (width <= (settings.max_width / 2) && height <= (settings.max_height / 2));
+    bool scale = !((width == settings.max_width && height == settings.max_height)
+        || (width == (settings.max_width / 2) && height == (settings.max_height / 2)));
+    uint32_t rows = (settings.end_y - settings.start_y + 1) / (binning ? 2 : 1);
+    uint32_t hts_min = binning ? OV3660_HTS_MIN_BINNING : settings.total_x;
+    uint32_t vts_min = binning ? (settings.total_y / 2) + 1 : settings.total_y;
+    uint32_t target_mfps = target_fps * 1000;
+
+    for (int multiplier = 1; multiplier <= 31; multiplier++) {
+        for (int sys_div = 1; sys_div <= 15; sys_div++) {
+            for (int pre_div = 0; pre_div <= 3; pre_div++) {
+                for (int root_2x = 0; root_2x <= 1; root_2x++) {
+                    int vco = 0;
+                    int pllclk = calc_pllclk(xclk, false, multiplier, sys_div, pre_div, root_2x, 0, &vco);
+                    int sysclk = pllclk / 4;
+
+                    if (sysclk > OV3660_SYSCLK_MAX || sysclk < 1000000) {
+                        continue;
+                    }
+
+                    /*!< The fastest PCLK the cam driver keeps up with */
+                    int pclk_div = (pllclk / 2 + OV3660_PCLK_MAX - 1) / OV3660_PCLK_MAX;
+                    pclk_div = pclk_div ? pclk_div : 1;
+
+                    if (pclk_div > 31) {
+                        continue;
+                    }
+
+                    int pclk = pllclk / 2 / pclk_div;
+
+                    /*!< An output line (2 bytes a pixel) must leave in the time of the sensor lines it is scaled from */
+                    uint32_t hts_bw = (uint64_t)width * 2 * sysclk * height / ((uint64_t)pclk * rows) + 1;
+                    uint32_t hts_base = hts_bw > hts_min ? hts_bw : hts_min;
+
+                    if (hts_base > OV3660_HTS_MAX) {
+                        continue;
+                    }
+
+                    uint16_t hts = 0;
+                    uint16_t vts = 0;
+                    uint32_t frame_clk = (uint64_t)sysclk * 1000 / target_mfps;
+                    uint32_t len = fps_fit_totals(frame_clk, hts_base, vts_min, &hts, &vts);
+                    uint32_t mfps = (uint64_t)sysclk * 1000 / len;
+                    uint64_t err = mfps > target_mfps ? mfps - target_mfps : target_mfps - mfps;
+
+                    /*!< Ties go to the slower clocks */
+                    if (err < best_err || (err == best_err && (pclk < best.pclk || (pclk == best.pclk && sysclk < best.sysclk)))) {
+                        best_err = err;
+                        best.fps = mfps / 1000.0f;
+                        best.sysclk = sysclk;
+                        best.pclk = pclk;
+                        best.hts = hts;
+                        best.vts = vts;
+                        best.multiplier = multiplier;
+                        best.sys_div = sys_div;
+                        best.pre_div = pre_div;
+                        best.root_2x = root_2x;
+                        best.pclk_div = pclk_div;
+                        best.binning = binning;
+                    }
+                }
+            }
+        }
+    }
+
+    if (!best.sysclk) {
+        ESP_LOGE(TAG, "No PLL setting for XCLK %d Hz", xclk);
+        return -1;
+    }
+
+    sensor->xclk_freq_hz = xclk;
+
+    int ret = write_addr_reg(sensor->slv_addr, X_ADDR_ST_H, settings.start_x, settings.start_y)
+        || write_addr_reg(sensor->slv_addr, X_ADDR_END_H, settings.end_x, settings.end_y)
+        || write_addr_reg(sensor->slv_addr, X_OUTPUT_SIZE_H, width, height)
+        || write_addr_reg(sensor->slv_addr, X_TOTAL_SIZE_H, best.hts, best.vts)
+        || write_addr_reg(sensor->slv_addr, X_OFFSET_H, binning ? 8 : 16, binning ? 2 : 6)
+        || write_reg_bits(sensor->slv_addr, ISP_CONTROL_01, 0x20, scale);
+
+    if (ret == 0) {
+        sensor->status.scale = scale;
+        sensor->status.binning = binning;
+        ret = set_image_options(sensor);
+    }
+
+    if (ret == 0) {
+        ret = set_pll(sensor, false, best.multiplier, best.sys_div, best.pre_div, best.root_2x, 0, true, best.pclk_div);
+    }
+
+    if (ret) {
+        ESP_LOGE(TAG, "Setting %dx%d at %.2f fps failed", width, height, target_fps);
+        return -1;
+    }
+
+    fps_target = target_fps;
+
+    ESP_LOGI(TAG, "%dx%d: %.2f fps (asked %.2f), SYSCLK %d Hz, PCLK %d Hz, HTS %u, VTS %u",
+             width, height, best.fps, target_fps, best.sysclk, best.pclk, best.hts, best.vts);
+
+    if (timing) {
+        *timing = best;
+    }
+
+    return 0;
+}
+
 int ov3660_init(sensor_t *sensor)
 {
+    reg_shadow_clear(&reg_shadow); /*!< Nothing is known about a sensor that was just probed */
+    fps_target = 0;
     sensor->reset = reset;
     sensor->set_pixformat = set_pixformat;
     sensor->set_framesize = set_framesize;
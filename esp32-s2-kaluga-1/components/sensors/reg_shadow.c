@@ -0,0 +1,88 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include "reg_shadow.h"
+
+/*!< Index of the first entry with a register not below reg */
+static uint16_t reg_shadow_find(const reg_shadow_t *shadow, uint16_t reg)
+{
+    uint16_t low = 0, high = shadow->num;
+
+    while (low < high) {
+        uint16_t mid = (low + high) / 2;
+
+        if (shadow->entries[mid].reg < reg) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+void reg_shadow_init(reg_shadow_t *shadow, reg_shadow_entry_t *entries, uint16_t size)
+{
+    shadow->entries = entries;
+    shadow->num = 0;
+    shadow->size = size;
+}
+
+bool reg_shadow_get(const reg_shadow_t *shadow, uint16_t reg, uint8_t *value)
+{
+    uint16_t i = reg_shadow_find(shadow, reg);
+
+    if (i < shadow->num && shadow->entries[i].reg == reg) {
+        *value = shadow->entries[i].value;
+        return true;
+    }
+
+    return false;
+}
+
+bool reg_shadow_set(reg_shadow_t *shadow, uint16_t reg, uint8_t value)
+{
+    uint16_t i = reg_shadow_find(shadow, reg);
+
+    if (i < shadow->num && shadow->entries[i].reg == reg) {
+        shadow->entries[i].value = value;
+        return true;
+    }
+
+    if (shadow->num == shadow->size) {
+        return false;
+    }
+
+    memmove(&shadow->entries[i + 1], &shadow->entries[i], (shadow->num - i) * sizeof(reg_shadow_entry_t));
+    shadow->entries[i].reg = reg;
+    shadow->entries[i].value = value;
+    shadow->num++;
+    return true;
+}
+
+void reg_shadow_remove(reg_shadow_t *shadow, uint16_t reg)
+{
+    uint16_t i = reg_shadow_find(shadow, reg);
+
+    if (i < shadow->num && shadow->entries[i].reg == reg) {
+        memmove(&shadow->entries[i], &shadow->entries[i + 1], (shadow->num - i - 1) * sizeof(reg_shadow_entry_t));
+        shadow->num--;
+    }
+}
+
+void reg_shadow_clear(reg_shadow_t *shadow)
+{
+    shadow->num = 0;
+}
@@ -41,13 +41,24 @@ static const char* TAG = "sccb";
 #define ACK_CHECK_DIS           0x0              /*!< I2C master will not check ack from slave */
 #define ACK_VAL                 0x0              /*!< I2C ack value */
 #define NACK_VAL                0x1              /*!< I2C nack value */
+#define SCCB_BURST_SIZE         128              /*!< Most bytes of register address and data in one sequential write */
 const int SCCB_I2C_PORT         = 0;
 static uint8_t ESP_SLAVE_ADDR   = 0x00;
+static const sccb_backend_t *sccb_backend = NULL; /*!< NULL: the I2C driver */
+
+void SCCB_Set_Backend(const sccb_backend_t *backend)
+{
+    sccb_backend = backend;
+}
 
 int SCCB_Init(int pin_sda, int pin_scl)
 {
     ESP_LOGI(TAG, "pin_sda %d pin_scl %d\n", pin_sda, pin_scl);
     
+    if (sccb_backend) {
+        return 0;
+    }
+
     i2c_config_t conf;
     conf.mode = I2C_MODE_MASTER;
     conf.sda_io_num = pin_sda;
@@ -63,6 +74,9 @@ int SCCB_Init(int pin_sda, int pin_scl)
 
 void SCCB_Deinit(void)
 {					 
+    if (sccb_backend) {
+        return;
+    }
     i2c_driver_delete(SCCB_I2C_PORT);
 }
 
@@ -70,6 +84,14 @@ uint8_t SCCB_Probe()
 {
     uint8_t slave_addr = 0x0;
     while(slave_addr < 0x7f) {
+        if (sccb_backend) {
+            if (sccb_backend->probe(sccb_backend->ctx, slave_addr) == 0) {
+                ESP_SLAVE_ADDR = slave_addr;
+                return ESP_SLAVE_ADDR;
+            }
+            slave_addr++;
+            continue;
+        }
         i2c_cmd_handle_t cmd = i2c_cmd_link_create();
         i2c_master_start(cmd);
         i2c_master_write_byte(cmd, ( slave_addr << 1 ) | WRITE_BIT, ACK_CHECK_EN);
@@ -89,6 +111,9 @@ uint8_t SCCB_Read(uint8_t slv_addr, uint8_t reg)
 {
     uint8_t data=0;
     esp_err_t ret = ESP_FAIL;
+    if (sccb_backend) {
+        return sccb_backend->read(sccb_backend->ctx, slv_addr, &reg, 1, &data) ? -1 : data;
+    }
     i2c_cmd_handle_t cmd = i2c_cmd_link_create();
     i2c_master_start(cmd);
     i2c_master_write_byte(cmd, ( slv_addr << 1 ) | WRITE_BIT, ACK_CHECK_EN);
@@ -110,9 +135,49 @@ uint8_t SCCB_Read(uint8_t slv_addr, uint8_t reg)
     return data;
 }
 
+int SCCB_Read_Checked(uint8_t slv_addr, uint8_t reg, uint8_t *out)
+{
+    uint8_t data = 0;
+    esp_err_t ret = ESP_FAIL;
+
+    if (sccb_backend) {
+        ret = sccb_backend->read(sccb_backend->ctx, slv_addr, &reg, 1, &data) ? ESP_FAIL : ESP_OK;
+    } else {
+        i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+        i2c_master_start(cmd);
+        i2c_master_write_byte(cmd, ( slv_addr << 1 ) | WRITE_BIT, ACK_CHECK_EN);
+        i2c_master_write_byte(cmd, reg, ACK_CHECK_EN);
+        i2c_master_stop(cmd);
+        ret = i2c_master_cmd_begin(SCCB_I2C_PORT, cmd, 1000 / portTICK_RATE_MS);
+        i2c_cmd_link_delete(cmd);
+
+        if (ret == ESP_OK) {
+            cmd = i2c_cmd_link_create();
+            i2c_master_start(cmd);
+            i2c_master_write_byte(cmd, ( slv_addr << 1 ) | READ_BIT, ACK_CHECK_EN);
+            i2c_master_read_byte(cmd, &data, NACK_VAL);
+            i2c_master_stop(cmd);
+            ret = i2c_master_cmd_begin(SCCB_I2C_PORT, cmd, 1000 / portTICK_RATE_MS);
+            i2c_cmd_link_delete(cmd);
+        }
+    }
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "R [%02x] fail, ret:%d", reg, ret);
+        return -1;
+    }
+
+    *out = data;
+    return 0;
+}
+
 uint8_t SCCB_Write(uint8_t slv_addr, uint8_t reg, uint8_t data)
 {
     esp_err_t ret = ESP_FAIL;
+    if (sccb_backend) {
+        uint8_t buf[2] = {reg, data};
+        return sccb_backend->write(sccb_backend->ctx, slv_addr, buf, sizeof(buf)) ? -1 : 0;
+    }
     i2c_cmd_handle_t cmd = i2c_cmd_link_create();
     i2c_master_start(cmd);
     i2c_master_write_byte(cmd, ( slv_addr << 1 ) | WRITE_BIT, ACK_CHECK_EN);
@@ -133,6 +198,10 @@ uint8_t SCCB_Read16(uint8_t slv_addr, uint16_t reg)
     esp_err_t ret = ESP_FAIL;
     uint16_t reg_htons = LITTLETOBIG(reg);
     uint8_t *reg_u8 = (uint8_t *)&reg_htons;
+    if (sccb_backend) {
+        SCCB_Read16_Checked(slv_addr, reg, &data);
+        return data;
+    }
     i2c_cmd_handle_t cmd = i2c_cmd_link_create();
     i2c_master_start(cmd);
     i2c_master_write_byte(cmd, ( slv_addr << 1 ) | WRITE_BIT, ACK_CHECK_EN);
@@ -155,12 +224,53 @@ uint8_t SCCB_Read16(uint8_t slv_addr, uint16_t reg)
     return data;
 }
 
+int SCCB_Read16_Checked(uint8_t slv_addr, uint16_t reg, uint8_t *out)
+{
+    uint8_t data = 0;
+    esp_err_t ret = ESP_FAIL;
+    uint8_t reg_u8[2] = {reg >> 8, reg & 0xFF};
+
+    if (sccb_backend) {
+        ret = sccb_backend->read(sccb_backend->ctx, slv_addr, reg_u8, 2, &data) ? ESP_FAIL : ESP_OK;
+    } else {
+        i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+        i2c_master_start(cmd);
+        i2c_master_write_byte(cmd, ( slv_addr << 1 ) | WRITE_BIT, ACK_CHECK_EN);
+        i2c_master_write(cmd, reg_u8, 2, ACK_CHECK_EN);
+        i2c_master_stop(cmd);
+        ret = i2c_master_cmd_begin(SCCB_I2C_PORT, cmd, 1000 / portTICK_RATE_MS);
+        i2c_cmd_link_delete(cmd);
+
+        if (ret == ESP_OK) {
+            cmd = i2c_cmd_link_create();
+            i2c_master_start(cmd);
+            i2c_master_write_byte(cmd, ( slv_addr << 1 ) | READ_BIT, ACK_CHECK_EN);
+            i2c_master_read_byte(cmd, &data, NACK_VAL);
+            i2c_master_stop(cmd);
+            ret = i2c_master_cmd_begin(SCCB_I2C_PORT, cmd, 1000 / portTICK_RATE_MS);
+            i2c_cmd_link_delete(cmd);
+        }
+    }
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "R [%04x] fail, ret:%d", reg, ret);
+        return -1;
+    }
+
+    *out = data;
+    return 0;
+}
+
 uint8_t SCCB_Write16(uint8_t slv_addr, uint16_t reg, uint8_t data)
 {
     static uint16_t i = 0;
     esp_err_t ret = ESP_FAIL;
     uint16_t reg_htons = LITTLETOBIG(reg);
     uint8_t *reg_u8 = (uint8_t *)&reg_htons;
+    if (sccb_backend) {
+        uint8_t buf[3] = {reg_u8[0], reg_u8[1], data};
+        return sccb_backend->write(sccb_backend->ctx, slv_addr, buf, sizeof(buf)) ? -1 : 0;
+    }
     i2c_cmd_handle_t cmd = i2c_cmd_link_create();
     i2c_master_start(cmd);
     i2c_master_write_byte(cmd, ( slv_addr << 1 ) | WRITE_BIT, ACK_CHECK_EN);
@@ -176,6 +286,78 @@ uint8_t SCCB_Write16(uint8_t slv_addr, uint16_t reg, uint8_t data)
     return ret == ESP_OK ? 0 : -1;
 }
 
+static uint16_t sccb_table_reg(const void *regs, size_t i, int reg_bytes)
+{
+    return reg_bytes == 2 ? ((const uint16_t (*)[2])regs)[i][0] : ((const uint8_t (*)[2])regs)[i][0];
+}
+
+static uint8_t sccb_table_val(const void *regs, size_t i, int reg_bytes)
+{
+    return reg_bytes == 2 ? ((const uint16_t (*)[2])regs)[i][1] : ((const uint8_t (*)[2])regs)[i][1];
+}
+
+/*!< One START...STOP transaction per write, or per run of consecutive registers when burst is set, each with its own command list */
+static int sccb_write_table(uint8_t slv_addr, const void *regs, size_t num, int reg_bytes, bool burst)
+{
+    uint8_t buf[SCCB_BURST_SIZE];
+    size_t i = 0;
+    int trans_num = 0;
+    uint16_t reg_first = 0;
+    esp_err_t ret = ESP_OK;
+
+    while (i < num) {
+        uint16_t reg = sccb_table_reg(regs, i, reg_bytes);
+        size_t len = 0;
+
+        reg_first = reg;
+
+        if (reg_bytes == 2) {
+            buf[len++] = reg >> 8;
+        }
+
+        buf[len++] = reg;
+        buf[len++] = sccb_table_val(regs, i++, reg_bytes);
+
+        /*!< The sensor increments the register address after each data byte of a sequential write */
+        while (burst && i < num && len < SCCB_BURST_SIZE && sccb_table_reg(regs, i, reg_bytes) == (uint16_t)(reg + 1)) {
+            buf[len++] = sccb_table_val(regs, i++, reg_bytes);
+            reg++;
+        }
+
+        trans_num++;
+
+        if (sccb_backend) {
+            ret = sccb_backend->write(sccb_backend->ctx, slv_addr, buf, len) ? ESP_FAIL : ESP_OK;
+        } else {
+            i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+            i2c_master_start(cmd);
+            i2c_master_write_byte(cmd, ( slv_addr << 1 ) | WRITE_BIT, ACK_CHECK_EN);
+            i2c_master_write(cmd, buf, len, ACK_CHECK_EN);
+            i2c_master_stop(cmd);
+            ret = i2c_master_cmd_begin(SCCB_I2C_PORT, cmd, 1000 / portTICK_RATE_MS);
+            i2c_cmd_link_delete(cmd);
+        }
+
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "SCCB write table failed addr:0x%02x, reg:0x%04x, ret:%d", slv_addr, reg_first, ret);
+            return -1;
+        }
+    }
+
+    ESP_LOGD(TAG, "%d regs in %d transactions", (int)num, trans_num);
+    return 0;
+}
+
+int SCCB_Write_Regs(uint8_t slv_addr, const uint8_t (*regs)[2], size_t num)
+{
+    return sccb_write_table(slv_addr, regs, num, 1, false);
+}
+
+int SCCB_Write16_Regs(uint8_t slv_addr, const uint16_t (*regs)[2], size_t num)
+{
+    return sccb_write_table(slv_addr, regs, num, 2, true);
+}
+
 
 
 
@@ -0,0 +1,280 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdlib.h>
+#include <string.h>
+
+#include "sccb_sim.h"
+
+#define SIM_OV2640_ADDR     (0x30)
+#define SIM_OV3660_ADDR     (0x3C)
+
+#define SIM_OV2640_BANK     (0xFF)   /*!< Bank select, 0: DSP, 1: sensor */
+#define SIM_OV2640_COM7     (0x112)  /*!< Sensor bank, bit 7 soft reset */
+#define SIM_OV3660_SYSTEM   (0x3008) /*!< Bit 7 soft reset, self clearing */
+
+struct sccb_sim {
+    sccb_sim_model_t model;
+    uint8_t slv_addr;
+    uint32_t freq;
+    uint8_t *regs;          /*!< OV2640: 2 banks of 256, OV3660: 64K */
+    uint64_t bus_bits;      /*!< Bits on the bus, START and STOP count as one */
+    uint32_t nack_skip;     /*!< Transactions to let through before the NACKs, see sccb_sim_nack_next */
+    uint32_t nack_num;      /*!< Transactions left to NACK */
+    sccb_sim_stats_t stats;
+    sccb_backend_t backend;
+};
+
+static const uint16_t ov2640_id_regs[][2] = {
+    {0x10A, 0x26}, /*!< PIDH */
+    {0x10B, 0x42}, /*!< PIDL */
+    {0x11C, 0x7F}, /*!< MIDH */
+    {0x11D, 0xA2}, /*!< MIDL */
+};
+
+static const uint16_t ov3660_id_regs[][2] = {
+    {0x300A, 0x36}, /*!< CHIP_ID_HIGH */
+    {0x300B, 0x60}, /*!< CHIP_ID_LOW */
+};
+
+static size_t sim_reg_num(sccb_sim_model_t model)
+{
+    return model == SCCB_SIM_OV2640 ? 2 * 256 : 64 * 1024;
+}
+
+static bool sim_reg_is_id(sccb_sim_t *sim, uint16_t reg)
+{
+    if (sim->model == SCCB_SIM_OV2640) {
+        return reg == 0x10A || reg == 0x10B || reg == 0x11C || reg == 0x11D;
+    }
+
+    return reg == 0x300A || reg == 0x300B;
+}
+
+static void sim_reset(sccb_sim_t *sim)
+{
+    uint8_t bank = sim->regs[SIM_OV2640_BANK];
+
+    /*!< Unmodelled registers reset to 0, drivers only rely on the IDs and on what they wrote */
+    memset(sim->regs, 0, sim_reg_num(sim->model));
+
+    if (sim->model == SCCB_SIM_OV2640) {
+        for (int i = 0; i < sizeof(ov2640_id_regs) / sizeof(ov2640_id_regs[0]); i++) {
+            sim->regs[ov2640_id_regs[i][0]] = ov2640_id_regs[i][1];
+        }
+
+        sim->regs[SIM_OV2640_BANK] = bank; /*!< The bank select is a DSP register, the sensor reset keeps it */
+    } else {
+        for (int i = 0; i < sizeof(ov3660_id_regs) / sizeof(ov3660_id_regs[0]); i++) {
+            sim->regs[ov3660_id_regs[i][0]] = ov3660_id_regs[i][1];
+        }
+    }
+
+    sim->stats.resets++;
+}
+
+/*!< Register index in regs[], OV2640 registers other than the bank select live in the selected bank */
+static uint16_t sim_reg_index(sccb_sim_t *sim, uint16_t reg)
+{
+    if (sim->model == SCCB_SIM_OV2640 && reg != SIM_OV2640_BANK) {
+        return (sim->regs[SIM_OV2640_BANK] & 0x01) << 8 | reg;
+    }
+
+    return reg;
+}
+
+static void sim_reg_write(sccb_sim_t *sim, uint16_t reg, uint8_t value)
+{
+    uint16_t index = sim_reg_index(sim, reg);
+
+    sim->stats.writes++;
+
+    if (sim->regs[index] == value) {
+        sim->stats.writes_redundant++;
+    }
+
+    if (sim_reg_is_id(sim, index)) {
+        return;
+    }
+
+    if ((sim->model == SCCB_SIM_OV2640 && index == SIM_OV2640_COM7) ||
+        (sim->model == SCCB_SIM_OV3660 && index == SIM_OV3660_SYSTEM)) {
+        if (value & 0x80) {
+            sim_reset(sim);
+            value &= ~0x80;
+        }
+    }
+
+    sim->regs[index] = value;
+}
+
+/*!< One bus segment: START, slave address, len bytes, STOP */
+static void sim_bus_segment(sccb_sim_t *sim, size_t len)
+{
+    sim->stats.bytes += len + 1;
+    sim->bus_bits += (len + 1) * 9 + 2;
+}
+
+static bool sim_addr_ack(sccb_sim_t *sim, uint8_t slv_addr)
+{
+    sim->stats.transactions++;
+
+    bool nack = slv_addr != sim->slv_addr;
+
+    if (!nack && sim->nack_num) {
+        if (sim->nack_skip) {
+            sim->nack_skip--;
+        } else {
+            sim->nack_num--;
+            nack = true;
+        }
+    }
+
+    if (nack) {
+        sim_bus_segment(sim, 0);
+        sim->stats.nacks++;
+        return false;
+    }
+
+    return true;
+}
+
+static int sim_write(void *ctx, uint8_t slv_addr, const uint8_t *data, size_t len)
+{
+    sccb_sim_t *sim = (sccb_sim_t *)ctx;
+    size_t reg_len = sim->model == SCCB_SIM_OV2640 ? 1 : 2;
+
+    if (!sim_addr_ack(sim, slv_addr)) {
+        return -1;
+    }
+
+    sim_bus_segment(sim, len);
+
+    if (len <= reg_len) {
+        return 0; /*!< Register address only */
+    }
+
+    uint16_t reg = reg_len == 2 ? data[0] << 8 | data[1] : data[0];
+
+    /*!< The OV2640 keeps the first data byte only, the OV3660 auto-increments */
+    size_t num = sim->model == SCCB_SIM_OV2640 ? 1 : len - reg_len;
+
+    for (size_t i = 0; i < num; i++) {
+        sim_reg_write(sim, reg + i, data[reg_len + i]);
+    }
+
+    return 0;
+}
+
+static int sim_read(void *ctx, uint8_t slv_addr, const uint8_t *reg, size_t reg_len, uint8_t *value)
+{
+    sccb_sim_t *sim = (sccb_sim_t *)ctx;
+
+    if (!sim_addr_ack(sim, slv_addr)) {
+        return -1;
+    }
+
+    /*!< Register address write, then a read of one byte */
+    sim_bus_segment(sim, reg_len);
+    sim_bus_segment(sim, 1);
+    sim->stats.reads++;
+    *value = sim->regs[sim_reg_index(sim, reg_len == 2 ? reg[0] << 8 | reg[1] : reg[0])];
+    return 0;
+}
+
+static int sim_probe(void *ctx, uint8_t slv_addr)
+{
+    sccb_sim_t *sim = (sccb_sim_t *)ctx;
+
+    if (!sim_addr_ack(sim, slv_addr)) {
+        return -1;
+    }
+
+    sim_bus_segment(sim, 0);
+    return 0;
+}
+
+sccb_sim_t *sccb_sim_create(sccb_sim_model_t model, uint32_t freq)
+{
+    sccb_sim_t *sim = (sccb_sim_t *)calloc(1, sizeof(sccb_sim_t));
+
+    if (!sim) {
+        return NULL;
+    }
+
+    sim->regs = (uint8_t *)malloc(sim_reg_num(model));
+
+    if (!sim->regs) {
+        free(sim);
+        return NULL;
+    }
+
+    sim->model = model;
+    sim->slv_addr = model == SCCB_SIM_OV2640 ? SIM_OV2640_ADDR : SIM_OV3660_ADDR;
+    sim->freq = freq;
+    sim->regs[SIM_OV2640_BANK] = 0;
+    sim_reset(sim);
+    sim->stats.resets = 0;
+
+    sim->backend.write = sim_write;
+    sim->backend.read = sim_read;
+    sim->backend.probe = sim_probe;
+    sim->backend.ctx = sim;
+    return sim;
+}
+
+void sccb_sim_delete(sccb_sim_t *sim)
+{
+    if (sim) {
+        free(sim->regs);
+        free(sim);
+    }
+}
+
+void sccb_sim_attach(sccb_sim_t *sim)
+{
+    SCCB_Set_Backend(sim ? &sim->backend : NULL);
+}
+
+uint8_t sccb_sim_get_addr(sccb_sim_t *sim)
+{
+    return sim->slv_addr;
+}
+
+uint8_t sccb_sim_get_reg(sccb_sim_t *sim, uint16_t reg)
+{
+    return sim->regs[reg & (sim_reg_num(sim->model) - 1)];
+}
+
+void sccb_sim_set_reg(sccb_sim_t *sim, uint16_t reg, uint8_t value)
+{
+    sim->regs[reg & (sim_reg_num(sim->model) - 1)] = value;
+}
+
+void sccb_sim_nack_next(sccb_sim_t *sim, uint32_t skip, uint32_t num)
+{
+    sim->nack_skip = skip;
+    sim->nack_num = num;
+}
+
+void sccb_sim_get_stats(sccb_sim_t *sim, sccb_sim_stats_t *stats)
+{
+    *stats = sim->stats;
+    stats->bus_time_us = sim->bus_bits * 1000000 / sim->freq;
+}
+
+void sccb_sim_reset_stats(sccb_sim_t *sim)
+{
+    memset(&sim->stats, 0, sizeof(sim->stats));
+    sim->bus_bits = 0;
+}
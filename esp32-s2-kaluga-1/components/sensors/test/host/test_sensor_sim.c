@@ -0,0 +1,259 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*!< The sensor drivers over sccb_sim, set up like the camera example, then the cam driver captures frames of the
+ *   size the sensor was set to and camera_set_framesize switches both, or puts both back when the sensor fails.
+ *   Failed reads must never reach the shadow */
+
+#include <stdio.h>
+#include "esp_heap_caps.h"
+#include "host_test.h"
+#include "sccb.h"
+#include "sccb_sim.h"
+#include "sensor.h"
+#include "ov2640.h"
+#include "ov3660.h"
+#include "cam.h"
+#include "camera.h"
+
+#define TEST_FRAME_NUM  (10)
+#define TEST_POOL_NUM   (2)
+
+static uint8_t *buffers[TEST_POOL_NUM];
+
+static uint16_t ov3660_out_width(sccb_sim_t *sim)
+{
+    return sccb_sim_get_reg(sim, 0x3808) << 8 | sccb_sim_get_reg(sim, 0x3809);
+}
+
+static uint16_t ov3660_out_high(sccb_sim_t *sim)
+{
+    return sccb_sim_get_reg(sim, 0x380a) << 8 | sccb_sim_get_reg(sim, 0x380b);
+}
+
+static uint16_t ov3660_hts(sccb_sim_t *sim)
+{
+    return sccb_sim_get_reg(sim, 0x380c) << 8 | sccb_sim_get_reg(sim, 0x380d);
+}
+
+static uint16_t ov3660_vts(sccb_sim_t *sim)
+{
+    return sccb_sim_get_reg(sim, 0x380e) << 8 | sccb_sim_get_reg(sim, 0x380f);
+}
+
+static void cam_run(framesize_t framesize)
+{
+    cam_config_t config = {0};
+
+    config.bit_width = 8;
+    config.size.width = resolution[framesize].width;
+    config.size.high = resolution[framesize].height;
+    config.max_buffer_size = 8 * 1024;
+    config.task_stack = 1024;
+    config.task_pri = 5;
+    config.mode.synthetic = 1;
+    config.frame_buffer_num = TEST_POOL_NUM;
+    config.frame_buffers = buffers;
+    HOST_CHECK(cam_init(&config) == ESP_OK);
+    cam_start();
+}
+
+static void cam_check_frames(uint16_t width, uint16_t high)
+{
+    int match = 0;
+
+    /*!< Frames of the old size may still be in the pool right after a switch */
+    for (int x = 0; x < TEST_FRAME_NUM; x++) {
+        cam_frame_t frame;
+        size_t len = cam_take_frame(&frame);
+
+        match = len == width * high * 2 ? match + 1 : 0;
+        cam_give(frame.buf);
+    }
+
+    HOST_CHECK(match >= TEST_FRAME_NUM - TEST_POOL_NUM);
+}
+
+static void ov3660_check(void)
+{
+    sccb_sim_t *sim = sccb_sim_create(SCCB_SIM_OV3660, 200 * 1000);
+    sccb_sim_stats_t stats;
+    sensor_t sensor = {0};
+
+    HOST_CHECK(sim);
+    sccb_sim_attach(sim);
+    HOST_CHECK(SCCB_Init(1, 2) == 0);
+    sensor.slv_addr = SCCB_Probe();
+    HOST_CHECK(sensor.slv_addr == sccb_sim_get_addr(sim));
+    HOST_CHECK(ov3660_init(&sensor) == ESP_OK);
+    sensor.init_status(&sensor);
+    HOST_CHECK(sensor.reset(&sensor) == 0);
+    HOST_CHECK(sensor.set_pixformat(&sensor, PIXFORMAT_RGB565) == 0);
+    sccb_sim_reset_stats(sim);
+    HOST_CHECK(sensor.set_framesize(&sensor, FRAMESIZE_QVGA) == 0);
+    HOST_CHECK(ov3660_out_width(sim) == 320 && ov3660_out_high(sim) == 240);
+    sccb_sim_get_stats(sim, &stats);
+    printf("%-30s %u transactions, %u writes, %u redundant\n", "ov3660 qvga", stats.transactions, stats.writes, stats.writes_redundant);
+    HOST_CHECK(ov3660_shadow_verify(&sensor) == 0);
+
+    /*!< A NACKed read fails and is not cached, the next read goes to the sensor */
+    ov3660_shadow_invalidate(&sensor);
+    sccb_sim_nack_next(sim, 0, 1);
+    HOST_CHECK(sensor.get_reg(&sensor, 0x3808, 0xFF) < 0);
+    HOST_CHECK(sensor.get_reg(&sensor, 0x3808, 0xFF) == 320 >> 8);
+    sccb_sim_nack_next(sim, 0, 1);
+    HOST_CHECK(sensor.get_reg(&sensor, 0x3809, 0xFF) < 0);
+    sccb_sim_set_reg(sim, 0x3809, 0x12);
+    HOST_CHECK(sensor.get_reg(&sensor, 0x3809, 0xFF) == 0x12);
+    sccb_sim_set_reg(sim, 0x3809, 320 & 0xFF);
+
+    /*!< A register that fails to reload leaves the shadow */
+    sccb_sim_nack_next(sim, 0, 1);
+    HOST_CHECK(ov3660_shadow_sync(&sensor) >= 1);
+    HOST_CHECK(ov3660_shadow_verify(&sensor) == 0);
+
+    /*!< The sensor and the cam driver switch together */
+    cam_run(FRAMESIZE_QVGA);
+    cam_check_frames(320, 240);
+    HOST_CHECK(camera_set_framesize(OV3660_PID, &sensor, FRAMESIZE_QQVGA) == ESP_OK);
+    HOST_CHECK(ov3660_out_width(sim) == 160 && ov3660_out_high(sim) == 120);
+    HOST_CHECK(sensor.status.framesize == FRAMESIZE_QQVGA);
+    cam_check_frames(160, 120);
+
+    /*!< Larger than the frame buffers: neither changes */
+    HOST_CHECK(camera_set_framesize(OV3660_PID, &sensor, FRAMESIZE_VGA) == ESP_ERR_INVALID_SIZE);
+    HOST_CHECK(ov3660_out_width(sim) == 160 && ov3660_out_high(sim) == 120);
+    HOST_CHECK(cam_is_started());
+    cam_check_frames(160, 120);
+
+    /*!< The sensor NACKs: both go back to the old size and capture goes on */
+    sccb_sim_nack_next(sim, 0, 1);
+    HOST_CHECK(camera_set_framesize(OV3660_PID, &sensor, FRAMESIZE_QVGA) == ESP_FAIL);
+    HOST_CHECK(ov3660_out_width(sim) == 160 && ov3660_out_high(sim) == 120);
+    HOST_CHECK(sensor.status.framesize == FRAMESIZE_QQVGA);
+    HOST_CHECK(cam_is_started());
+    cam_check_frames(160, 120);
+
+    /*!< The sensor does not come back either: capture stays stopped */
+    sccb_sim_nack_next(sim, 0, 1000);
+    HOST_CHECK(camera_set_framesize(OV3660_PID, &sensor, FRAMESIZE_QVGA) == ESP_ERR_INVALID_STATE);
+    HOST_CHECK(!cam_is_started());
+    sccb_sim_nack_next(sim, 0, 0);
+    HOST_CHECK(camera_set_framesize(OV3660_PID, &sensor, FRAMESIZE_QQVGA) == ESP_OK);
+    HOST_CHECK(ov3660_out_width(sim) == 160 && ov3660_out_high(sim) == 120);
+    HOST_CHECK(!cam_is_started()); /*!< It was not running before */
+    cam_start();
+    cam_check_frames(160, 120);
+
+    /*!< A solved frame rate survives the switch, it is solved again for the new size */
+    ov3660_timing_t timing;
+    HOST_CHECK(ov3660_configure_for_fps(&sensor, 320, 240, 20, 16 * 1000 * 1000, NULL) == 0);
+    HOST_CHECK(camera_set_framesize(OV3660_PID, &sensor, FRAMESIZE_QQVGA) == ESP_OK);
+    uint16_t hts = ov3660_hts(sim);
+    uint16_t vts = ov3660_vts(sim);
+    HOST_CHECK(ov3660_configure_for_fps(&sensor, 160, 120, 20, 16 * 1000 * 1000, &timing) == 0);
+    HOST_CHECK(hts == timing.hts && vts == timing.vts);
+    HOST_CHECK(ov3660_hts(sim) == hts && ov3660_vts(sim) == vts);
+    cam_check_frames(160, 120);
+
+    /*!< A reset brings the presets back */
+    HOST_CHECK(sensor.reset(&sensor) == 0);
+    HOST_CHECK(sensor.set_framesize(&sensor, FRAMESIZE_QQVGA) == 0);
+    HOST_CHECK(ov3660_hts(sim) != timing.hts || ov3660_vts(sim) != timing.vts);
+    cam_stop();
+    HOST_CHECK(cam_deinit() == ESP_OK);
+    HOST_CHECK(ov3660_shadow_verify(&sensor) == 0);
+
+    sccb_sim_attach(NULL);
+    sccb_sim_delete(sim);
+    printf("%-30s ok\n", "ov3660");
+}
+
+static void ov2640_check(void)
+{
+    sccb_sim_t *sim = sccb_sim_create(SCCB_SIM_OV2640, 200 * 1000);
+    uint16_t width, high;
+
+    HOST_CHECK(sim);
+    sccb_sim_attach(sim);
+    HOST_CHECK(SCCB_Init(1, 2) == 0);
+    HOST_CHECK(SCCB_Probe() == sccb_sim_get_addr(sim));
+    HOST_CHECK(OV2640_Init(0, 1) == ESP_OK);
+    OV2640_RGB565_Mode(false);
+    HOST_CHECK(OV2640_ImageSize_Set(800, 600) == ESP_OK);
+    HOST_CHECK(OV2640_ImageWin_Set(0, 0, 800, 600) == ESP_OK);
+    HOST_CHECK(OV2640_OutSize_Set(320, 240) == ESP_OK);
+    HOST_CHECK(OV2640_ImageSize_Get(&width, &high) == ESP_OK && width == 800 && high == 600);
+
+    /*!< DSP bank ZMOW/ZMOH, the output size in units of 4 pixels */
+    HOST_CHECK(sccb_sim_get_reg(sim, 0x5A) == 320 / 4 && sccb_sim_get_reg(sim, 0x5B) == 240 / 4);
+
+    cam_run(FRAMESIZE_QVGA);
+    cam_check_frames(320, 240);
+    HOST_CHECK(camera_set_framesize(OV2640_PID, NULL, FRAMESIZE_QQVGA) == ESP_OK);
+    HOST_CHECK(sccb_sim_get_reg(sim, 0x5A) == 160 / 4 && sccb_sim_get_reg(sim, 0x5B) == 120 / 4);
+    cam_check_frames(160, 120);
+
+    /*!< Any of the 4 transactions of OV2640_ImageSize_Get NACKs: nothing is touched, capture goes on */
+    for (int skip = 0; skip < 4; skip++) {
+        sccb_sim_nack_next(sim, skip, 1);
+        width = high = 0;
+        HOST_CHECK(OV2640_ImageSize_Get(&width, &high) == ESP_FAIL && width == 0 && high == 0);
+        sccb_sim_nack_next(sim, skip, 1);
+        HOST_CHECK(camera_set_framesize(OV2640_PID, NULL, FRAMESIZE_QVGA) == ESP_FAIL);
+        HOST_CHECK(sccb_sim_get_reg(sim, 0x5A) == 160 / 4 && sccb_sim_get_reg(sim, 0x5B) == 120 / 4);
+        cam_check_frames(160, 120);
+    }
+
+    /*!< The sensor NACKs the output size: both go back to the old size. OV2640_ImageSize_Get goes first, 4 transactions */
+    sccb_sim_nack_next(sim, 4 + 2, 1);
+    HOST_CHECK(camera_set_framesize(OV2640_PID, NULL, FRAMESIZE_QVGA) == ESP_FAIL);
+    HOST_CHECK(sccb_sim_get_reg(sim, 0x5A) == 160 / 4 && sccb_sim_get_reg(sim, 0x5B) == 120 / 4);
+    cam_check_frames(160, 120);
+    HOST_CHECK(camera_set_framesize(OV3660_PID, NULL, FRAMESIZE_QVGA) == ESP_ERR_INVALID_ARG);
+    HOST_CHECK(camera_set_framesize(OV7725_PID, NULL, FRAMESIZE_QVGA) == ESP_ERR_NOT_SUPPORTED);
+    cam_stop();
+    HOST_CHECK(cam_deinit() == ESP_OK);
+
+    /*!< Another slave address NACKs */
+    HOST_CHECK(SCCB_Write(sccb_sim_get_addr(sim) + 1, 0x12, 0x80) != 0);
+
+    sccb_sim_attach(NULL);
+    sccb_sim_delete(sim);
+    printf("%-30s ok\n", "ov2640");
+}
+
+int main(void)
+{
+    uint8_t value = 0x5A;
+
+    host_test_start();
+
+    for (int x = 0; x < TEST_POOL_NUM; x++) {
+        buffers[x] = heap_caps_malloc(320 * 240 * 2, MALLOC_CAP_DMA);
+        HOST_CHECK(buffers[x]);
+    }
+
+    ov3660_check();
+    ov2640_check();
+
+    /*!< No backend: the I2C driver, nothing answers on the host bus */
+    HOST_CHECK(SCCB_Read16_Checked(0x3C, 0x300A, &value) == -1 && value == 0x5A);
+
+    for (int x = 0; x < TEST_POOL_NUM; x++) {
+        heap_caps_free(buffers[x]);
+    }
+
+    return 0;
+}
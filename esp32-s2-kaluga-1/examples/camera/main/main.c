@@ -32,6 +32,21 @@ static const char *TAG = "main";
 
 #define CAM_WIDTH   (320)
 #define CAM_HIGH    (240)
+#define CAM_FPS     (39)
+
+#ifdef CONFIG_CAMERA_JPEG_MODE
+static int jpeg_band_write(void *ctx, int y, int w, int h, uint8_t *data)
+{
+    /*!< lcd_set_index waits for the previous band, this one is sent while the next is decoded */
+    lcd_set_index(0, y, w - 1, y + h - 1);
+    return lcd_write_data_async(data, w * h * sizeof(uint16_t), NULL, NULL); /*!< Not 0: the band decode stops */
+}
+#else
+static void lcd_write_done(void *ctx)
+{
+    cam_give((uint8_t *)ctx);
+}
+#endif
 
 static void cam_task(void *arg)
 {
@@ -134,12 +149,13 @@ static void cam_task(void *arg)
             sensor.set_pixformat(&sensor, PIXFORMAT_RGB565);
         }
 
-        /*!< TotalX gets smaller, frame rate goes up */
-        /*!< TotalY gets smaller, frame rate goes up, vsync gets shorter */
-        sensor.set_res_raw(&sensor, 0, 0, 2079, 1547, 8, 2, 1920, 800, CAM_WIDTH, CAM_HIGH, true, true);
+        /*!< Window, PLL and frame timing for the output size and frame rate, PCLK stays within what the cam driver sustains */
+        if (ov3660_configure_for_fps(&sensor, CAM_WIDTH, CAM_HIGH, CAM_FPS, cam_config.xclk_fre, NULL) != 0) {
+            goto fail;
+        }
+
         sensor.set_vflip(&sensor, 1);
         sensor.set_hmirror(&sensor, 1);
-        sensor.set_pll(&sensor, false, 15, 1, 0, false, 0, true, 5); /*!< ov3660: 39 fps */
     } else {
         ESP_LOGE(TAG, "sensor is temporarily not supported\n");
         goto fail;
@@ -148,29 +164,47 @@ static void cam_task(void *arg)
     ESP_LOGI(TAG, "camera init done\n");
     cam_start();
 
+#ifdef CONFIG_CAMERA_JPEG_MODE
+    jpeg_decoder_t *jpeg_decoder = jpeg_decoder_create(); /*!< Buffers are reused across frames */
+
+    if (!jpeg_decoder) {
+        ESP_LOGE(TAG, "jpeg decoder create fail\n");
+        goto fail;
+    }
+
+#endif
+
     while (1) {
         uint8_t *cam_buf = NULL;
-        cam_take(&cam_buf);
 #ifdef CONFIG_CAMERA_JPEG_MODE
+        size_t cam_len = cam_take(&cam_buf);
+        jpeg_reader_t jpeg_reader;
+        jpeg_reader_init_mem(&jpeg_reader, cam_buf, cam_len); /*!< A truncated frame fails instead of reading past the buffer */
 
-        int w, h;
-        uint8_t *img = jpeg_decode(cam_buf, &w, &h);
-
-        if (img) {
-            ESP_LOGI(TAG, "jpeg: w: %d, h: %d\n", w, h);
-            lcd_set_index(0, 0, w - 1, h - 1);
-            lcd_write_data(img, w * h * sizeof(uint16_t));
-            free(img);
+        if (jpeg_decoder_decode_band_ex(jpeg_decoder, &jpeg_reader, jpeg_band_write, NULL) == ESP_OK) {
+            ESP_LOGD(TAG, "jpeg decode: %lld us\n", jpeg_decoder_get_decode_time(jpeg_decoder));
         }
 
+        cam_give(cam_buf);
 #else
+        cam_take(&cam_buf);
+        /*!< The frame buffer goes back to the camera once it is on the screen, the next frame is captured meanwhile */
         lcd_set_index(0, 0, CAM_WIDTH - 1, CAM_HIGH - 1);
-        lcd_write_data(cam_buf, CAM_WIDTH * CAM_HIGH * 2);
+        lcd_write_data_async(cam_buf, CAM_WIDTH * CAM_HIGH * 2, lcd_write_done, cam_buf);
 #endif
-        cam_give(cam_buf);
-        /*!< Use a logic analyzer to observe the frame rate */
+#ifdef CONFIG_CAM_STATS_ENABLE
+        cam_stats_t cam_stats;
+
+        if (cam_get_stats(&cam_stats) == ESP_OK && cam_stats.captured >= 100) {
+            ESP_LOGI(TAG, "fps: %.1f, capture: %u us, vsync latency: %u us, copy: %u us, take wait: %u us, dropped: %u\n",
+                     cam_stats.fps, cam_stats.capture.avg, cam_stats.vsync_latency.avg, cam_stats.copy.avg, cam_stats.take_wait.avg, cam_stats.dropped);
+            cam_reset_stats();
+        }
+#else
+        /*!< Use a logic analyzer to observe the frame rate, or enable CONFIG_CAM_STATS_ENABLE */
         gpio_set_level(LCD_BK, 1);
         gpio_set_level(LCD_BK, 0);
+#endif
     }
 
 
@@ -0,0 +1,435 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*!< FreeRTOS on pthreads for the host tests, modelling the single core ESP32-S2: one task runs at a time,
+ *   a task runs until it blocks, delays or yields, and tasks that become ready run in FIFO order.
+ *   Priorities are ignored. Interrupts do not exist, the drivers under test raise their events from tasks */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "host_test.h"
+
+typedef struct host_task {
+    TaskFunction_t func;
+    void *arg;
+    pthread_t thread;
+    pthread_cond_t cond;
+    uint32_t notify;
+    const void *blocked_on;   /*!< Object the task waits for, NULL if ready or running */
+    bool deleted;
+    struct host_task *next;   /*!< All tasks */
+    struct host_task *ready_next;
+} host_task_t;
+
+typedef struct {
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t *storage;
+} host_queue_t;
+
+static pthread_mutex_t host_lock = PTHREAD_MUTEX_INITIALIZER;
+static host_task_t *host_tasks;
+static host_task_t *host_ready_head;
+static host_task_t *host_ready_tail;
+static host_task_t *host_running;
+static __thread host_task_t *host_self;
+static int64_t host_start_time;
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void host_ready_push(host_task_t *task)
+{
+    task->ready_next = NULL;
+
+    if (host_ready_tail) {
+        host_ready_tail->ready_next = task;
+    } else {
+        host_ready_head = task;
+    }
+
+    host_ready_tail = task;
+}
+
+/*!< Hand the CPU to the next ready task, host_lock held */
+static void host_cpu_put(void)
+{
+    host_running = host_ready_head;
+
+    if (host_ready_head) {
+        host_ready_head = host_ready_head->ready_next;
+
+        if (!host_ready_head) {
+            host_ready_tail = NULL;
+        }
+
+        pthread_cond_signal(&host_running->cond);
+    }
+}
+
+/*!< Wait for the CPU, host_lock held. A task deleted meanwhile ends here */
+static void host_cpu_get(void)
+{
+    if (!host_running && !host_self->deleted) {
+        host_running = host_self;
+    } else if (!host_self->deleted) {
+        host_ready_push(host_self);
+    }
+
+    while (host_running != host_self && !host_self->deleted) {
+        pthread_cond_wait(&host_self->cond, &host_lock);
+    }
+
+    if (host_self->deleted) {
+        pthread_mutex_unlock(&host_lock);
+        pthread_exit(NULL);
+    }
+}
+
+/*!< Give up the CPU until host_wake(obj) makes the task ready and it is its turn, host_lock held */
+static void host_block_on(const void *obj)
+{
+    host_self->blocked_on = obj;
+    host_cpu_put();
+
+    while (host_running != host_self && !host_self->deleted) {
+        pthread_cond_wait(&host_self->cond, &host_lock);
+    }
+
+    if (host_self->deleted) {
+        pthread_mutex_unlock(&host_lock);
+        pthread_exit(NULL);
+    }
+}
+
+/*!< Make the tasks waiting for obj ready, they run once the caller gives up the CPU, host_lock held */
+static void host_wake(const void *obj)
+{
+    for (host_task_t *task = host_tasks; task; task = task->next) {
+        if (task->blocked_on == obj && !task->deleted) {
+            task->blocked_on = NULL;
+
+            if (host_running) {
+                host_ready_push(task);
+            } else {
+                host_running = task;
+                pthread_cond_signal(&task->cond);
+            }
+        }
+    }
+}
+
+static host_task_t *host_task_new(TaskFunction_t func, void *arg)
+{
+    host_task_t *task = calloc(1, sizeof(host_task_t));
+
+    task->func = func;
+    task->arg = arg;
+    pthread_cond_init(&task->cond, NULL);
+    task->next = host_tasks;
+    host_tasks = task;
+    return task;
+}
+
+void host_test_start(void)
+{
+    pthread_mutex_lock(&host_lock);
+
+    if (!host_self) {
+        host_start_time = esp_timer_get_time();
+        host_self = host_task_new(NULL, NULL);
+        host_cpu_get();
+    }
+
+    pthread_mutex_unlock(&host_lock);
+}
+
+static void *host_task_entry(void *arg)
+{
+    host_self = arg;
+    pthread_mutex_lock(&host_lock);
+    host_cpu_get();
+    pthread_mutex_unlock(&host_lock);
+    host_self->func(host_self->arg);
+    vTaskDelete(NULL);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t func, const char *name, uint32_t stack, void *arg, UBaseType_t pri, TaskHandle_t *handle)
+{
+    pthread_attr_t attr;
+
+    pthread_mutex_lock(&host_lock);
+    host_task_t *task = host_task_new(func, arg);
+    pthread_mutex_unlock(&host_lock);
+
+    if (handle) {
+        *handle = task;
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_create(&task->thread, &attr, host_task_entry, task);
+    pthread_attr_destroy(&attr);
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t handle)
+{
+    host_task_t *task = handle ? handle : host_self;
+
+    pthread_mutex_lock(&host_lock);
+
+    for (host_task_t **ready = &host_ready_head; *ready; ready = &(*ready)->ready_next) {
+        if (*ready == task) {
+            *ready = task->ready_next;
+            break;
+        }
+    }
+
+    host_ready_tail = host_ready_head;
+
+    while (host_ready_tail && host_ready_tail->ready_next) {
+        host_ready_tail = host_ready_tail->ready_next;
+    }
+
+    task->deleted = true;
+    pthread_cond_signal(&task->cond); /*!< Blocked or waiting for the CPU, it exits on its own */
+
+    if (task == host_self) {
+        host_cpu_put();
+        pthread_mutex_unlock(&host_lock);
+        pthread_exit(NULL);
+    }
+
+    pthread_mutex_unlock(&host_lock);
+}
+
+void vPortYield(void)
+{
+    pthread_mutex_lock(&host_lock);
+    host_cpu_put();
+    host_cpu_get();
+    pthread_mutex_unlock(&host_lock);
+}
+
+/*!< Sleep without the CPU, other tasks run meanwhile */
+static void host_sleep_until(int64_t until)
+{
+    int64_t now;
+
+    pthread_mutex_lock(&host_lock);
+    host_cpu_put();
+    pthread_mutex_unlock(&host_lock);
+
+    while ((now = esp_timer_get_time()) < until) {
+        struct timespec ts = {
+            .tv_sec = (until - now) / 1000000,
+            .tv_nsec = ((until - now) % 1000000) * 1000
+        };
+        nanosleep(&ts, NULL);
+    }
+
+    pthread_mutex_lock(&host_lock);
+    host_cpu_get();
+    pthread_mutex_unlock(&host_lock);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    host_sleep_until(esp_timer_get_time() + ticks * 1000LL);
+}
+
+void vTaskDelayUntil(TickType_t *previous_wake, TickType_t increment)
+{
+    *previous_wake += increment;
+    host_sleep_until(host_start_time + *previous_wake * 1000LL);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (esp_timer_get_time() - host_start_time) / 1000;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t wait)
+{
+    uint32_t value;
+
+    pthread_mutex_lock(&host_lock);
+
+    while (!host_self->notify && wait) {
+        host_block_on(host_self);
+    }
+
+    value = host_self->notify;
+
+    if (value) {
+        host_self->notify = clear_on_exit ? 0 : value - 1;
+    }
+
+    pthread_mutex_unlock(&host_lock);
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle)
+{
+    host_task_t *task = handle;
+
+    pthread_mutex_lock(&host_lock);
+    task->notify++;
+    host_wake(task);
+    pthread_mutex_unlock(&host_lock);
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t handle, BaseType_t *woken)
+{
+    xTaskNotifyGive(handle);
+
+    if (woken) {
+        *woken = pdTRUE;
+    }
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    host_queue_t *queue = calloc(1, sizeof(host_queue_t));
+
+    queue->length = length;
+    queue->item_size = item_size;
+    queue->storage = calloc(length, item_size ? item_size : 1);
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t handle)
+{
+    host_queue_t *queue = handle;
+
+    free(queue->storage);
+    free(queue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t handle, const void *item, TickType_t wait)
+{
+    host_queue_t *queue = handle;
+
+    pthread_mutex_lock(&host_lock);
+
+    while (queue->count == queue->length) {
+        if (!wait) {
+            pthread_mutex_unlock(&host_lock);
+            return pdFALSE;
+        }
+
+        host_block_on(queue);
+    }
+
+    if (queue->item_size) { /*!< Semaphores carry no data */
+        memcpy(queue->storage + ((queue->head + queue->count) % queue->length) * queue->item_size, item, queue->item_size);
+    }
+
+    queue->count++;
+    host_wake(queue);
+    pthread_mutex_unlock(&host_lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t handle, const void *item, BaseType_t *woken)
+{
+    return xQueueSend(handle, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t handle, void *item, TickType_t wait)
+{
+    host_queue_t *queue = handle;
+
+    pthread_mutex_lock(&host_lock);
+
+    while (!queue->count) {
+        if (!wait) {
+            pthread_mutex_unlock(&host_lock);
+            return pdFALSE;
+        }
+
+        host_block_on(queue);
+    }
+
+    if (queue->item_size) {
+        memcpy(item, queue->storage + queue->head * queue->item_size, queue->item_size);
+    }
+
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    host_wake(queue);
+    pthread_mutex_unlock(&host_lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueReset(QueueHandle_t handle)
+{
+    host_queue_t *queue = handle;
+
+    pthread_mutex_lock(&host_lock);
+    queue->head = 0;
+    queue->count = 0;
+    host_wake(queue);
+    pthread_mutex_unlock(&host_lock);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t handle)
+{
+    return ((host_queue_t *)handle)->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t sem = xSemaphoreCreateBinary();
+
+    xSemaphoreGive(sem);
+    return sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait)
+{
+    return xQueueReceive(sem, NULL, wait);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    return xQueueSend(sem, NULL, 0);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    vQueueDelete(sem);
+}
@@ -0,0 +1,284 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*!< The IDF functions the drivers call besides FreeRTOS: heap, cache, peripherals and pins.
+ *   Pins and peripherals are accepted and ignored, the host tests use the synthetic sources.
+ *   No slave answers on the I2C bus, every command list fails */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "esp_system.h"
+#include "esp_intr_alloc.h"
+#include "driver/gpio.h"
+#include "driver/i2c.h"
+#include "driver/ledc.h"
+#include "soc/i2s_struct.h"
+#include "soc/soc_memory_layout.h"
+#include "esp32s2/rom/cache.h"
+#include "hal/gpio_ll.h"
+
+#define HOST_HEAP_SIZE  (64 << 20)
+#define HOST_HEAP_ALIGN (16)
+
+typedef struct {
+    size_t size;              /*!< Bytes after the header */
+    size_t used;
+    uint8_t pad[HOST_HEAP_ALIGN - 2 * sizeof(size_t)];
+} host_heap_block_t;
+
+i2s_dev_t I2S0;
+gpio_dev_t GPIO;
+uint32_t GPIO_PIN_MUX_REG[64];
+
+static uint8_t *host_heap;
+static size_t host_heap_end;
+static const uint8_t *host_psram_start;
+static const uint8_t *host_psram_end;
+static host_cache_stats_t host_cache_stats;
+
+/*!< First fit over the blocks in address order, the arena lies below 4 GB like the ESP32-S2 address space */
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    size = (size + HOST_HEAP_ALIGN - 1) & ~(size_t)(HOST_HEAP_ALIGN - 1);
+
+    if (!host_heap) {
+        host_heap = mmap(NULL, HOST_HEAP_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+
+        if (host_heap == MAP_FAILED) {
+            abort();
+        }
+    }
+
+    for (size_t pos = 0; pos < host_heap_end; pos += sizeof(host_heap_block_t) + ((host_heap_block_t *)&host_heap[pos])->size) {
+        host_heap_block_t *block = (host_heap_block_t *)&host_heap[pos];
+
+        if (block->used || block->size < size) {
+            continue;
+        }
+
+        if (block->size >= size + 2 * sizeof(host_heap_block_t)) { /*!< Split, the rest stays free */
+            host_heap_block_t *rest = (host_heap_block_t *)((uint8_t *)(block + 1) + size);
+            rest->size = block->size - size - sizeof(host_heap_block_t);
+            rest->used = 0;
+            block->size = size;
+        }
+
+        block->used = 1;
+        return block + 1;
+    }
+
+    if (host_heap_end + sizeof(host_heap_block_t) + size > HOST_HEAP_SIZE) {
+        return NULL;
+    }
+
+    host_heap_block_t *block = (host_heap_block_t *)&host_heap[host_heap_end];
+    block->size = size;
+    block->used = 1;
+    host_heap_end += sizeof(host_heap_block_t) + size;
+    return block + 1;
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+    void *ptr = heap_caps_malloc(n * size, caps);
+
+    if (ptr) {
+        memset(ptr, 0, n * size);
+    }
+
+    return ptr;
+}
+
+void heap_caps_free(void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+
+    if ((uint8_t *)ptr < host_heap || (uint8_t *)ptr >= host_heap + HOST_HEAP_SIZE) {
+        free(ptr);
+        return;
+    }
+
+    host_heap_block_t *block = (host_heap_block_t *)ptr - 1;
+    block->used = 0;
+
+    /*!< Merge with the free blocks after it */
+    for (host_heap_block_t *next = (host_heap_block_t *)((uint8_t *)(block + 1) + block->size);
+            (uint8_t *)next < host_heap + host_heap_end && !next->used;
+            next = (host_heap_block_t *)((uint8_t *)(block + 1) + block->size)) {
+        block->size += sizeof(host_heap_block_t) + next->size;
+    }
+}
+
+void host_set_external_ram(const void *start, const void *end)
+{
+    host_psram_start = start;
+    host_psram_end = end;
+}
+
+bool esp_ptr_external_ram(const void *p)
+{
+    return (const uint8_t *)p >= host_psram_start && (const uint8_t *)p < host_psram_end;
+}
+
+void Cache_WriteBack_Addr(uint32_t addr, uint32_t size)
+{
+    host_cache_stats.writeback_num++;
+    host_cache_stats.last_writeback_addr = addr;
+}
+
+void Cache_Invalidate_Addr(uint32_t addr, uint32_t size)
+{
+    host_cache_stats.invalidate_num++;
+    host_cache_stats.last_invalidate_addr = addr;
+}
+
+void host_cache_get_stats(host_cache_stats_t *stats)
+{
+    *stats = host_cache_stats;
+}
+
+void ets_delay_us(uint32_t us)
+{
+}
+
+void periph_module_enable(periph_module_t periph)
+{
+}
+
+esp_err_t esp_intr_alloc(int source, int flags, intr_handler_t handler, void *arg, intr_handle_t *ret_handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_intr_free(intr_handle_t handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio_num, gpio_pull_mode_t pull)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    return ESP_OK;
+}
+
+void gpio_matrix_in(uint32_t gpio, uint32_t signal_idx, bool inv)
+{
+}
+
+void gpio_matrix_out(uint32_t gpio, uint32_t signal_idx, bool out_inv, bool oen_inv)
+{
+}
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2c_param_config(i2c_port_t i2c_num, const i2c_config_t *i2c_conf)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t i2c_num, i2c_mode_t mode, size_t slv_rx_buf_len, size_t slv_tx_buf_len, int intr_alloc_flags)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_delete(i2c_port_t i2c_num)
+{
+    return ESP_OK;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create(void)
+{
+    return malloc(1);
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle)
+{
+    free(cmd_handle);
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd_handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd_handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd_handle, uint8_t data, bool ack_en)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd_handle, const uint8_t *data, size_t data_len, bool ack_en)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd_handle, uint8_t *data, i2c_ack_type_t ack)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t i2c_num, i2c_cmd_handle_t cmd_handle, TickType_t ticks_to_wait)
+{
+    return ESP_FAIL; /*!< No ACK */
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+typedef int gpio_num_t;
+
+typedef enum {
+    GPIO_PIN_INTR_DISABLE = 0,
+    GPIO_PIN_INTR_POSEDGE = 1,
+    GPIO_PIN_INTR_NEGEDGE = 2,
+} gpio_int_type_t;
+
+typedef enum {
+    GPIO_MODE_INPUT = 1,
+    GPIO_MODE_OUTPUT = 2,
+} gpio_mode_t;
+
+typedef enum {
+    GPIO_PULLUP_DISABLE = 0,
+    GPIO_PULLUP_ENABLE = 1,
+} gpio_pullup_t;
+
+typedef enum {
+    GPIO_PULLDOWN_DISABLE = 0,
+    GPIO_PULLDOWN_ENABLE = 1,
+} gpio_pulldown_t;
+
+typedef enum {
+    GPIO_PULLUP_ONLY,
+    GPIO_PULLDOWN_ONLY,
+    GPIO_PULLUP_PULLDOWN,
+    GPIO_FLOATING,
+} gpio_pull_mode_t;
+
+typedef struct {
+    uint64_t pin_bit_mask;
+    gpio_mode_t mode;
+    gpio_pullup_t pull_up_en;
+    gpio_pulldown_t pull_down_en;
+    gpio_int_type_t intr_type;
+} gpio_config_t;
+
+typedef void (*gpio_isr_t)(void *);
+
+esp_err_t gpio_config(const gpio_config_t *config);
+esp_err_t gpio_install_isr_service(int intr_alloc_flags);
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args);
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num);
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num);
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode);
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio_num, gpio_pull_mode_t pull);
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level);
+void gpio_matrix_in(uint32_t gpio, uint32_t signal_idx, bool inv);
+void gpio_matrix_out(uint32_t gpio, uint32_t signal_idx, bool out_inv, bool oen_inv);
+
+extern uint32_t GPIO_PIN_MUX_REG[];
+
+#define PIN_FUNC_GPIO               2
+#define PIN_FUNC_SELECT(reg, func)  ((void)(reg), (void)(func))
+
+#define I2S0I_WS_IN_IDX     23
+#define I2S0I_V_SYNC_IDX    193
+#define I2S0I_H_SYNC_IDX    194
+#define I2S0I_H_ENABLE_IDX  195
+#define I2S0I_DATA_IN0_IDX  28
@@ -0,0 +1,6 @@
+#pragma once
+
+/*!< lcd.h includes it, the lcd driver drives the SPI registers itself */
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+
+/*!< No cache on the host, the calls are counted so tests can check the cache maintenance */
+
+typedef struct {
+    uint32_t writeback_num;
+    uint32_t invalidate_num;
+    uint32_t last_writeback_addr;
+    uint32_t last_invalidate_addr;
+} host_cache_stats_t;
+
+void Cache_WriteBack_Addr(uint32_t addr, uint32_t size);
+void Cache_Invalidate_Addr(uint32_t addr, uint32_t size);
+void host_cache_get_stats(host_cache_stats_t *stats);
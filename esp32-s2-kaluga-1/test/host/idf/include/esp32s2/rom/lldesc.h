@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef struct lldesc_s {
+    volatile uint32_t size   : 12,
+             length : 12,
+             offset : 5,
+             sosf   : 1,
+             eof    : 1,
+             owner  : 1;
+    volatile const uint8_t *buf;
+    union {
+        volatile uintptr_t empty; /*!< Pointer sized on the host, the drivers store 32 bit addresses in it */
+        struct {
+            struct lldesc_s *stqe_next;
+        } qe;
+    };
+} lldesc_t;
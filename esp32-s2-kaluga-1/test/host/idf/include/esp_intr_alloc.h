@@ -0,0 +1,12 @@
+#pragma once
+
+#include "esp_err.h"
+
+typedef void *intr_handle_t;
+typedef void (*intr_handler_t)(void *arg);
+
+#define ESP_INTR_FLAG_LEVEL1    (1 << 1)
+#define ETS_I2S0_INTR_SOURCE    35
+
+esp_err_t esp_intr_alloc(int source, int flags, intr_handler_t handler, void *arg, intr_handle_t *ret_handle);
+esp_err_t esp_intr_free(intr_handle_t handle);
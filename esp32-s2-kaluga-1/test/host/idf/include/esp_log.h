@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdio.h>
+
+/*!< Errors and warnings go to stderr, the rest is compiled out to keep the test output readable. The arguments
+ *   stay referenced and the format checked, so a variable used only for logging does not warn */
+
+#define ESP_LOGE(tag, format, ...) fprintf(stderr, "E (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) fprintf(stderr, "W (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) do { if (0) fprintf(stderr, "I (%s) " format "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGD(tag, format, ...) do { if (0) fprintf(stderr, "D (%s) " format "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGV(tag, format, ...) do { if (0) fprintf(stderr, "V (%s) " format "\n", tag, ##__VA_ARGS__); } while (0)
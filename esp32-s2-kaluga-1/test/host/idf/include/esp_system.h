@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include "esp_err.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+
+void ets_delay_us(uint32_t us);
+
+typedef enum {
+    PERIPH_I2S0_MODULE = 0,
+} periph_module_t;
+
+void periph_module_enable(periph_module_t periph);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+/*!< Single core FreeRTOS on pthreads, see freertos_host.c. A tick is 1 ms */
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE             0
+#define pdTRUE              1
+#define pdPASS              pdTRUE
+#define pdFAIL              pdFALSE
+#define portMAX_DELAY       ((TickType_t)0xffffffff)
+#define portTICK_PERIOD_MS  1
+#define portTICK_RATE_MS    portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms))
+
+typedef struct {
+    uint32_t owner;
+    uint32_t count;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0, 0}
+
+/*!< Only one task runs at a time and the ISRs are called from tasks, a critical section has nothing to exclude */
+static inline void vPortCPUInitializeMutex(portMUX_TYPE *mux)
+{
+    mux->owner = 0;
+    mux->count = 0;
+}
+
+#define portENTER_CRITICAL(mux)     ((void)(mux))
+#define portEXIT_CRITICAL(mux)      ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux) ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux)  ((void)(mux))
+#define portYIELD_FROM_ISR()        ((void)0)
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack, void *arg, UBaseType_t pri, TaskHandle_t *handle);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t *previous_wake, TickType_t increment);
+TickType_t xTaskGetTickCount(void);
+void vPortYield(void);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t wait);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken);
+
+#define taskYIELD() vPortYield()
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "driver/gpio.h"
+
+typedef struct {
+    uint32_t in;
+} gpio_dev_t;
+
+extern gpio_dev_t GPIO;
+
+static inline int gpio_ll_get_level(gpio_dev_t *hw, int gpio_num)
+{
+    return (hw->in >> gpio_num) & 0x1;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Turn the calling thread into the first task, call it before any FreeRTOS function
+ */
+void host_test_start(void);
+
+/*!< Checks stay on with NDEBUG, a failure names the test source line and ends the test */
+#define HOST_CHECK(cond) do {                                                            \
+        if (!(cond)) {                                                                   \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);    \
+            fflush(NULL);                                                                \
+            _Exit(1);                                                                    \
+        }                                                                                \
+    } while (0)
+
+#ifdef __cplusplus
+}
+#endif
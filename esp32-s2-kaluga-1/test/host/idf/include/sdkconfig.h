@@ -0,0 +1,7 @@
+#pragma once
+
+/*!< Host build configuration, every optional driver feature the host tests cover is on */
+
+#define CONFIG_CAM_SIM_ENABLE 1
+#define CONFIG_CAM_STATS_ENABLE 1
+#define CONFIG_SCCB_SIM_ENABLE 1
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdint.h>
+
+/*!< The I2S0 fields the drivers touch, as plain memory. Nothing reacts to the writes */
+
+typedef union {
+    struct {
+        uint32_t in_suc_eof: 1;
+    };
+    uint32_t val;
+} i2s_int_reg_t;
+
+typedef volatile struct {
+    i2s_int_reg_t int_st;
+    i2s_int_reg_t int_clr;
+    i2s_int_reg_t int_ena;
+    union {
+        struct {
+            uint32_t clkm_div_num: 8;
+            uint32_t clkm_div_b:   6;
+            uint32_t clkm_div_a:   6;
+            uint32_t clk_sel:      2;
+            uint32_t clk_en:       1;
+        };
+        uint32_t val;
+    } clkm_conf;
+    union {
+        struct {
+            uint32_t tx_bck_div_num: 6;
+            uint32_t tx_bits_mod:    6;
+            uint32_t rx_bck_div_num: 6;
+            uint32_t rx_bits_mod:    6;
+        };
+        uint32_t val;
+    } sample_rate_conf;
+    union {
+        struct {
+            uint32_t tx_right_first: 1;
+            uint32_t tx_msb_right:   1;
+            uint32_t tx_dma_equal:   1;
+            uint32_t rx_right_first: 1;
+            uint32_t rx_msb_right:   1;
+            uint32_t rx_dma_equal:   1;
+            uint32_t rx_start:       1;
+            uint32_t rx_reset:       1;
+            uint32_t rx_fifo_reset:  1;
+        };
+        uint32_t val;
+    } conf;
+    union {
+        struct {
+            uint32_t tx_pcm_bypass: 1;
+            uint32_t tx_stop_en:    1;
+            uint32_t rx_pcm_bypass: 1;
+        };
+        uint32_t val;
+    } conf1;
+    union {
+        struct {
+            uint32_t cam_sync_fifo_reset:   1;
+            uint32_t lcd_en:                1;
+            uint32_t camera_en:             1;
+            uint32_t i_v_sync_filter_en:    1;
+            uint32_t i_v_sync_filter_thres: 3;
+        };
+        uint32_t val;
+    } conf2;
+    union {
+        struct {
+            uint32_t tx_chan_mod: 3;
+            uint32_t rx_chan_mod: 3;
+        };
+        uint32_t val;
+    } conf_chan;
+    union {
+        struct {
+            uint32_t rx_fifo_mod_force_en: 1;
+            uint32_t rx_data_num:          6;
+            uint32_t rx_fifo_mod:          3;
+            uint32_t tx_fifo_mod_force_en: 1;
+            uint32_t tx_data_num:          6;
+            uint32_t tx_fifo_mod:          3;
+            uint32_t dscr_en:              1;
+        };
+        uint32_t val;
+    } fifo_conf;
+    union {
+        struct {
+            uint32_t out_rst:      1;
+            uint32_t in_rst:       1;
+            uint32_t ahbm_fifo_rst: 1;
+            uint32_t ahbm_rst:     1;
+            uint32_t check_owner:  1;
+        };
+        uint32_t val;
+    } lc_conf;
+    union {
+        uint32_t val;
+    } timing;
+    union {
+        struct {
+            uint32_t addr:  20;
+            uint32_t stop:  1;
+            uint32_t start: 1;
+        };
+        uint32_t val;
+    } in_link;
+    uint32_t rx_eof_num;
+} i2s_dev_t;
+
+extern i2s_dev_t I2S0;
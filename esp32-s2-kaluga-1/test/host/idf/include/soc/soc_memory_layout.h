@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdbool.h>
+
+/*!< False unless a test marks a range as PSRAM with host_set_external_ram */
+bool esp_ptr_external_ram(const void *p);
+void host_set_external_ram(const void *start, const void *end);